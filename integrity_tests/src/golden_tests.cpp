@@ -0,0 +1,410 @@
+// Golden-image regression tests.
+//
+// A fixed matrix of (synthetic) volumes, camera poses and render configs is rendered through the reference path and
+// compared against the reference images stored in integrity_tests/golden/. Every fast render path is rendered with
+// the same matrix and compared against the reference path with per-mode tolerances. Paths that only approximate the
+// reference (splatting) also have reference images of their own, prefixed with the name of the path.
+//
+// To (re)generate the reference images, run the tests with the environment variable VOLVIS_UPDATE_GOLDEN=1.
+#include "test_classes.h"
+#include <algorithm>
+#include <array>
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <glm/common.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifndef GOLDEN_IMAGE_DIR
+#define GOLDEN_IMAGE_DIR "golden"
+#endif
+
+static constexpr glm::ivec2 imageResolution { 40, 40 };
+
+// Image with 8 bits per channel; the framebuffer is clamped to [0, 1] and quantized.
+struct GoldenImage {
+    glm::ivec2 resolution;
+    std::vector<uint8_t> rgba;
+};
+
+struct ImageError {
+    float maxAbs;
+    float psnr;
+    // Fraction of the pixels that differ by more than 2/255 in any channel.
+    float badPixelFraction;
+};
+
+struct Tolerance {
+    float maxAbs;
+    float minPSNR;
+    float maxBadPixelFraction;
+};
+
+static GoldenImage quantize(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
+{
+    GoldenImage out { resolution, std::vector<uint8_t>(frameBuffer.size() * 4) };
+    for (size_t i = 0; i < frameBuffer.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            const float v = std::clamp(frameBuffer[i][c], 0.0f, 1.0f);
+            out.rgba[i * 4 + size_t(c)] = uint8_t(std::lround(v * 255.0f));
+        }
+    }
+    return out;
+}
+
+// Images are stored in the (binary) portable arbitrary map format.
+static void writePAM(const std::filesystem::path& filePath, const GoldenImage& image)
+{
+    std::ofstream file { filePath, std::ios::binary };
+    file << "P7\nWIDTH " << image.resolution.x << "\nHEIGHT " << image.resolution.y << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    file.write(reinterpret_cast<const char*>(image.rgba.data()), std::streamsize(image.rgba.size()));
+}
+
+static std::optional<GoldenImage> readPAM(const std::filesystem::path& filePath)
+{
+    std::ifstream file { filePath, std::ios::binary };
+    if (!file.is_open())
+        return {};
+
+    GoldenImage out {};
+    std::string token;
+    while (file >> token && token != "ENDHDR") {
+        if (token == "WIDTH")
+            file >> out.resolution.x;
+        else if (token == "HEIGHT")
+            file >> out.resolution.y;
+    }
+    file.get(); // Newline after ENDHDR.
+    out.rgba.resize(size_t(out.resolution.x) * size_t(out.resolution.y) * 4);
+    file.read(reinterpret_cast<char*>(out.rgba.data()), std::streamsize(out.rgba.size()));
+    if (!file)
+        return {};
+    return out;
+}
+
+static ImageError compareImages(const GoldenImage& reference, const GoldenImage& test)
+{
+    REQUIRE(reference.resolution == test.resolution);
+
+    ImageError error { 0.0f, 0.0f, 0.0f };
+    double squaredErrorSum = 0.0;
+    size_t badPixels = 0;
+    for (size_t pixel = 0; pixel < reference.rgba.size() / 4; pixel++) {
+        bool bad = false;
+        for (size_t c = 0; c < 4; c++) {
+            const float diff = std::abs(float(reference.rgba[pixel * 4 + c]) - float(test.rgba[pixel * 4 + c])) / 255.0f;
+            error.maxAbs = std::max(error.maxAbs, diff);
+            squaredErrorSum += double(diff) * double(diff);
+            bad |= diff > 2.0f / 255.0f;
+        }
+        badPixels += bad ? 1 : 0;
+    }
+    const double mse = squaredErrorSum / double(reference.rgba.size());
+    error.psnr = mse > 0.0 ? float(10.0 * std::log10(1.0 / mse)) : std::numeric_limits<float>::infinity();
+    error.badPixelFraction = float(badPixels) / float(reference.rgba.size() / 4);
+    return error;
+}
+
+static void requireWithinTolerance(const ImageError& error, const Tolerance& tolerance)
+{
+    INFO(fmt::format("max abs error: {}, PSNR: {} dB, bad pixels: {}%", error.maxAbs, error.psnr, error.badPixelFraction * 100.0f));
+    CHECK(error.maxAbs <= tolerance.maxAbs);
+    CHECK(error.psnr >= tolerance.minPSNR);
+    CHECK(error.badPixelFraction <= tolerance.maxBadPixelFraction);
+}
+
+// ==== Test matrix ====
+
+struct GoldenVolume {
+    std::string name;
+    std::function<float(const glm::vec3&)> density;
+    glm::ivec3 dims;
+};
+
+static volume::Volume createVolume(const GoldenVolume& desc)
+{
+    std::vector<uint16_t> data;
+    data.reserve(size_t(desc.dims.x) * size_t(desc.dims.y) * size_t(desc.dims.z));
+    for (int z = 0; z < desc.dims.z; z++) {
+        for (int y = 0; y < desc.dims.y; y++) {
+            for (int x = 0; x < desc.dims.x; x++)
+                data.push_back(uint16_t(std::clamp(std::lround(desc.density(glm::vec3(x, y, z))), 0L, 65535L)));
+        }
+    }
+    return volume::Volume(std::move(data), desc.dims);
+}
+
+static std::vector<GoldenVolume> goldenVolumes()
+{
+    return {
+        // Nested spherical shells with a non-cubic size to catch mixed up strides.
+        { "shells", [](const glm::vec3& p) {
+             const float r = glm::length(p - glm::vec3(15.5f, 13.5f, 17.5f));
+             return r > 13.0f ? 0.0f : 110.0f + 100.0f * std::cos(r * 0.7f);
+         },
+            glm::ivec3(32, 28, 36) },
+        // Overlapping blobs on top of a low amplitude ripple (mostly semi-transparent).
+        { "blobs", [](const glm::vec3& p) {
+             const auto blob = [&](const glm::vec3& c, float s) { return std::exp(-glm::dot(p - c, p - c) / (s * s)); };
+             const float ripple = 10.0f + 8.0f * std::sin(p.x * 0.5f) * std::sin(p.y * 0.4f) * std::sin(p.z * 0.3f);
+             return ripple + 220.0f * blob(glm::vec3(10, 12, 14), 6.0f) + 160.0f * blob(glm::vec3(20, 18, 12), 5.0f);
+         },
+            glm::ivec3(30, 30, 30) }
+    };
+}
+
+struct GoldenPose {
+    std::string name;
+    glm::vec3 position; // Relative to the volume size (1 = volume dims).
+};
+
+static std::vector<GoldenPose> goldenPoses()
+{
+    return { { "front", glm::vec3(0.5f, 0.5f, -1.4f) }, { "oblique", glm::vec3(1.6f, 1.3f, 1.9f) } };
+}
+
+struct GoldenConfig {
+    std::string name;
+    render::RenderMode renderMode;
+    bool volumeShading;
+};
+
+static std::vector<GoldenConfig> goldenConfigs()
+{
+    return {
+        { "slicer", render::RenderMode::RenderSlicer, false },
+        { "mip", render::RenderMode::RenderMIP, false },
+        { "iso", render::RenderMode::RenderIso, false },
+        { "iso_shaded", render::RenderMode::RenderIso, true },
+        { "composite", render::RenderMode::RenderComposite, false },
+        { "composite_shaded", render::RenderMode::RenderComposite, true },
+        { "tf2d", render::RenderMode::RenderTF2D, false }
+    };
+}
+
+static std::vector<std::pair<std::string, volume::InterpolationMode>> goldenInterpolationModes()
+{
+    return {
+        { "nn", volume::InterpolationMode::NearestNeighbour },
+        { "linear", volume::InterpolationMode::Linear },
+        { "cubic", volume::InterpolationMode::Cubic }
+    };
+}
+
+static render::RenderConfig createRenderConfig(const GoldenConfig& desc, const volume::Volume& volume)
+{
+    render::RenderConfig config {};
+    config.renderMode = desc.renderMode;
+    config.renderResolution = imageResolution;
+    config.volumeShading = desc.volumeShading;
+    config.isoValue = 120.0f;
+    // Transfer function: dark blue & transparent for low values to bright orange & more opaque for high values.
+    for (size_t i = 0; i < config.tfColorMap.size(); i++) {
+        const float t = float(i) / float(config.tfColorMap.size() - 1);
+        config.tfColorMap[i] = glm::vec4(t, 0.6f * t, 1.0f - t, 0.12f * t * t);
+    }
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = volume.maximum();
+    config.TF2DIntensity = 150.0f;
+    config.TF2DRadius = 60.0f;
+    config.TF2DColor = glm::vec4(0.0f, 0.8f, 0.6f, 0.3f);
+    // The reference is traced one sample at a time; the SIMD kernels are fast paths.
+    config.simdLevel = render::kernels::SimdLevel::Scalar;
+    return config;
+}
+
+// A way of rendering an image. The reference path renders with the default config through Renderer::render().
+// Fast paths modify the config (and/or call a different entry point) and must stay within their tolerance.
+struct RenderPath {
+    std::string name;
+    std::function<void(render::RenderConfig&)> configure;
+    std::function<void(render::Renderer&)> render;
+    std::function<Tolerance(const GoldenConfig&, volume::InterpolationMode)> tolerance;
+};
+
+static void renderDefault(render::Renderer& renderer)
+{
+    renderer.render();
+}
+
+static void configureSplatting(render::RenderConfig& config)
+{
+    config.renderBackend = render::RenderBackend::Splatting;
+}
+
+static std::vector<RenderPath> fastRenderPaths()
+{
+    const auto exact = [](const GoldenConfig&, volume::InterpolationMode) { return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f }; };
+    const auto simd = [](render::kernels::SimdLevel level) { return [=](render::RenderConfig& config) { config.simdLevel = level; }; };
+    return {
+        // Deadline-driven rendering with a generous budget must produce exactly the same image.
+        { "deadline", [](render::RenderConfig&) {},
+            [](render::Renderer& renderer) {
+                const auto tileMask = renderer.render(render::Renderer::Clock::now() + std::chrono::hours(1));
+                REQUIRE(tileMask.allComplete());
+            },
+            exact },
+        // Exact cell traversal visits voxels and thin features that fixed steps skip, so it does not match the
+        // reference everywhere (most visibly with nearest neighbour). Modes that it does not affect must be identical.
+        { "cell_traversal", [](render::RenderConfig& config) { config.cellTraversal = true; }, renderDefault,
+            [](const GoldenConfig& config, volume::InterpolationMode interpolationMode) {
+                const bool nearest = interpolationMode == volume::InterpolationMode::NearestNeighbour;
+                if (config.renderMode == render::RenderMode::RenderIso || (config.renderMode == render::RenderMode::RenderMIP && nearest))
+                    return nearest ? Tolerance { 1.0f, 25.0f, 0.15f } : Tolerance { 1.0f, 35.0f, 0.01f };
+                return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f };
+            } },
+        // MIP rays only skip samples that cannot raise their maximum, so the images must be identical.
+        { "max_pyramid", [](render::RenderConfig& config) { config.maxPyramidTraversal = true; }, renderDefault, exact },
+        // Rays skip the uniform tiles of the sparse copy of the volume, whose samples all have the same value. The
+        // sample positions are computed rather than stepped, so they differ in the last bits: isosurface hits may move to
+        // the neighbouring sample where the surface touches a sample position (on at most 0.5% of the pixels, as in
+        // "Sparse Volume Tests"), and composited colors may round to the next 8-bit value. MIP and the modes that do not
+        // skip (2D transfer functions, cubic interpolation) must be identical.
+        { "sparse", [](render::RenderConfig& config) { config.sparseTraversal = true; }, renderDefault,
+            [](const GoldenConfig& config, volume::InterpolationMode interpolationMode) {
+                if (interpolationMode == volume::InterpolationMode::Cubic)
+                    return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f };
+                if (config.renderMode == render::RenderMode::RenderIso)
+                    return Tolerance { 1.0f, 0.0f, 0.005f };
+                if (config.renderMode == render::RenderMode::RenderComposite)
+                    return Tolerance { 1.0f / 255.0f, 60.0f, 0.0f };
+                return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f };
+            } },
+        // The ray sampler interpolates exactly like the volume.
+        { "ray_sampler", [](render::RenderConfig& config) { config.reuseCellCorners = true; }, renderDefault, exact },
+        // The SIMD kernels round exactly like the scalar code. Levels that this machine does not support fall back to
+        // the scalar code.
+        { "simd_sse42", simd(render::kernels::SimdLevel::SSE42), renderDefault, exact },
+        { "simd_avx2", simd(render::kernels::SimdLevel::AVX2), renderDefault, exact },
+        { "simd_avx512", simd(render::kernels::SimdLevel::AVX512), renderDefault, exact },
+        // Fixed-point interpolation quantizes the interpolation weights, which only affects the kernel paths (linear
+        // MIP, compositing and 2D transfer function).
+        { "fixed_point",
+            [](render::RenderConfig& config) {
+                config.simdLevel = render::kernels::detectSimdLevel();
+                config.fixedPointInterpolation = true;
+            },
+            renderDefault,
+            [](const GoldenConfig& config, volume::InterpolationMode interpolationMode) {
+                const bool kernels = interpolationMode == volume::InterpolationMode::Linear
+                    && (config.renderMode == render::RenderMode::RenderMIP || config.renderMode == render::RenderMode::RenderComposite
+                        || config.renderMode == render::RenderMode::RenderTF2D);
+                if (kernels)
+                    return Tolerance { 2.0f / 255.0f, 60.0f, 0.0f };
+                return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f };
+            } },
+        // Splatting composites the footprints of the voxels instead of samples along the rays, so MIP and compositing
+        // are close to the reference but not the same: MIP footprints widen thin features at this image size, and the
+        // footprints do not follow the cubic B-spline. The other modes are ray cast as usual. The bounds are the
+        // largest errors measured at the time of writing plus a small margin; regressions within them are caught by
+        // the reference images of splatting itself (see "Golden images: splatting").
+        { "splatting", configureSplatting, renderDefault,
+            [](const GoldenConfig& config, volume::InterpolationMode interpolationMode) {
+                const bool nearest = interpolationMode == volume::InterpolationMode::NearestNeighbour;
+                if (config.renderMode == render::RenderMode::RenderMIP)
+                    return nearest ? Tolerance { 0.24f, 32.0f, 0.13f } : Tolerance { 0.26f, 28.0f, 0.27f };
+                if (config.renderMode == render::RenderMode::RenderComposite)
+                    return interpolationMode == volume::InterpolationMode::Cubic ? Tolerance { 0.6f, 22.5f, 0.27f } : Tolerance { 0.07f, 41.5f, 0.2f };
+                return Tolerance { 0.0f, std::numeric_limits<float>::infinity(), 0.0f };
+            } },
+    };
+}
+
+// Render every combination of the test matrix with the given path and call the callback with the image.
+static void forEachGoldenImage(
+    const std::function<void(render::RenderConfig&)>& configure,
+    const std::function<void(render::Renderer&)>& render,
+    const std::function<void(const std::string&, const GoldenConfig&, volume::InterpolationMode, const GoldenImage&)>& callback)
+{
+    for (const GoldenVolume& volumeDesc : goldenVolumes()) {
+        volume::Volume volume = createVolume(volumeDesc);
+        volume::GradientVolume gradientVolume { volume };
+        for (const GoldenPose& pose : goldenPoses()) {
+            const glm::vec3 dims { volume.dims() };
+            const TestCamera camera { pose.position * dims, dims / 2.0f };
+            for (const auto& [interpolationName, interpolationMode] : goldenInterpolationModes()) {
+                volume.interpolationMode = interpolationMode;
+                gradientVolume.interpolationMode = interpolationMode;
+                for (const GoldenConfig& configDesc : goldenConfigs()) {
+                    render::RenderConfig config = createRenderConfig(configDesc, volume);
+                    configure(config);
+                    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+                    render(renderer);
+
+                    const std::string name = fmt::format("{}_{}_{}_{}", volumeDesc.name, pose.name, configDesc.name, interpolationName);
+                    callback(name, configDesc, interpolationMode, quantize(renderer.frameBuffer(), imageResolution));
+                }
+            }
+        }
+    }
+}
+
+// Compare the images of the test matrix that are rendered with configure, of the render modes for which include
+// returns true, against the reference images <prefix><name>.pam (or store them with VOLVIS_UPDATE_GOLDEN).
+static void requireGoldenImages(
+    const std::string& prefix,
+    const std::function<void(render::RenderConfig&)>& configure,
+    const std::function<bool(const GoldenConfig&)>& include)
+{
+    const std::filesystem::path goldenDir { GOLDEN_IMAGE_DIR };
+    const bool update = std::getenv("VOLVIS_UPDATE_GOLDEN") != nullptr;
+    if (update)
+        std::filesystem::create_directories(goldenDir);
+
+    forEachGoldenImage(
+        configure, renderDefault,
+        [&](const std::string& name, const GoldenConfig& config, volume::InterpolationMode, const GoldenImage& image) {
+            if (!include(config))
+                return;
+            const std::filesystem::path filePath = goldenDir / (prefix + name + ".pam");
+            if (update) {
+                writePAM(filePath, image);
+                return;
+            }
+
+            INFO(name);
+            const auto optReference = readPAM(filePath);
+            INFO("Missing reference image; run the tests with VOLVIS_UPDATE_GOLDEN=1 to create it.");
+            REQUIRE(optReference.has_value());
+            // Allow for a few pixels that differ slightly due to floating-point differences between compilers /
+            // platforms.
+            requireWithinTolerance(compareImages(*optReference, image), Tolerance { 8.0f / 255.0f, 35.0f, 0.02f });
+        });
+}
+
+TEST_CASE("Golden images: reference path")
+{
+    requireGoldenImages("", [](render::RenderConfig&) {}, [](const GoldenConfig&) { return true; });
+}
+
+// The other render modes are ray cast, which the fast path "splatting" requires to match the reference exactly.
+TEST_CASE("Golden images: splatting")
+{
+    requireGoldenImages("splatting_", configureSplatting, [](const GoldenConfig& config) {
+        return config.renderMode == render::RenderMode::RenderMIP || config.renderMode == render::RenderMode::RenderComposite;
+    });
+}
+
+TEST_CASE("Golden images: fast paths")
+{
+    std::vector<GoldenImage> referenceImages;
+    forEachGoldenImage([](render::RenderConfig&) {}, renderDefault,
+        [&](const std::string&, const GoldenConfig&, volume::InterpolationMode, const GoldenImage& image) {
+            referenceImages.push_back(image);
+        });
+
+    for (const RenderPath& path : fastRenderPaths()) {
+        size_t i = 0;
+        forEachGoldenImage(path.configure, path.render,
+            [&](const std::string& name, const GoldenConfig& config, volume::InterpolationMode interpolationMode, const GoldenImage& image) {
+                INFO(fmt::format("{} ({})", name, path.name));
+                requireWithinTolerance(compareImages(referenceImages[i++], image), path.tolerance(config, interpolationMode));
+            });
+    }
+}
@@ -1,8 +1,17 @@
 #include <render/ray.h>
+#include <render/ray_trace_camera.h>
 #include <render/renderer.h>
 #include <volume/gradient_volume.h>
+#include <volume/procedural_volume.h>
+#include <volume/sparse_volume.h>
 #include <volume/volume.h>
+#include <array>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <limits>
 #include <utility>
+#include <vector>
 
 #define provide_member_function_access(func_name)      \
     template <typename... Args>                        \
@@ -31,6 +40,7 @@ public:
 
     provide_static_member_function_access(linearInterpolate)
     provide_const_member_function_access(getSampleTriLinearInterpolation)
+    provide_const_member_function_access(getSampleTriLinearInterpolationFast)
 
     provide_static_member_function_access(weight)
     provide_static_member_function_access(cubicInterpolate)
@@ -57,5 +67,136 @@ public:
     provide_member_function_access(traceRayTF2D)
 
     provide_member_function_access(bisectionAccuracy)
-    provide_member_function_access(computePhongShading)
-};
\ No newline at end of file
+    provide_static_member_function_access(computePhongShading)
+};
+
+// Pinhole camera with a fixed pose, used to render deterministic images without a window.
+class TestCamera : public render::RayTraceCamera {
+public:
+    TestCamera(const glm::vec3& position, const glm::vec3& lookAt, float fovy = 0.7f)
+        : m_position(position)
+        , m_forward(glm::normalize(lookAt - position))
+        , m_right(glm::normalize(glm::cross(m_forward, std::abs(m_forward.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0))))
+        , m_up(glm::cross(m_right, m_forward))
+        , m_halfScreenSize(std::tan(fovy / 2.0f))
+    {
+    }
+
+    glm::vec3 position() const override { return m_position; }
+    glm::vec3 forward() const override { return m_forward; }
+
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        render::Ray ray;
+        ray.origin = m_position;
+        ray.direction = glm::normalize(m_forward + (pixel.x * m_halfScreenSize) * m_right + (pixel.y * m_halfScreenSize) * m_up);
+        ray.tmin = std::numeric_limits<float>::lowest();
+        ray.tmax = std::numeric_limits<float>::max();
+        return ray;
+    }
+
+private:
+    glm::vec3 m_position, m_forward, m_right, m_up;
+    float m_halfScreenSize;
+};
+
+// Orthographic camera with a fixed pose: parallel rays from a square screen of 2 * halfScreenSize voxels around position.
+class TestOrthographicCamera : public render::RayTraceCamera {
+public:
+    TestOrthographicCamera(const glm::vec3& position, const glm::vec3& lookAt, float halfScreenSize)
+        : m_position(position)
+        , m_forward(glm::normalize(lookAt - position))
+        , m_right(glm::normalize(glm::cross(m_forward, std::abs(m_forward.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0))))
+        , m_up(glm::cross(m_right, m_forward))
+        , m_halfScreenSize(halfScreenSize)
+    {
+    }
+
+    glm::vec3 position() const override { return m_position; }
+    glm::vec3 forward() const override { return m_forward; }
+    bool orthographic() const override { return true; }
+
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        render::Ray ray;
+        ray.origin = m_position + (pixel.x * m_halfScreenSize) * m_right + (pixel.y * m_halfScreenSize) * m_up;
+        ray.direction = m_forward;
+        ray.tmin = std::numeric_limits<float>::lowest();
+        ray.tmax = std::numeric_limits<float>::max();
+        return ray;
+    }
+
+private:
+    glm::vec3 m_position, m_forward, m_right, m_up;
+    float m_halfScreenSize;
+};
+
+// The procedural volume that the tests of the render backends render, and the poses of the cameras around it: their
+// positions relative to the dimensions of the volume, looking at its centre. The first two look along an axis.
+struct TestScene {
+    TestScene()
+        : volume(volume::createProceduralVolume(settings()))
+        , gradientVolume(volume)
+        , dims(volume.dims())
+    {
+    }
+
+    TestCamera perspectiveCamera(const glm::vec3& pose) const { return TestCamera { pose * dims, dims / 2.0f }; }
+    TestOrthographicCamera orthographicCamera(const glm::vec3& pose) const { return TestOrthographicCamera { pose * dims, dims / 2.0f, 0.8f * glm::compMax(dims) }; }
+
+    static volume::ProceduralVolumeSettings settings()
+    {
+        volume::ProceduralVolumeSettings out;
+        out.dims = glm::ivec3(40, 36, 44);
+        return out;
+    }
+
+    volume::Volume volume;
+    volume::GradientVolume gradientVolume;
+    glm::vec3 dims;
+    static constexpr std::array<glm::vec3, 5> poses { glm::vec3(0.5f, 0.5f, -1.5f), glm::vec3(0.5f, 2.0f, 0.5f), glm::vec3(1.6f, 1.3f, 1.9f), glm::vec3(-1.2f, 0.4f, 0.6f), glm::vec3(0.45f, 2.0f, 0.3f) };
+};
+
+// A ramp from blue to yellow over the values [0, maximum], transparent below the entry firstOpaque.
+inline void setTestTransferFunction(render::RenderConfig& config, float maximum, size_t firstOpaque)
+{
+    for (size_t i = 0; i < config.tfColorMap.size(); i++) {
+        const float t = float(i) / float(config.tfColorMap.size() - 1);
+        config.tfColorMap[i] = glm::vec4(t, 0.6f * t, 1.0f - t, i < firstOpaque ? 0.0f : 0.15f * t);
+    }
+    config.tfColorMapIndexStart = 0.0f;
+    config.tfColorMapIndexRange = maximum;
+}
+
+// The framebuffer and statistics of a single frame.
+struct TestImage {
+    std::vector<glm::vec4> pixels;
+    render::RenderStats stats;
+};
+
+inline TestImage renderTestImage(const volume::Volume& volume, const volume::GradientVolume& gradientVolume, const render::RayTraceCamera& camera, const render::RenderConfig& config, const volume::SparseVolume* pSparseVolume = nullptr)
+{
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    if (pSparseVolume)
+        renderer.setSparseVolume(pSparseVolume);
+    renderer.render();
+    return TestImage { std::vector<glm::vec4>(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer())), renderer.stats() };
+}
+
+// The mean over the pixels of the largest difference of their channels.
+inline float meanImageError(const TestImage& lhs, const TestImage& rhs)
+{
+    float sumError = 0.0f;
+    for (size_t i = 0; i < lhs.pixels.size(); i++)
+        sumError += glm::compMax(glm::abs(lhs.pixels[i] - rhs.pixels[i]));
+    return sumError / float(lhs.pixels.size());
+}
+
+// The number of pixels with a channel that differs by more than tolerance.
+inline size_t numDifferentPixels(const TestImage& lhs, const TestImage& rhs, float tolerance)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < lhs.pixels.size(); i++)
+        out += glm::compMax(glm::abs(lhs.pixels[i] - rhs.pixels[i])) > tolerance;
+    return out;
+}
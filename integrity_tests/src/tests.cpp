@@ -1,9 +1,26 @@
 // Can access the header files from the viewer...
+#include "render/cell_walker.h"
+#include "render/kernels.h"
+#include "render/shear_warp.h"
+#include "render/splatting.h"
 #include "test_classes.h"
 #include "ui/window.h"
+#include "volume/max_pyramid.h"
+#include "volume/procedural_volume.h"
+#include "volume/ray_sampler.h"
+#include "volume/sparse_volume.h"
 #include <algorithm>
 #include <catch2/catch.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <limits>
+#include <numeric>
+#include <tuple>
 
 /*
 GradientVolume:
@@ -37,6 +54,1041 @@ TEST_CASE("Volume Tests")
     REQUIRE_NOTHROW(volume.test_getSampleTriCubicInterpolation(glm::vec3(2.5f)));
 }
 
+TEST_CASE("Downsample Tests")
+{
+    const glm::ivec3 dim { 7, 5, 6 };
+    std::vector<int16_t> voxels(size_t(dim.x * dim.y * dim.z));
+    std::iota(std::begin(voxels), std::end(voxels), int16_t(-100));
+    const volume::Volume volume { voxels, dim };
+
+    const volume::Volume preview = volume.downsample(3);
+    REQUIRE(preview.dims() == glm::ivec3(3, 2, 2));
+    REQUIRE(preview.voxelType() == volume::VoxelType::Int16);
+    for (int z = 0; z < preview.dims().z; z++) {
+        for (int y = 0; y < preview.dims().y; y++) {
+            for (int x = 0; x < preview.dims().x; x++)
+                REQUIRE(preview.getVoxel(x, y, z) == volume.getVoxel(3 * x, 3 * y, 3 * z));
+        }
+    }
+}
+
+TEST_CASE("Fast Trilinear Interpolation Tests")
+{
+    const glm::ivec3 dim { 7, 6, 5 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(uint16_t((i * 7919) % 4096));
+    const TestVolume volume { data, dim };
+
+    // Sample a grid that includes the voxel positions, the borders and positions outside of the volume.
+    for (float z = -1.0f; z <= float(dim.z); z += 0.35f) {
+        for (float y = -1.0f; y <= float(dim.y); y += 0.35f) {
+            for (float x = -1.0f; x <= float(dim.x); x += 0.35f) {
+                const glm::vec3 coord { x, y, z };
+                REQUIRE(volume.test_getSampleTriLinearInterpolationFast(coord) == Approx(volume.test_getSampleTriLinearInterpolation(coord)).margin(1e-2));
+            }
+        }
+    }
+}
+
+TEST_CASE("Ray Sampler Tests")
+{
+    const glm::ivec3 dim { 9, 8, 7 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(uint16_t((i * 7919) % 4096));
+    volume::Volume volume { data, dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+
+    // Rays that step through (and out of) the volume along and across the cell boundaries.
+    for (const glm::vec3 direction : { glm::vec3(1, 0, 0), glm::vec3(-1, 0.5f, 0.25f), glm::vec3(0.3f, -0.8f, 0.6f), glm::vec3(0.1f, 0.1f, -1) }) {
+        const glm::vec3 step = 0.7f * glm::normalize(direction);
+        volume::RaySampler sampler { volume, step };
+        for (glm::vec3 coord = glm::vec3(dim) / 2.0f - 10.0f * step; glm::length(coord - glm::vec3(dim) / 2.0f) < 12.0f; coord += step)
+            REQUIRE(sampler.sample(coord) == volume.getSampleInterpolate(coord));
+    }
+}
+
+TEST_CASE("Native Voxel Type Tests")
+{
+    // The same values (which fit in every type) stored as uint8, int16, uint16 and float.
+    const glm::ivec3 dim { 9, 8, 7 };
+    std::vector<uint16_t> values;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        values.push_back(uint16_t((i * 7919) % 251));
+    const auto convert = [&](auto type) { return std::vector<decltype(type)>(std::begin(values), std::end(values)); };
+    std::vector<volume::Volume> volumes;
+    volumes.emplace_back(convert(uint8_t {}), dim);
+    volumes.emplace_back(convert(int16_t {}), dim);
+    volumes.emplace_back(convert(uint16_t {}), dim);
+    volumes.emplace_back(convert(float {}), dim);
+    volume::Volume& reference = volumes[2];
+
+    std::vector<float> xs, ys, zs;
+    for (float z = -1.0f; z <= float(dim.z); z += 0.35f) {
+        for (float y = -1.0f; y <= float(dim.y); y += 0.35f) {
+            for (float x = -1.0f; x <= float(dim.x); x += 0.35f) {
+                xs.push_back(x);
+                ys.push_back(y);
+                zs.push_back(z);
+            }
+        }
+    }
+    const int count = int(xs.size());
+    const size_t numSamples = xs.size();
+
+    for (size_t type = 0; type < volumes.size(); type++) {
+        volume::Volume& volume = volumes[type];
+        INFO("voxel type " << type);
+        REQUIRE(volume.voxelType() == volume::VoxelType(type));
+        REQUIRE(volume.minimum() == reference.minimum());
+        REQUIRE(volume.maximum() == reference.maximum());
+        // Float volumes are binned over [minimum, maximum] instead of per value.
+        if (volume.voxelType() != volume::VoxelType::Float32)
+            REQUIRE(volume.histogram() == reference.histogram());
+        REQUIRE(std::accumulate(std::begin(volume.histogram()), std::end(volume.histogram()), size_t(0)) == volume.numVoxels());
+
+        for (const auto mode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear, volume::InterpolationMode::Cubic }) {
+            volume.interpolationMode = reference.interpolationMode = mode;
+            const volume::Volume::Sampler sampler = volume.sampler();
+            for (size_t i = 0; i < numSamples; i++) {
+                const glm::vec3 coord { xs[i], ys[i], zs[i] };
+                REQUIRE(sampler(coord) == reference.getSampleInterpolate(coord));
+            }
+        }
+
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        volume::RaySampler raySampler { volume, glm::vec3(0.3f, -0.8f, 0.6f) };
+        for (size_t i = 0; i < numSamples; i++) {
+            const glm::vec3 coord { xs[i], ys[i], zs[i] };
+            REQUIRE(raySampler.sample(coord) == volume.getSampleInterpolate(coord));
+        }
+
+        // The kernels of every instruction set, including the fixed-point kernel (which gives the same result for
+        // every integer type).
+        const render::kernels::VolumeView view { volume.rawData(), volume.voxelType(), { dim.x, dim.y, dim.z } };
+        const render::kernels::VolumeView referenceView { reference.rawData(), reference.voxelType(), { dim.x, dim.y, dim.z } };
+        for (int level = int(render::kernels::SimdLevel::SSE42); level <= int(render::kernels::detectSimdLevel()); level++) {
+            INFO(render::kernels::simdLevelName(render::kernels::SimdLevel(level)));
+            const render::kernels::KernelTable* pKernels = render::kernels::kernelTable(render::kernels::SimdLevel(level));
+            std::vector<float> samples(numSamples), fixedSamples(numSamples), referenceSamples(numSamples);
+            pKernels->sampleTrilinear(view, xs.data(), ys.data(), zs.data(), count, samples.data());
+            pKernels->sampleTrilinearFixed(view, xs.data(), ys.data(), zs.data(), count, fixedSamples.data());
+            pKernels->sampleTrilinearFixed(referenceView, xs.data(), ys.data(), zs.data(), count, referenceSamples.data());
+            for (size_t i = 0; i < numSamples; i++) {
+                REQUIRE(samples[i] == volume.getSampleInterpolate(glm::vec3(xs[i], ys[i], zs[i])));
+                if (volume.voxelType() == volume::VoxelType::Float32)
+                    REQUIRE(fixedSamples[i] == samples[i]);
+                else
+                    REQUIRE(fixedSamples[i] == referenceSamples[i]);
+            }
+        }
+    }
+
+    // Negative values: int16 samples exactly like float.
+    std::vector<int16_t> signedValues;
+    for (const uint16_t value : values)
+        signedValues.push_back(int16_t(int(value) * 100 - 12500));
+    volume::Volume signedVolume { signedValues, dim };
+    volume::Volume floatVolume { std::vector<float>(std::begin(signedValues), std::end(signedValues)), dim };
+    signedVolume.interpolationMode = floatVolume.interpolationMode = volume::InterpolationMode::Linear;
+    REQUIRE(signedVolume.minimum() == floatVolume.minimum());
+    const render::kernels::VolumeView signedView { signedVolume.rawData(), signedVolume.voxelType(), { dim.x, dim.y, dim.z } };
+    for (int level = int(render::kernels::SimdLevel::SSE42); level <= int(render::kernels::detectSimdLevel()); level++) {
+        std::vector<float> samples(numSamples), fixedSamples(numSamples);
+        render::kernels::kernelTable(render::kernels::SimdLevel(level))->sampleTrilinear(signedView, xs.data(), ys.data(), zs.data(), count, samples.data());
+        render::kernels::kernelTable(render::kernels::SimdLevel(level))->sampleTrilinearFixed(signedView, xs.data(), ys.data(), zs.data(), count, fixedSamples.data());
+        for (size_t i = 0; i < numSamples; i++) {
+            const float expected = floatVolume.getSampleInterpolate(glm::vec3(xs[i], ys[i], zs[i]));
+            REQUIRE(signedVolume.getSampleInterpolate(glm::vec3(xs[i], ys[i], zs[i])) == expected);
+            REQUIRE(samples[i] == expected);
+            REQUIRE(fixedSamples[i] == Approx(expected).margin(3.0f * 25000.0f / 256.0f + 1.0f));
+        }
+    }
+
+    // Int16 volumes with more distinct values than bins, and float volumes with values between integers, far apart or
+    // NaN, are binned over [minimum, maximum] into at most maxHistogramBins bins. NaNs are not counted.
+    REQUIRE(signedVolume.histogram().size() == volume::Volume::maxHistogramBins);
+    REQUIRE(signedVolume.histogramBegin() == -12500.0f);
+    std::vector<float> fractions;
+    for (const uint16_t value : values)
+        fractions.push_back(float(value) / 251.0f - 0.5f);
+    const float fractionsMinimum = *std::min_element(std::begin(fractions), std::end(fractions));
+    const float fractionsMaximum = *std::max_element(std::begin(fractions), std::end(fractions));
+    fractions[5] = std::numeric_limits<float>::quiet_NaN();
+    const volume::Volume fractionVolume { fractions, dim };
+    REQUIRE(fractionVolume.minimum() == fractionsMinimum);
+    REQUIRE(fractionVolume.maximum() == fractionsMaximum);
+    REQUIRE(fractionVolume.histogramBegin() == fractionsMinimum);
+    const std::vector<size_t>& fractionHistogram = fractionVolume.histogram();
+    REQUIRE(fractionHistogram.size() == volume::Volume::maxHistogramBins);
+    REQUIRE(std::accumulate(std::begin(fractionHistogram), std::end(fractionHistogram), size_t(0)) == fractions.size() - 1);
+    REQUIRE(fractionHistogram.front() > 0);
+    REQUIRE(fractionHistogram.back() > 0);
+    for (const float value : fractions) {
+        if (std::isnan(value))
+            continue;
+        const float bin = (value - fractionVolume.histogramBegin()) / fractionVolume.histogramBinWidth();
+        REQUIRE(fractionHistogram[std::min(size_t(bin), fractionHistogram.size() - 1)] > 0);
+    }
+
+    fractions[6] = 4e9f;
+    const volume::Volume wideVolume { fractions, dim };
+    REQUIRE(wideVolume.maximum() == 4e9f);
+    REQUIRE(wideVolume.histogram().size() == volume::Volume::maxHistogramBins);
+    REQUIRE(wideVolume.histogram().front() == fractions.size() - 2);
+    REQUIRE(wideVolume.histogram().back() == 1);
+
+    // fld files with byte and float data are loaded without conversion.
+    const auto writeFile = [&](const std::filesystem::path& file, const char* type, const void* data, size_t size) {
+        std::ofstream ofs { file, std::ios::binary };
+        ofs << "# AVS field file\nndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z
+            << "\nnspace=3\nveclen=1\ndata=" << type << "\nfield=uniform\n\f\f";
+        ofs.write(static_cast<const char*>(data), std::streamsize(size));
+    };
+    const std::filesystem::path byteFile = std::filesystem::temp_directory_path() / "volvis_test_byte.fld";
+    const std::vector<uint8_t> bytes = convert(uint8_t {});
+    writeFile(byteFile, "byte", bytes.data(), bytes.size());
+    const volume::Volume byteVolume { byteFile };
+    REQUIRE(byteVolume.voxelType() == volume::VoxelType::UInt8);
+    REQUIRE(std::equal(std::begin(bytes), std::end(bytes), std::begin(byteVolume.data<uint8_t>()), std::end(byteVolume.data<uint8_t>())));
+
+    const std::filesystem::path floatFile = std::filesystem::temp_directory_path() / "volvis_test_float.fld";
+    std::vector<float> floats;
+    for (const uint16_t value : values)
+        floats.push_back(float(value) / 7.0f - 3.0f);
+    writeFile(floatFile, "float", floats.data(), floats.size() * sizeof(float));
+    const volume::Volume loadedFloatVolume { floatFile };
+    REQUIRE(loadedFloatVolume.voxelType() == volume::VoxelType::Float32);
+    REQUIRE(std::equal(std::begin(floats), std::end(floats), std::begin(loadedFloatVolume.data<float>()), std::end(loadedFloatVolume.data<float>())));
+    REQUIRE(loadedFloatVolume.minimum() == -3.0f);
+
+    std::filesystem::remove(byteFile);
+    std::filesystem::remove(floatFile);
+}
+
+TEST_CASE("Region Loading Tests")
+{
+    const glm::ivec3 dim { 11, 7, 9 };
+    std::vector<uint16_t> voxels(size_t(dim.x * dim.y * dim.z));
+    std::iota(std::begin(voxels), std::end(voxels), uint16_t(300));
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_test_region.fld";
+    {
+        std::ofstream ofs { file, std::ios::binary };
+        ofs << "# AVS field file\nndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z
+            << "\nnspace=3\nveclen=1\ndata=short\nfield=uniform\n\f\f";
+        ofs.write(reinterpret_cast<const char*>(voxels.data()), std::streamsize(voxels.size() * sizeof(uint16_t)));
+    }
+    const volume::Volume full { file };
+
+    // Whole slices, whole rows, partial rows (close together and far apart), strided and clamped regions all read the
+    // same voxels as the full volume.
+    const std::vector<volume::Volume::Region> regions {
+        { glm::ivec3(0, 0, 2), glm::ivec3(11, 7, 5), 1 },
+        { glm::ivec3(0, 1, 0), glm::ivec3(11, 6, 9), 1 },
+        { glm::ivec3(2, 3, 1), glm::ivec3(9, 5, 8), 1 },
+        { glm::ivec3(4, 1, 0), glm::ivec3(6, 6, 9), 1 },
+        { glm::ivec3(1, 0, 2), glm::ivec3(10, 7, 9), 3 },
+        { glm::ivec3(-5, 4, 3), glm::ivec3(100, 100, 4), 2 },
+        {}
+    };
+    for (const auto& region : regions) {
+        const volume::Volume partial { file, region };
+        const glm::ivec3 begin = glm::clamp(region.begin, glm::ivec3(0), dim);
+        const glm::ivec3 end = glm::clamp(region.end, begin, dim);
+        REQUIRE(partial.dims() == (end - begin + region.stride - 1) / region.stride);
+        REQUIRE(volume::Volume::regionDims(file, region) == partial.dims());
+        REQUIRE(partial.minimum() == full.getVoxel(begin.x, begin.y, begin.z));
+        for (int z = 0; z < partial.dims().z; z++) {
+            for (int y = 0; y < partial.dims().y; y++) {
+                for (int x = 0; x < partial.dims().x; x++) {
+                    const glm::ivec3 p = begin + glm::ivec3(x, y, z) * region.stride;
+                    REQUIRE(partial.getVoxel(x, y, z) == full.getVoxel(p.x, p.y, p.z));
+                }
+            }
+        }
+    }
+
+    // Regions outside of the file are empty.
+    const volume::Volume empty { file, volume::Volume::Region { glm::ivec3(20), glm::ivec3(30), 1 } };
+    REQUIRE(empty.numVoxels() == 0);
+
+    // The voxels that are missing from a truncated file are 0, including the voxel of which only one byte is left; every
+    // voxel before it is read.
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) - voxels.size() * sizeof(uint16_t) / 2);
+    const size_t numVoxelsLeft = voxels.size() / 2;
+    for (const auto& region : regions) {
+        const volume::Volume truncated { file, region };
+        const glm::ivec3 begin = glm::clamp(region.begin, glm::ivec3(0), dim);
+        for (int z = 0; z < truncated.dims().z; z++) {
+            for (int y = 0; y < truncated.dims().y; y++) {
+                for (int x = 0; x < truncated.dims().x; x++) {
+                    const glm::ivec3 p = begin + glm::ivec3(x, y, z) * region.stride;
+                    const size_t fileIndex = size_t(p.x) + size_t(p.y) * size_t(dim.x) + size_t(p.z) * size_t(dim.x * dim.y);
+                    REQUIRE(truncated.getVoxel(x, y, z) == (fileIndex < numVoxelsLeft ? full.getVoxel(p.x, p.y, p.z) : 0.0f));
+                }
+            }
+        }
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE("Procedural Volume Tests")
+{
+    for (size_t scene = 0; scene < volume::numProceduralScenes; scene++) {
+        volume::ProceduralVolumeSettings settings;
+        settings.scene = volume::ProceduralScene(scene);
+        settings.dims = glm::ivec3(37, 29, 23);
+        settings.seed = 7;
+        settings.density = 0.1f;
+        const volume::Volume generated = volume::createProceduralVolume(settings);
+        REQUIRE(generated.dims() == settings.dims);
+        REQUIRE(generated.maximum() > 0.0f);
+        REQUIRE(generated.maximum() <= volume::proceduralMaximum(settings.voxelType));
+
+        // Generating is deterministic, and writing to a file gives the same voxels.
+        const gsl::span<const uint8_t> voxels = generated.data<uint8_t>();
+        const volume::Volume generatedAgain = volume::createProceduralVolume(settings);
+        const gsl::span<const uint8_t> again = generatedAgain.data<uint8_t>();
+        REQUIRE(std::equal(std::begin(voxels), std::end(voxels), std::begin(again), std::end(again)));
+        const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_test_procedural.fld";
+        REQUIRE(volume::writeProceduralVolume(settings, file));
+        const volume::Volume loaded { file };
+        REQUIRE(loaded.dims() == settings.dims);
+        REQUIRE(std::equal(std::begin(voxels), std::end(voxels), std::begin(loaded.data<uint8_t>()), std::end(loaded.data<uint8_t>())));
+        std::filesystem::remove(file);
+
+        settings.seed = 8;
+        const volume::Volume otherSeedVolume = volume::createProceduralVolume(settings);
+        const gsl::span<const uint8_t> otherSeed = otherSeedVolume.data<uint8_t>();
+        REQUIRE(std::equal(std::begin(voxels), std::end(voxels), std::begin(otherSeed), std::end(otherSeed)) == (settings.scene == volume::ProceduralScene::Spheres));
+    }
+
+    // Other voxel types hold the same scene with a larger range of values.
+    volume::ProceduralVolumeSettings settings;
+    settings.scene = volume::ProceduralScene::Noise;
+    settings.dims = glm::ivec3(20, 30, 10);
+    const volume::Volume bytes = volume::createProceduralVolume(settings);
+    settings.voxelType = volume::VoxelType::Float32;
+    const volume::Volume floats = volume::createProceduralVolume(settings);
+    REQUIRE(floats.voxelType() == volume::VoxelType::Float32);
+    for (size_t i = 0; i < bytes.numVoxels(); i++)
+        REQUIRE(bytes.data<uint8_t>()[i] == Approx(floats.data<float>()[i] * 255.0f / 4095.0f).margin(0.5f));
+
+    // The balls of the sparse scene fill about the requested fraction of the volume.
+    settings.scene = volume::ProceduralScene::Sparse;
+    settings.dims = glm::ivec3(96);
+    settings.density = 0.05f;
+    const volume::Volume sparseVolume = volume::createProceduralVolume(settings);
+    const gsl::span<const float> sparse = sparseVolume.data<float>();
+    const auto numFilled = std::count_if(std::begin(sparse), std::end(sparse), [](float value) { return value > 0.0f; });
+    REQUIRE(double(numFilled) / double(sparse.size()) == Approx(settings.density).epsilon(0.3));
+}
+
+TEST_CASE("Sparse Volume Tests")
+{
+    // Balls in an empty volume, with a block of a constant value that starts and ends inside of tiles.
+    volume::ProceduralVolumeSettings settings;
+    settings.scene = volume::ProceduralScene::Sparse;
+    settings.dims = glm::ivec3(70, 61, 53);
+    settings.seed = 3;
+    settings.density = 0.001f;
+    const volume::Volume balls = volume::createProceduralVolume(settings);
+    std::vector<uint8_t> data(std::begin(balls.data<uint8_t>()), std::end(balls.data<uint8_t>()));
+    const glm::ivec3 dim = settings.dims;
+    for (int z = 0; z < 29; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 13; x < 43; x++)
+                data[size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))] = 60;
+        }
+    }
+    volume::Volume volume { data, dim };
+    volume::GradientVolume gradientVolume { volume };
+    const volume::SparseVolume sparseVolume { volume };
+
+    REQUIRE(sparseVolume.dims() == dim);
+    const glm::ivec3 numTiles = sparseVolume.numTiles();
+    REQUIRE(numTiles == glm::ivec3(9, 8, 7));
+    REQUIRE(sparseVolume.numLeaves() > 0);
+    REQUIRE(sparseVolume.numLeaves() < size_t(numTiles.x * numTiles.y * numTiles.z) / 2);
+    REQUIRE(sparseVolume.memoryUsage() < volume.numVoxels() / 2);
+    REQUIRE(sparseVolume.tile(glm::ivec3(3, 4, 1)).leaf == volume::SparseVolume::uniformTile);
+    REQUIRE(sparseVolume.tile(glm::ivec3(3, 4, 1)).value == 60.0f);
+    REQUIRE(sparseVolume.tile(glm::ivec3(3, 4, 1)).uniformCells);
+    REQUIRE(!sparseVolume.tile(glm::ivec3(4, 4, 2)).uniformCells);
+    REQUIRE(sparseVolume.tile(glm::ivec3(3, 4, 1)).uniformNeighbourhood);
+    REQUIRE(!sparseVolume.tile(glm::ivec3(3, 4, 2)).uniformNeighbourhood);
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                REQUIRE(sparseVolume.getVoxel(x, y, z) == volume.getVoxel(x, y, z));
+        }
+    }
+
+    // Samples are the same as those of the volume, also across tiles, at the borders and outside of the volume.
+    for (const auto interpolationMode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+        volume.interpolationMode = interpolationMode;
+        for (float z = -1.0f; z <= float(dim.z); z += 0.73f) {
+            for (float y = -1.0f; y <= float(dim.y); y += 0.61f) {
+                for (float x = -1.0f; x <= float(dim.x); x += 0.57f)
+                    REQUIRE(sparseVolume.getSampleInterpolate(glm::vec3(x, y, z), interpolationMode) == volume.getSampleInterpolate(glm::vec3(x, y, z)));
+            }
+        }
+    }
+
+    // Building from a file a slab at a time gives the same tiles.
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_test_sparse.fld";
+    REQUIRE(volume::writeProceduralVolume(settings, file));
+    const volume::SparseVolume fromFile { file };
+    const volume::SparseVolume fromVolume { volume::Volume { file } };
+    std::filesystem::remove(file);
+    REQUIRE(fromFile.dims() == dim);
+    REQUIRE(fromFile.numLeaves() == fromVolume.numLeaves());
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                REQUIRE(fromFile.getVoxel(x, y, z) == balls.getVoxel(x, y, z));
+        }
+    }
+
+    // Skipping the uniform tiles renders the same images with fewer samples. The sample positions are computed rather
+    // than stepped, so they differ in the last bits.
+    TestCamera camera { glm::vec3(1.5f, 1.2f, 1.8f) * glm::vec3(dim), glm::vec3(dim) / 2.0f };
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(48, 40);
+    config.isoValue = 80.0f;
+    setTestTransferFunction(config, volume.maximum(), 1);
+    for (const auto interpolationMode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+        for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderComposite, render::RenderMode::RenderIso }) {
+            for (const bool volumeShading : { false, true }) {
+                volume.interpolationMode = gradientVolume.interpolationMode = interpolationMode;
+                config.renderMode = renderMode;
+                config.volumeShading = volumeShading;
+                config.simdLevel = render::kernels::SimdLevel::Scalar;
+                config.sparseTraversal = false;
+                const TestImage dense = renderTestImage(volume, gradientVolume, camera, config);
+                config.sparseTraversal = true;
+                // Without a sparse volume of its own, the renderer builds one.
+                const TestImage sparse = renderTestImage(volume, gradientVolume, camera, config, volumeShading ? nullptr : &sparseVolume);
+
+                INFO(int(interpolationMode) << " " << int(renderMode) << " " << volumeShading);
+                REQUIRE(sparse.stats.samplesTaken < dense.stats.samplesTaken / 2);
+                // Isosurface hits may move to the neighbouring sample where the surface touches a sample position.
+                REQUIRE(numDifferentPixels(sparse, dense, 1e-3f) <= dense.pixels.size() / 200);
+            }
+        }
+    }
+
+    // The deadline-driven renders build the sparse copy in the background and trace without it until it is ready.
+    config.renderMode = render::RenderMode::RenderComposite;
+    config.volumeShading = false;
+    config.sparseTraversal = false;
+    const TestImage dense = renderTestImage(volume, gradientVolume, camera, config);
+    config.sparseTraversal = true;
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    const auto deadline = render::Renderer::Clock::now() + std::chrono::hours(1);
+    const auto timeout = render::Renderer::Clock::now() + std::chrono::seconds(10);
+    TestImage sparse;
+    do {
+        REQUIRE(renderer.render(deadline).allComplete());
+        sparse = TestImage { std::vector<glm::vec4>(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer())), renderer.stats() };
+        REQUIRE(numDifferentPixels(sparse, dense, 1e-3f) <= dense.pixels.size() / 200);
+    } while (sparse.stats.samplesTaken == dense.stats.samplesTaken && render::Renderer::Clock::now() < timeout);
+    REQUIRE(sparse.stats.samplesTaken < dense.stats.samplesTaken / 2);
+}
+
+TEST_CASE("Shear-Warp Tests")
+{
+    TestScene scene;
+    volume::Volume& volume = scene.volume;
+    const glm::vec3 dims = scene.dims;
+
+    // Every point of a ray projects onto the same intermediate pixel, and all slices lie inside of the intermediate image.
+    for (const glm::vec3& pose : TestScene::poses) {
+        const glm::vec3 direction = glm::normalize(dims / 2.0f - pose * dims);
+        const render::ShearWarpFactorization view = render::factorizeView(direction, volume.dims());
+        REQUIRE(glm::abs(direction[view.axis]) == glm::compMax(glm::abs(direction)));
+        REQUIRE(view.reversed == (direction[view.axis] < 0.0f));
+        const glm::vec3 point { 3.0f, 7.0f, 11.0f };
+        for (const float t : { -20.0f, 5.0f, 30.0f }) {
+            const glm::vec2 difference = view.project(point + t * direction) - view.project(point);
+            REQUIRE(glm::compMax(glm::abs(difference)) < 1e-4f);
+        }
+        const glm::vec2 sliceSize { volume.dims()[view.uAxis], volume.dims()[view.vAxis] };
+        for (int slice = 0; slice < view.numSlices; slice++) {
+            const glm::vec2 offset = view.sliceOffset(slice);
+            REQUIRE(glm::all(glm::greaterThanEqual(offset, glm::vec2(0.0f))));
+            REQUIRE(glm::all(glm::lessThanEqual(offset + sliceSize, glm::vec2(view.imageSize))));
+        }
+    }
+
+    // The encoding keeps every opaque voxel and its neighbours in the slice, with their values.
+    const float threshold = 100.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        const render::RunLengthVolume encoded { volume, axis, threshold };
+        REQUIRE(encoded.numStoredVoxels() < volume.numVoxels());
+        REQUIRE(encoded.transparentValue() < threshold);
+        const glm::ivec2 axes = volume::otherAxes(axis);
+        for (int slice = 0; slice < encoded.numSlices(); slice++) {
+            std::vector<uint8_t> kept(size_t(encoded.sliceSize().x) * size_t(encoded.sliceSize().y), 0);
+            const auto voxel = [&](int u, int v) {
+                glm::ivec3 position;
+                position[axis] = slice;
+                position[axes.x] = u;
+                position[axes.y] = v;
+                return volume.getVoxel(position.x, position.y, position.z);
+            };
+            for (int v = 0; v < encoded.sliceSize().y; v++) {
+                for (const render::RunLengthVolume::Run& run : encoded.runs(slice, v)) {
+                    for (int u = run.begin; u < run.end; u++) {
+                        REQUIRE(encoded.values(slice)[run.value + size_t(u - run.begin)] == voxel(u, v));
+                        kept[size_t(u) + size_t(encoded.sliceSize().x) * size_t(v)] = 1;
+                    }
+                }
+            }
+            for (int v = 0; v < encoded.sliceSize().y; v++) {
+                for (int u = 0; u < encoded.sliceSize().x; u++) {
+                    if (voxel(u, v) < threshold)
+                        continue;
+                    for (int neighbour = 0; neighbour < 9; neighbour++) {
+                        const glm::ivec2 n = glm::clamp(glm::ivec2(u + neighbour % 3 - 1, v + neighbour / 3 - 1), glm::ivec2(0), encoded.sliceSize() - 1);
+                        REQUIRE(kept[size_t(n.x) + size_t(encoded.sliceSize().x) * size_t(n.y)]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Shear-warp samples on the slices instead of at fixed steps along the rays, so its images are close to the ray
+    // cast images. It samples at most once per voxel, skipping the transparent ones. Perspective views are always ray
+    // cast.
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(48, 48);
+    setTestTransferFunction(config, volume.maximum(), 100);
+    config.simdLevel = render::kernels::SimdLevel::Scalar;
+    for (const glm::vec3& pose : TestScene::poses) {
+        const TestOrthographicCamera camera = scene.orthographicCamera(pose);
+        const TestCamera perspectiveCamera = scene.perspectiveCamera(pose);
+        for (const auto interpolationMode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+            for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderComposite }) {
+                for (const bool volumeShading : { false, true }) {
+                    volume.interpolationMode = scene.gradientVolume.interpolationMode = interpolationMode;
+                    config.renderMode = renderMode;
+                    config.volumeShading = volumeShading;
+                    config.renderBackend = render::RenderBackend::RayCasting;
+                    const TestImage rayCasting = renderTestImage(volume, scene.gradientVolume, camera, config);
+                    const TestImage perspectiveRayCasting = renderTestImage(volume, scene.gradientVolume, perspectiveCamera, config);
+                    config.renderBackend = render::RenderBackend::ShearWarp;
+                    const TestImage shearWarp = renderTestImage(volume, scene.gradientVolume, camera, config);
+                    const TestImage perspective = renderTestImage(volume, scene.gradientVolume, perspectiveCamera, config);
+
+                    INFO(pose.x << " " << int(interpolationMode) << " " << int(renderMode) << " " << volumeShading);
+                    REQUIRE(shearWarp.stats.samplesTaken < volume.numVoxels());
+                    REQUIRE(meanImageError(shearWarp, rayCasting) < 0.03f);
+                    REQUIRE(perspective.pixels == perspectiveRayCasting.pixels);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Splatting Tests")
+{
+    TestScene scene;
+    volume::Volume& volume = scene.volume;
+
+    // The bricks cover every voxel once, with their largest value.
+    const render::VolumeBricks bricks { volume };
+    size_t numBrickVoxels = 0;
+    for (const render::VolumeBricks::Brick& brick : bricks.bricks()) {
+        const glm::ivec3 size = brick.end - brick.begin;
+        REQUIRE(glm::all(glm::greaterThan(size, glm::ivec3(0))));
+        REQUIRE(glm::all(glm::lessThanEqual(size, glm::ivec3(render::VolumeBricks::brickSize))));
+        numBrickVoxels += size_t(size.x) * size_t(size.y) * size_t(size.z);
+        float maximum = std::numeric_limits<float>::lowest();
+        for (int z = brick.begin.z; z < brick.end.z; z++) {
+            for (int y = brick.begin.y; y < brick.end.y; y++) {
+                for (int x = brick.begin.x; x < brick.end.x; x++)
+                    maximum = std::max(maximum, volume.getVoxel(x, y, z));
+            }
+        }
+        REQUIRE(brick.maximum == maximum);
+    }
+    REQUIRE(numBrickVoxels == volume.numVoxels());
+
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(48, 40);
+    setTestTransferFunction(config, volume.maximum(), 100);
+    config.simdLevel = render::kernels::SimdLevel::Scalar;
+    for (const glm::vec3& pose : TestScene::poses) {
+        const TestCamera perspectiveCamera = scene.perspectiveCamera(pose);
+        const TestOrthographicCamera orthographicCamera = scene.orthographicCamera(pose);
+        for (const render::RayTraceCamera* pCamera : { static_cast<const render::RayTraceCamera*>(&perspectiveCamera), static_cast<const render::RayTraceCamera*>(&orthographicCamera) }) {
+            // Every point along the ray of a pixel projects onto that pixel.
+            const render::ScreenProjection projection = render::screenProjection(*pCamera, config.renderResolution);
+            for (const glm::ivec2 pixel : { glm::ivec2(0), glm::ivec2(13, 31), glm::ivec2(47, 2) }) {
+                const render::Ray ray = pCamera->generateRay(glm::vec2(pixel) / glm::vec2(config.renderResolution) * 2.0f - 1.0f);
+                for (const float t : { 10.0f, 50.0f, 120.0f }) {
+                    const glm::vec3 point = ray.origin + t * ray.direction;
+                    const glm::vec3 projected = projection.project(point);
+                    REQUIRE(projected.x == Approx(float(pixel.x)).margin(1e-3));
+                    REQUIRE(projected.y == Approx(float(pixel.y)).margin(1e-3));
+                    REQUIRE(projected.z == Approx(glm::dot(point - projection.origin, projection.forward)));
+                    // A unit step along the right vector of the screen moves by pixelsPerUnit().x pixels.
+                    const glm::vec3 moved = projection.project(point + glm::normalize(projection.right) * projected.z / 100.0f);
+                    REQUIRE((moved.x - projected.x) / projected.z * 100.0f == Approx(projection.pixelsPerUnit(projected.z).x).epsilon(1e-2));
+                }
+            }
+
+            // Splatting composites the footprints of the classified voxels instead of samples along the rays, so its images
+            // are close to the ray cast images. It splats every voxel at most once, skipping the transparent ones.
+            for (const auto interpolationMode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+                for (const auto renderMode : { render::RenderMode::RenderMIP, render::RenderMode::RenderComposite }) {
+                    for (const bool volumeShading : { false, true }) {
+                        volume.interpolationMode = scene.gradientVolume.interpolationMode = interpolationMode;
+                        config.renderMode = renderMode;
+                        config.volumeShading = volumeShading;
+                        config.renderBackend = render::RenderBackend::RayCasting;
+                        const TestImage rayCasting = renderTestImage(volume, scene.gradientVolume, *pCamera, config);
+                        config.renderBackend = render::RenderBackend::Splatting;
+                        const TestImage splatting = renderTestImage(volume, scene.gradientVolume, *pCamera, config);
+
+                        INFO(pose.x << " " << pCamera->orthographic() << " " << int(interpolationMode) << " " << int(renderMode) << " " << volumeShading);
+                        REQUIRE(splatting.stats.samplesTaken < volume.numVoxels());
+                        REQUIRE(meanImageError(splatting, rayCasting) < 0.04f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Max Pyramid Tests")
+{
+    TestScene scene;
+    volume::Volume& volume = scene.volume;
+    const glm::ivec3 dims = volume.dims();
+
+    // The maximum of a node covers its voxels and the first voxels of the next nodes, and the top node covers the
+    // whole volume.
+    const volume::MaxPyramid pyramid { volume };
+    REQUIRE(pyramid.levelSize(pyramid.numLevels() - 1) == glm::ivec3(1));
+    for (int level = 0; level < pyramid.numLevels(); level++) {
+        const glm::ivec3 levelSize = pyramid.levelSize(level);
+        const int nodeSize = volume::MaxPyramid::brickSize << level;
+        for (int z = 0; z < levelSize.z; z++) {
+            for (int y = 0; y < levelSize.y; y++) {
+                for (int x = 0; x < levelSize.x; x++) {
+                    const glm::ivec3 begin = glm::ivec3(x, y, z) * nodeSize;
+                    const glm::ivec3 end = glm::min(begin + nodeSize + 1, dims);
+                    float maximum = std::numeric_limits<float>::lowest();
+                    for (int vz = begin.z; vz < end.z; vz++) {
+                        for (int vy = begin.y; vy < end.y; vy++) {
+                            for (int vx = begin.x; vx < end.x; vx++)
+                                maximum = std::max(maximum, volume.getVoxel(vx, vy, vz));
+                        }
+                    }
+                    if (level == 0)
+                        REQUIRE(pyramid.maximum(level, glm::ivec3(x, y, z)) == maximum);
+                    else
+                        REQUIRE(pyramid.maximum(level, glm::ivec3(x, y, z)) >= maximum);
+                }
+            }
+        }
+    }
+    REQUIRE(pyramid.maximum() == volume.maximum());
+
+    // Empty volumes have levels without nodes, and no node holds any position.
+    const volume::Volume emptyVolume { std::vector<uint8_t>(), glm::ivec3(0, 20, 9) };
+    const volume::MaxPyramid emptyPyramid { emptyVolume };
+    REQUIRE(emptyPyramid.levelSize(emptyPyramid.numLevels() - 1) == glm::ivec3(0, 1, 1));
+    REQUIRE(emptyPyramid.maximum() == std::numeric_limits<float>::lowest());
+    REQUIRE(!emptyPyramid.findNode(glm::vec3(0.0f), 0.0f));
+
+    // The MIP images hold the maximum of every column of voxels.
+    for (int axis = 0; axis < 3; axis++) {
+        const glm::ivec2 axes = volume::otherAxes(axis);
+        for (int v = 0; v < dims[axes.y]; v++) {
+            for (int u = 0; u < dims[axes.x]; u++) {
+                float maximum = std::numeric_limits<float>::lowest();
+                for (int s = 0; s < dims[axis]; s++) {
+                    glm::ivec3 voxel;
+                    voxel[axis] = s;
+                    voxel[axes.x] = u;
+                    voxel[axes.y] = v;
+                    maximum = std::max(maximum, volume.getVoxel(voxel.x, voxel.y, voxel.z));
+                }
+                REQUIRE(pyramid.columnMaximum(axis, u, v) == maximum);
+            }
+        }
+    }
+
+    // Skipping with the pyramid leaves the MIP images unchanged, including those of the views along an axis, which
+    // take the MIP images of the pyramid with nearest neighbour interpolation.
+    render::RenderConfig config {};
+    config.renderResolution = glm::ivec2(48, 40);
+    config.renderMode = render::RenderMode::RenderMIP;
+    config.simdLevel = render::kernels::SimdLevel::Scalar;
+    for (const glm::vec3& pose : TestScene::poses) {
+        const TestCamera perspectiveCamera = scene.perspectiveCamera(pose);
+        const TestOrthographicCamera orthographicCamera = scene.orthographicCamera(pose);
+        for (const render::RayTraceCamera* pCamera : { static_cast<const render::RayTraceCamera*>(&perspectiveCamera), static_cast<const render::RayTraceCamera*>(&orthographicCamera) }) {
+            for (const auto interpolationMode : { volume::InterpolationMode::NearestNeighbour, volume::InterpolationMode::Linear }) {
+                volume.interpolationMode = interpolationMode;
+                config.maxPyramidTraversal = false;
+                const TestImage reference = renderTestImage(volume, scene.gradientVolume, *pCamera, config);
+                config.maxPyramidTraversal = true;
+                const TestImage skipping = renderTestImage(volume, scene.gradientVolume, *pCamera, config);
+
+                INFO(pose.x << " " << pCamera->orthographic() << " " << int(interpolationMode));
+                REQUIRE(skipping.stats.samplesTaken < reference.stats.samplesTaken);
+                REQUIRE(skipping.pixels == reference.pixels);
+            }
+        }
+    }
+
+    // The deadline-driven renders build the pyramid in the background and trace without it until it is ready.
+    const TestCamera camera = scene.perspectiveCamera(TestScene::poses[2]);
+    config.maxPyramidTraversal = false;
+    const TestImage reference = renderTestImage(volume, scene.gradientVolume, camera, config);
+    config.maxPyramidTraversal = true;
+    render::Renderer renderer { &volume, &scene.gradientVolume, &camera, config };
+    const auto deadline = render::Renderer::Clock::now() + std::chrono::hours(1);
+    const auto timeout = render::Renderer::Clock::now() + std::chrono::seconds(10);
+    do {
+        REQUIRE(renderer.render(deadline).allComplete());
+        REQUIRE(std::equal(std::begin(renderer.frameBuffer()), std::end(renderer.frameBuffer()), std::begin(reference.pixels)));
+    } while (renderer.stats().samplesTaken == reference.stats.samplesTaken && render::Renderer::Clock::now() < timeout);
+    REQUIRE(renderer.stats().samplesTaken < reference.stats.samplesTaken);
+}
+
+// Volumes of 2^31 voxels and more, to check that no voxel index is computed in 32 bits. Needs about 2.5 GB of memory,
+// so it only runs when asked for (IntegrityTests [large]).
+TEST_CASE("Large Volume Tests", "[.large]")
+{
+    // A sparse byte file of which only the last slices, which lie beyond voxel 2^31, hold voxels other than 0.
+    const glm::ivec3 dim { 2048, 1024, 1100 };
+    const int firstSlice = 1090;
+    const size_t sliceSize = size_t(dim.x) * size_t(dim.y);
+    REQUIRE(size_t(firstSlice) * sliceSize > size_t(std::numeric_limits<int32_t>::max()));
+    const auto expectedVoxel = [&](int x, int y, int z) {
+        return z < firstSlice ? 0.0f : float((x * 7 + y * 13 + z * 29) % 251);
+    };
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "volvis_test_large.fld";
+    {
+        std::ofstream ofs { file, std::ios::binary };
+        ofs << "# AVS field file\nndim=3\ndim1=" << dim.x << "\ndim2=" << dim.y << "\ndim3=" << dim.z
+            << "\nnspace=3\nveclen=1\ndata=byte\nfield=uniform\n\f\f";
+        ofs.seekp(std::streamoff(size_t(firstSlice) * sliceSize), std::ios::cur);
+        std::vector<uint8_t> slice(sliceSize);
+        for (int z = firstSlice; z < dim.z; z++) {
+            for (int y = 0; y < dim.y; y++) {
+                for (int x = 0; x < dim.x; x++)
+                    slice[size_t(x) + size_t(y) * size_t(dim.x)] = uint8_t(expectedVoxel(x, y, z));
+            }
+            ofs.write(reinterpret_cast<const char*>(slice.data()), std::streamsize(slice.size()));
+        }
+    }
+
+    volume::Volume volume { file, volume::Volume::Properties::Defer };
+    REQUIRE(volume.dims() == dim);
+    REQUIRE(volume.numVoxels() == sliceSize * size_t(dim.z));
+    const std::vector<glm::ivec3> voxels { { 0, 0, 0 }, { 2047, 1023, 1089 }, { 5, 6, 1090 }, { 1000, 500, 1095 }, { 2046, 1022, 1098 } };
+    for (const glm::ivec3& voxel : voxels) {
+        const float expected = expectedVoxel(voxel.x, voxel.y, voxel.z);
+        REQUIRE(volume.getVoxel(voxel.x, voxel.y, voxel.z) == expected);
+        volume.interpolationMode = volume::InterpolationMode::NearestNeighbour;
+        REQUIRE(volume.getSampleInterpolate(glm::vec3(voxel)) == expected);
+        volume.interpolationMode = volume::InterpolationMode::Linear;
+        REQUIRE(volume.getSampleInterpolate(glm::vec3(voxel)) == expected);
+
+        // Halfway between 8 voxels the linear sample is their mean.
+        if (glm::all(glm::lessThan(voxel + 1, dim))) {
+            float mean = 0.0f;
+            for (int corner = 0; corner < 8; corner++)
+                mean += expectedVoxel(voxel.x + (corner & 1), voxel.y + ((corner >> 1) & 1), voxel.z + (corner >> 2)) / 8.0f;
+            REQUIRE(volume.getSampleInterpolate(glm::vec3(voxel) + 0.5f) == Approx(mean));
+        }
+    }
+
+    const volume::Volume::Region region { glm::ivec3(1000, 500, 1080), glm::ivec3(1100, 600, 1100), 3 };
+    const volume::Volume partial { file, region };
+    const volume::Volume downsampled = volume.downsample(16);
+    for (const auto& [pVolume, begin, stride] : { std::tuple { &partial, region.begin, region.stride }, std::tuple { &downsampled, glm::ivec3(0), 16 } }) {
+        const glm::ivec3 last = pVolume->dims() - 1;
+        for (const glm::ivec3& voxel : { glm::ivec3(0), last, glm::ivec3(last.x / 2, 1, last.z) }) {
+            const glm::ivec3 p = begin + voxel * stride;
+            REQUIRE(pVolume->getVoxel(voxel.x, voxel.y, voxel.z) == expectedVoxel(p.x, p.y, p.z));
+        }
+    }
+
+    // The SIMD kernels sample large volumes like the scalar code does. MIP rays do not use the gradients.
+    const volume::GradientVolume gradientVolume { downsampled };
+    TestCamera camera { glm::vec3(900.0f, 400.0f, 1400.0f), glm::vec3(1024.0f, 512.0f, 1095.0f) };
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderMIP;
+    config.renderResolution = glm::ivec2(24, 16);
+    const auto renderMIP = [&](render::kernels::SimdLevel simdLevel) {
+        config.simdLevel = simdLevel;
+        render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+        renderer.render();
+        const auto pixels = renderer.frameBuffer();
+        return std::vector<glm::vec4>(std::begin(pixels), std::end(pixels));
+    };
+    const std::vector<glm::vec4> reference = renderMIP(render::kernels::SimdLevel::Scalar);
+    REQUIRE(std::any_of(std::begin(reference), std::end(reference), [](const glm::vec4& pixel) { return pixel.x > 0.5f; }));
+    for (const auto simdLevel : { render::kernels::SimdLevel::SSE42, render::kernels::SimdLevel::AVX2, render::kernels::SimdLevel::AVX512 }) {
+        if (!render::kernels::kernelTable(simdLevel))
+            continue;
+        const std::vector<glm::vec4> pixels = renderMIP(simdLevel);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            for (int c = 0; c < 4; c++)
+                REQUIRE(pixels[i][c] == Approx(reference[i][c]).margin(1e-5));
+        }
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE("SIMD Kernel Tests")
+{
+    using namespace render::kernels;
+
+    const glm::ivec3 dim { 9, 8, 7 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(uint16_t((i * 7919) % 4096));
+    volume::Volume volume { data, dim };
+    volume.interpolationMode = volume::InterpolationMode::Linear;
+    volume::GradientVolume gradientVolume { volume };
+    gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+
+    // A grid that includes the voxel positions, the borders and positions outside of the volume. The number of samples
+    // is not a multiple of any vector width.
+    std::vector<float> xs, ys, zs;
+    for (float z = -1.0f; z <= float(dim.z); z += 0.35f) {
+        for (float y = -1.0f; y <= float(dim.y); y += 0.35f) {
+            for (float x = -1.0f; x <= float(dim.x); x += 0.35f) {
+                xs.push_back(x);
+                ys.push_back(y);
+                zs.push_back(z);
+            }
+        }
+    }
+    const int count = int(xs.size()) - 3;
+    const size_t numSamples = size_t(count);
+    const VolumeView volumeView { volume.rawData(), volume.voxelType(), { dim.x, dim.y, dim.z } };
+    const GradientView gradientView { glm::value_ptr(gradientVolume.data()[0].dir), { dim.x, dim.y, dim.z } };
+
+    // Transfer function with a distinct color per entry, and values below, inside and above its range.
+    std::vector<glm::vec4> tfColors;
+    for (int i = 0; i < 256; i++)
+        tfColors.push_back(glm::vec4(float(i), float(i) / 256.0f, 1.0f - float(i) / 256.0f, float(i % 16) / 15.0f));
+    const TransferFunctionView tf { glm::value_ptr(tfColors[0]), 256, 100.0f, 3000.0f };
+    std::vector<float> values;
+    for (int i = 0; i < count; i++)
+        values.push_back(float(i) * 7.3f - 200.0f);
+
+    // Isosurface hits at the sample positions with every kind of SurfaceHit, shaded from a viewer and light outside of
+    // the volume. Gradients outside of the volume are 0 and get no diffuse light.
+    std::vector<SurfaceHit> hits;
+    for (int i = 0; i < count; i++)
+        hits.push_back(SurfaceHit(i % 3));
+    const PhongView phong { 0.1f, 0.7f, 0.2f, { 0.8f, 0.5f, 0.1f }, { 30.0f, -12.0f, 25.0f }, { -8.0f, 20.0f, 30.0f } };
+
+    for (int level = int(SimdLevel::SSE42); level <= int(detectSimdLevel()); level++) {
+        INFO(simdLevelName(SimdLevel(level)));
+        const KernelTable* pKernels = kernelTable(SimdLevel(level));
+        REQUIRE(pKernels);
+
+        std::vector<float> samples(numSamples);
+        pKernels->sampleTrilinear(volumeView, xs.data(), ys.data(), zs.data(), count, samples.data());
+        for (size_t i = 0; i < numSamples; i++)
+            REQUIRE(samples[i] == volume.getSampleInterpolate(glm::vec3(xs[i], ys[i], zs[i])));
+
+        std::vector<volume::GradientVoxel> gradients(numSamples);
+        pKernels->sampleGradients(gradientView, xs.data(), ys.data(), zs.data(), count, glm::value_ptr(gradients[0].dir));
+        for (size_t i = 0; i < numSamples; i++) {
+            const volume::GradientVoxel expected = gradientVolume.getGradientInterpolate(glm::vec3(xs[i], ys[i], zs[i]));
+            REQUIRE(gradients[i].dir == expected.dir);
+            REQUIRE(gradients[i].magnitude == expected.magnitude);
+        }
+
+        // Same mapping as Renderer::getTFValue.
+        std::vector<glm::vec4> colors(numSamples);
+        pKernels->lookupTransferFunction(tf, values.data(), count, glm::value_ptr(colors[0]));
+        for (size_t i = 0; i < numSamples; i++) {
+            const float range01 = (values[i] - tf.indexStart) / tf.indexRange;
+            const size_t index = std::min(static_cast<size_t>(range01 * 256.0f), size_t(255));
+            REQUIRE(colors[i] == tfColors[index]);
+        }
+
+        // Compositing must stop at the sample that saturates the opacity.
+        glm::vec4 color { 0.0f };
+        float opacity = 0.0f, expectedOpacity = 0.0f;
+        glm::vec4 expectedColor { 0.0f };
+        int expectedComposited = 0;
+        while (expectedComposited < count && expectedOpacity < 1.0f) {
+            const glm::vec4 sample = colors[size_t(expectedComposited++)];
+            expectedColor += (1.0f - expectedOpacity) * sample.a * glm::vec4(glm::vec3(sample), 1.0f);
+            expectedOpacity += (1.0f - expectedOpacity) * sample.a;
+        }
+        REQUIRE(pKernels->composite(glm::value_ptr(colors[0]), count, glm::value_ptr(color), &opacity) == expectedComposited);
+        REQUIRE(color == expectedColor);
+        REQUIRE(opacity == expectedOpacity);
+
+        std::array<std::vector<float>, 3> gradientComponents;
+        for (int axis = 0; axis < 3; axis++) {
+            for (size_t i = 0; i < numSamples; i++)
+                gradientComponents[size_t(axis)].push_back(gradients[i].dir[axis]);
+        }
+        const SurfaceView surfaces {
+            hits.data(), { xs.data(), ys.data(), zs.data() },
+            { gradientComponents[0].data(), gradientComponents[1].data(), gradientComponents[2].data() }
+        };
+        std::vector<glm::vec4> shaded(numSamples);
+        pKernels->shadeSurfaces(surfaces, phong, count, glm::value_ptr(shaded[0]));
+        for (size_t i = 0; i < numSamples; i++) {
+            const glm::vec3 position { xs[i], ys[i], zs[i] };
+            const auto normalize = [](const glm::vec3& v) { return v * (1.0f / std::sqrt(glm::dot(v, v))); };
+            const glm::vec3 V = normalize(glm::make_vec3(phong.eye) - position);
+            const glm::vec3 L = normalize(position - glm::make_vec3(phong.light));
+            glm::vec4 expected { 0.0f, 0.0f, 0.0f, hits[i] == SurfaceHit::MissedVolume ? 0.0f : 1.0f };
+            if (hits[i] == SurfaceHit::HitSurface)
+                expected = glm::vec4(TestRenderer::test_computePhongShading(glm::make_vec3(phong.color), gradients[i], L, V), 1.0f);
+            REQUIRE(shaded[i] == expected);
+        }
+
+        for (const int n : { 0, 5, 16, count }) {
+            const float expected = std::accumulate(std::begin(samples), std::begin(samples) + n, 3.0f, [](float a, float b) { return std::max(a, b); });
+            REQUIRE(pKernels->maximum(samples.data(), n, 3.0f) == expected);
+        }
+
+        // The fixed-point kernel matches the integer arithmetic described in render/kernels_x86.h exactly, and is
+        // within the weight quantization (1/256 of the largest voxel difference per axis) of the float kernel.
+        std::vector<float> fixedSamples(numSamples);
+        pKernels->sampleTrilinearFixed(volumeView, xs.data(), ys.data(), zs.data(), count, fixedSamples.data());
+        for (size_t i = 0; i < numSamples; i++) {
+            const float x = xs[i], y = ys[i], z = zs[i];
+            int64_t expected = 0;
+            if (x >= 0.0f && y >= 0.0f && z >= 0.0f && x + 1.0f < float(dim.x) && y + 1.0f < float(dim.y) && z + 1.0f < float(dim.z)) {
+                const int x0 = int(x), y0 = int(y), z0 = int(z);
+                const int64_t wx = int64_t((x - float(x0)) * 256.0f), wy = int64_t((y - float(y0)) * 256.0f), wz = int64_t((z - float(z0)) * 256.0f);
+                const auto voxel = [&](int dx, int dy, int dz) { return int64_t(volume.getVoxel(x0 + dx, y0 + dy, z0 + dz)); };
+                const auto lerp = [](int64_t a, int64_t b, int64_t w) { return a * (256 - w) + b * w; };
+                const auto row = [&](int dy, int dz) { return lerp(voxel(0, dy, dz), voxel(1, dy, dz), wx); };
+                const int64_t bottom = (lerp(row(0, 0), row(1, 0), wy) + 128) >> 8;
+                const int64_t top = (lerp(row(0, 1), row(1, 1), wy) + 128) >> 8;
+                expected = lerp(bottom, top, wz);
+            }
+            REQUIRE(fixedSamples[i] == float(expected) / 65536.0f);
+            REQUIRE(fixedSamples[i] == Approx(samples[i]).margin(3.0f * 4096.0f / 256.0f + 1.0f));
+        }
+    }
+}
+
+TEST_CASE("Deferred Iso Shading Tests")
+{
+    const glm::ivec3 dim { 24, 20, 22 };
+    std::vector<uint16_t> data;
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                data.push_back(uint16_t(std::max(200.0f - 15.0f * glm::length(glm::vec3(x, y, z) - glm::vec3(11.5f, 9.0f, 10.5f)), 0.0f)));
+        }
+    }
+    volume::Volume volume { data, dim };
+    volume::GradientVolume gradientVolume { volume };
+    volume.interpolationMode = gradientVolume.interpolationMode = volume::InterpolationMode::Linear;
+    TestCamera camera { glm::vec3(1.6f, 1.3f, 1.9f) * glm::vec3(dim), glm::vec3(dim) / 2.0f };
+
+    render::RenderConfig config {};
+    config.renderMode = render::RenderMode::RenderIso;
+    config.renderResolution = glm::ivec2(40, 32);
+    config.volumeShading = true;
+    config.isoValue = 100.0f;
+    const auto frameBuffer = [](const render::Renderer& renderer) {
+        const auto pixels = renderer.frameBuffer();
+        return std::vector<glm::vec4>(std::begin(pixels), std::end(pixels));
+    };
+    const auto renderFromScratch = [&]() {
+        render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+        renderer.render();
+        return frameBuffer(renderer);
+    };
+
+    render::Renderer renderer { &volume, &gradientVolume, &camera, config };
+    renderer.render();
+    REQUIRE(renderer.stats().raysCast > 0);
+
+    // Changing only the shading shades the traced isosurface again without casting any rays.
+    const std::vector<std::function<void(render::RenderConfig&)>> shadingChanges {
+        [](render::RenderConfig& c) { c.isoColor = glm::vec3(0.2f, 0.4f, 0.9f); },
+        [](render::RenderConfig& c) { c.volumeShading = false; },
+        [](render::RenderConfig& c) { c.volumeShading = true; },
+        [](render::RenderConfig& c) { c.simdLevel = render::kernels::SimdLevel::Scalar; }
+    };
+    for (const auto& change : shadingChanges) {
+        change(config);
+        renderer.setConfig(config);
+        renderer.render();
+        REQUIRE(renderer.stats().raysCast == 0);
+        REQUIRE(frameBuffer(renderer) == renderFromScratch());
+    }
+    config.isoColor = glm::vec3(1.0f, 0.0f, 0.5f);
+    renderer.setConfig(config);
+    REQUIRE(renderer.render(render::Renderer::Clock::now() + std::chrono::hours(1)).allComplete());
+    REQUIRE(renderer.stats().raysCast == 0);
+    REQUIRE(frameBuffer(renderer) == renderFromScratch());
+
+    // Anything that moves the isosurface traces it again.
+    const std::vector<std::function<void()>> traceChanges {
+        [&]() { config.isoValue = 120.0f; },
+        [&]() { volume.interpolationMode = volume::InterpolationMode::Cubic; },
+        [&]() { camera = TestCamera { glm::vec3(0.5f, 0.5f, -1.4f) * glm::vec3(dim), glm::vec3(dim) / 2.0f }; }
+    };
+    for (const auto& change : traceChanges) {
+        change();
+        renderer.setConfig(config);
+        renderer.render();
+        REQUIRE(renderer.stats().raysCast > 0);
+        REQUIRE(frameBuffer(renderer) == renderFromScratch());
+    }
+}
+
+TEST_CASE("Cubic Interpolation Tests")
+{
+    // The B-spline weights of the 4 taps always sum to 1.
+    for (const float factor : { 0.0f, 0.25f, 0.5f, 0.9f }) {
+        const float sum = TestVolume::test_weight(factor + 1.0f) + TestVolume::test_weight(factor) + TestVolume::test_weight(1.0f - factor) + TestVolume::test_weight(2.0f - factor);
+        REQUIRE(sum == Approx(1.0f));
+    }
+
+    const glm::ivec3 dim { 6, 5, 7 };
+    std::vector<uint16_t> data;
+    for (int i = 0; i < dim.x * dim.y * dim.z; i++)
+        data.push_back(uint16_t((i * 37) % 101));
+    const TestVolume volume { data, dim };
+
+    // The prefiltered B-spline passes through the voxel values.
+    for (int z = 0; z < dim.z; z++) {
+        for (int y = 0; y < dim.y; y++) {
+            for (int x = 0; x < dim.x; x++)
+                REQUIRE(volume.test_getSampleTriCubicInterpolation(glm::vec3(x, y, z)) == Approx(volume.getVoxel(x, y, z)).margin(1e-2));
+        }
+    }
+
+    // The 8 fetch evaluation matches the direct evaluation of all 64 taps.
+    for (const glm::vec3 coord : { glm::vec3(0.3f, 1.7f, 2.2f), glm::vec3(2.5f, 2.5f, 2.5f), glm::vec3(4.9f, 0.1f, 5.6f) }) {
+        const int z = int(coord.z);
+        const glm::vec2 xy { coord.x, coord.y };
+        const float direct = TestVolume::test_cubicInterpolate(
+            volume.test_biCubicInterpolate(xy, z - 1), volume.test_biCubicInterpolate(xy, z), volume.test_biCubicInterpolate(xy, z + 1), volume.test_biCubicInterpolate(xy, z + 2), coord.z - float(z));
+        REQUIRE(volume.test_getSampleTriCubicInterpolation(coord) == Approx(direct).margin(1e-2));
+    }
+}
+
 TEST_CASE("Gradient Volume Tests")
 {
     volume::GradientVoxel gv = { glm::vec3(1.f, 0.f, 0.f), 1.f };
@@ -46,3 +1098,35 @@ TEST_CASE("Gradient Volume Tests")
     const TestGradientVolume gradient { volume };
     REQUIRE_NOTHROW(gradient.test_getGradientLinearInterpolate(glm::vec3(100.f)));
 }
+
+TEST_CASE("Cell Walker Tests")
+{
+    const glm::vec3 direction = glm::normalize(glm::vec3(1.0f, -0.5f, 0.25f));
+    const render::Ray ray { glm::vec3(0.2f, 5.3f, 0.4f), direction, 0.0f, 10.0f };
+    const glm::vec3 end = ray.origin + ray.tmax * ray.direction;
+
+    for (const float cellOrigin : { 0.0f, -0.5f }) {
+        render::CellWalker walker { ray, cellOrigin };
+        REQUIRE(walker.cell() == glm::ivec3(glm::floor(ray.origin - cellOrigin)));
+
+        // Every step moves to a neighbouring cell and starts where the previous cell ended.
+        int numCells = 1;
+        glm::ivec3 cell = walker.cell();
+        float tExit = walker.tExit();
+        while (walker.next()) {
+            const glm::ivec3 delta = glm::abs(walker.cell() - cell);
+            REQUIRE(delta.x + delta.y + delta.z == 1);
+            REQUIRE(walker.tEnter() == Approx(tExit));
+            cell = walker.cell();
+            tExit = walker.tExit();
+            numCells++;
+        }
+
+        // Each cell that the ray passes through is visited exactly once.
+        const glm::ivec3 endCell { glm::floor(end - cellOrigin) };
+        const glm::ivec3 crossings = glm::abs(endCell - glm::ivec3(glm::floor(ray.origin - cellOrigin)));
+        REQUIRE(cell == endCell);
+        REQUIRE(numCells == crossings.x + crossings.y + crossings.z + 1);
+        REQUIRE(tExit == Approx(ray.tmax));
+    }
+}
\ No newline at end of file
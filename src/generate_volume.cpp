@@ -0,0 +1,83 @@
+// Writes a procedural volume (see volume/procedural_volume.h) to an .fld file, to benchmark the viewer at any size:
+//   VolumeGenerator <scene> <size> <file.fld> [--type byte|short|float] [--seed n] [--density fraction]
+// where scene is noise, spheres, vessels or sparse and size is either N (for N^3 voxels) or XxYxZ.
+#include "volume/procedural_volume.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fmt/format.h>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+static std::optional<glm::ivec3> parseSize(const std::string& text)
+{
+    glm::ivec3 dims;
+    int length = 0;
+    if (std::sscanf(text.c_str(), "%dx%dx%d%n", &dims.x, &dims.y, &dims.z, &length) != 3 || size_t(length) != text.size()) {
+        // A single number is the size of a cube.
+        length = 0;
+        if (std::sscanf(text.c_str(), "%d%n", &dims.x, &length) != 1 || size_t(length) != text.size())
+            return {};
+        dims = glm::ivec3(dims.x);
+    }
+    if (dims.x < 1 || dims.y < 1 || dims.z < 1)
+        return {};
+    return dims;
+}
+
+static int printUsage()
+{
+    std::cerr << "Usage: VolumeGenerator <noise|spheres|vessels|sparse> <N|XxYxZ> <file.fld> [--type byte|short|float] [--seed n] [--density fraction]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    // The file is followed by pairs of an option and its value.
+    if (argc < 4 || argc % 2 != 0)
+        return printUsage();
+
+    volume::ProceduralVolumeSettings settings;
+    const auto sceneName = std::find(std::begin(volume::proceduralSceneNames), std::end(volume::proceduralSceneNames), std::string_view(argv[1]));
+    if (sceneName == std::end(volume::proceduralSceneNames))
+        return printUsage();
+    settings.scene = volume::ProceduralScene(sceneName - std::begin(volume::proceduralSceneNames));
+    const auto optDims = parseSize(argv[2]);
+    if (!optDims)
+        return printUsage();
+    settings.dims = *optDims;
+    const std::string file = argv[3];
+
+    for (int i = 4; i < argc; i += 2) {
+        const std::string_view option = argv[i];
+        const std::string value = argv[i + 1];
+        if (option == "--type") {
+            if (value == "byte")
+                settings.voxelType = volume::VoxelType::UInt8;
+            else if (value == "short")
+                settings.voxelType = volume::VoxelType::UInt16;
+            else if (value == "float")
+                settings.voxelType = volume::VoxelType::Float32;
+            else
+                return printUsage();
+        } else if (option == "--seed") {
+            settings.seed = uint32_t(std::stoul(value));
+        } else if (option == "--density") {
+            settings.density = std::stof(value);
+        } else {
+            return printUsage();
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    if (!volume::writeProceduralVolume(settings, file)) {
+        std::cerr << "Could not write " << file << std::endl;
+        return 1;
+    }
+    const std::chrono::duration<double> duration = clock::now() - start;
+    std::cout << fmt::format("Wrote {} ({}x{}x{} voxels) in {:.2f}s", file, settings.dims.x, settings.dims.y, settings.dims.z, duration.count()) << std::endl;
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include "ui/menu.h"
 #include "ui/surface_cube.h"
 #include "ui/trackball.h"
+#include "ui/volume_loader.h"
 #include "ui/window.h"
 #include "ui/wireframe_cube.h"
 #include "volume/gradient_volume.h"
@@ -21,6 +22,7 @@
 #include <glm/vec3.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <ratio>
 #include <vector>
@@ -45,36 +47,52 @@ int main(int argc, char** argv)
     ui::Trackball trackballCamera { &myWindow, glm::radians(60.0f), aspectRatio };
 
     // Render instance contains everything you need to render (volume + renderer). Initially there is
-    // nothing to render hence the optional (initially it is empty). The optional is passed to the menu
-    // class which is responsible for creating the volume + renderer when the user loads a volume.
-    std::optional<volume::Volume> optVolume;
-    std::optional<volume::GradientVolume> optGradientVolume;
+    // nothing to render hence the pointers and the optional (initially they are empty). They are filled by
+    // the load volume callback of the menu (see ui/volume_loader.h).
+    std::unique_ptr<volume::Volume> pVolume;
+    std::unique_ptr<volume::GradientVolume> pGradientVolume;
+    // The camera in the coordinates of pVolume while it is a preview (see ui::VolumeLoader).
+    std::optional<render::ScaledCamera> optPreviewCamera;
     std::optional<render::Renderer> optRenderer;
+    // Extent of the volume in voxels of the file, which the camera and the wireframe are placed around.
+    glm::ivec3 volumeDims;
     ui::Menu volVisMenu { viewportSize };
+    ui::VolumeLoader volumeLoader;
 
-    // Whether to redraw because the user interacted with the application. When this is the reason for the
-    // redraw then dynamic resolution scaling is enabled. After the user interaction, one more render is
-    // performed at the full (selected) resolution. When the application is static no renders are performed.
+    // Whether to redraw because the user interacted with the application. Rendering is deadline-driven: each frame
+    // traces as many tiles as fit in the frame time budget (center of the screen first). Tiles that did not fit are
+    // traced in the following frames (refinement) until the image is complete. When the application is static no renders are performed.
     bool redrawUserInteraction = false;
-    bool redrawFullResolution = true;
-    auto loadVolume = [&](const std::filesystem::path& filePath) {
-        optVolume.emplace(filePath.string());
-        optVolume->interpolationMode = volVisMenu.interpolationMode();
-        optGradientVolume.emplace(optVolume.value());
-        optRenderer.emplace(&optVolume.value(), &optGradientVolume.value(), &trackballCamera, volVisMenu.renderConfig());
-
-        const float maxDimension = float(glm::compMax(optVolume->dims()));
-        trackballCamera.setDistance(maxDimension);
-        trackballCamera.setWorldScale(maxDimension);
-        trackballCamera.setLookAt(glm::vec3(optVolume->dims()) / 2.0f);
-
-        volVisMenu.setLoadedVolume(optVolume.value(), optGradientVolume.value());
+    bool refineFrame = false;
+    // Replace the volume that is shown by a preview or a loaded volume. Called between frames.
+    auto showVolume = [&](ui::LoadedVolume&& loadedVolume) {
+        volVisMenu.setLoadedVolume(loadedVolume);
+
+        // The renderer refers to the previous volume.
+        optRenderer.reset();
+        pVolume = std::move(loadedVolume.pVolume);
+        pGradientVolume = std::move(loadedVolume.pGradientVolume);
+        pVolume->interpolationMode = volVisMenu.interpolationMode();
+        volumeDims = (pVolume->dims() - 1) * loadedVolume.stride + 1;
+
+        // Keep the view that the user chose while looking at the preview of this volume.
+        if (!optPreviewCamera) {
+            const float maxDimension = float(glm::compMax(volumeDims));
+            trackballCamera.setDistance(maxDimension);
+            trackballCamera.setWorldScale(maxDimension);
+            trackballCamera.setLookAt(glm::vec3(volumeDims) / 2.0f);
+        }
+        optPreviewCamera.reset();
+        const render::RayTraceCamera* pCamera = &trackballCamera;
+        if (loadedVolume.stride > 1)
+            pCamera = &optPreviewCamera.emplace(&trackballCamera, float(loadedVolume.stride));
+        optRenderer.emplace(pVolume.get(), pGradientVolume.get(), pCamera, volVisMenu.renderConfig());
 
         redrawUserInteraction = true;
     };
 
     // Callbacks.
-    volVisMenu.setLoadVolumeCallback(loadVolume);
+    volVisMenu.setLoadVolumeCallback([&](const std::filesystem::path& filePath) { volumeLoader.start(filePath); });
     volVisMenu.setRenderConfigChangedCallback(
         [&](const render::RenderConfig& renderConfig) {
             if (optRenderer)
@@ -83,12 +101,17 @@ int main(int argc, char** argv)
         });
     volVisMenu.setInterpolationModeChangedCallback(
         [&](volume::InterpolationMode interpolationMode) {
-            if (optVolume) {
-                optVolume->interpolationMode = interpolationMode;
-                optGradientVolume->interpolationMode = interpolationMode;
+            if (pVolume) {
+                pVolume->interpolationMode = interpolationMode;
+                pGradientVolume->interpolationMode = interpolationMode;
             }
             redrawUserInteraction = true;
         });
+    volVisMenu.setProjectionChangedCallback(
+        [&](bool orthographic) {
+            trackballCamera.setOrthographic(orthographic);
+            redrawUserInteraction = true;
+        });
     myWindow.registerWindowResizeCallback(
         [&](const glm::ivec2& newWindowSize) {
             // Maintain aspect ratio!
@@ -106,12 +129,16 @@ int main(int argc, char** argv)
     ui::WireframeCube wireframeCube;
     ui::SurfaceCube surfaceCube;
 
-    // The dynamic resolution scale that was used in previous frame (to keep the frame time below the target).
-    int prevResolutionScale = 1;
     std::chrono::duration<double> renderTime { 0 };
     while (!myWindow.shouldClose()) {
         myWindow.updateInput();
 
+        if (auto optPreview = volumeLoader.takePreview())
+            showVolume(std::move(*optPreview));
+        if (auto optLoadedVolume = volumeLoader.takeVolume())
+            showVolume(std::move(*optLoadedVolume));
+        volVisMenu.setLoadingProgress(volumeLoader.progress());
+
         if (optRenderer.has_value()) {
             // If camera changed in any way then we need to redraw.
             static glm::mat4 prevViewMatrix = glm::identity<glm::mat4>();
@@ -120,53 +147,34 @@ int main(int argc, char** argv)
                 prevViewMatrix = viewMatrix;
                 redrawUserInteraction = true;
             }
-            // If previous frame we rendered at a lower resolution (because something changed) then it will request to draw
-            // the next frame in full resolution. If the user is still holding the mouse button then we can reasonably assume
-            // that (s)he is not finished with the interaction (so we should keep rendering at a lower resolution).
-            if (redrawFullResolution && (myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_LEFT) || myWindow.isMouseButtonPressed(GLFW_MOUSE_BUTTON_RIGHT)))
-                redrawUserInteraction = true;
 
             // We draw when either the user has interacted (camera matrix changed or render config changed (see callback)) or if
-            //  last frame we rendered at a lower resolution and we want to now render at the full resolution.
-            if (redrawUserInteraction || redrawFullResolution) {
-                if (redrawUserInteraction) {
-                    // Reduce the resolution if the performance drops below the target frame time.
-                    // Estimated performance when rendering at full resolution (resolution returned from menu).
-                    // This way we can dynamically update the resolution while the user is moving the camera since
-                    // some views may be slower to render than others.
-                    const float estimatedFullResFrameTime = float(renderTime.count()) * float(prevResolutionScale * prevResolutionScale);
-                    const float performanceScale = estimatedFullResFrameTime / float(frameTimeTarget);
-                    // Resolution scale changes the number of pixels quadratically (scales both width and height).
-                    const int resolutionScale = std::max(int(std::sqrt(performanceScale)) + 1, 1);
-
-                    // NOTE(Mathijs): calling setBaseRenderResolution will update the render config and call
-                    //  the associated callback. Make sure that you don't read redrawUserInteraction after
-                    //  this call because it will always be true.
-                    volVisMenu.setBaseRenderResolution(baseRenderResolution / resolutionScale);
-                    redrawFullResolution = true;
-                    prevResolutionScale = resolutionScale;
-                } else {
-                    prevResolutionScale = 1;
-                    volVisMenu.setBaseRenderResolution(baseRenderResolution);
-                    redrawFullResolution = false;
-                }
-                redrawUserInteraction = false;
-
-                using clock = std::chrono::high_resolution_clock;
+            //  last frame did not finish all tiles before the deadline and we want to continue refining the image.
+            if (redrawUserInteraction || refineFrame) {
+                using clock = render::Renderer::Clock;
                 const auto start = clock::now();
-                optRenderer->render();
+                const auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(frameTimeTarget));
+                const render::TileMask& tileMask = redrawUserInteraction ? optRenderer->render(deadline) : optRenderer->continueRender(deadline);
                 const auto end = clock::now();
                 renderTime = end - start;
 
-                fullScreenTextureGL.update(optRenderer->frameBuffer(), volVisMenu.renderConfig().renderResolution);
+                refineFrame = !tileMask.allComplete();
+                redrawUserInteraction = false;
+                volVisMenu.addRenderStats(optRenderer->stats());
+
+                const render::RenderConfig renderConfig = volVisMenu.renderConfig();
+                if (renderConfig.showCostHeatmap)
+                    fullScreenTextureGL.update(optRenderer->costHeatmap(), renderConfig.renderResolution);
+                else
+                    fullScreenTextureGL.update(optRenderer->frameBuffer(), renderConfig.renderResolution);
             }
 
             // === Drawing the framebuffer to the screen and adding the wireframe. ===
 
             // Make the wireframe slightly larger than the volume to prevent z-fighting
             constexpr float wireframeMargin = 0.05f;
-            const auto wireframeCubeSize = glm::vec3(optVolume->dims()) * (1.0f + wireframeMargin);
-            const auto wireframeCubeOffset = -glm::vec3(optVolume->dims()) * wireframeMargin * 0.5f;
+            const auto wireframeCubeSize = glm::vec3(volumeDims) * (1.0f + wireframeMargin);
+            const auto wireframeCubeOffset = -glm::vec3(volumeDims) * wireframeMargin * 0.5f;
             constexpr glm::vec3 wireframeColor { 1.0f };
 
             // Draw on the left side of the screen next to the menu.
@@ -183,7 +191,7 @@ int main(int argc, char** argv)
             glDepthMask(GL_TRUE);
             glDepthFunc(GL_LEQUAL);
             glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-            surfaceCube.draw(trackballCamera, optVolume->dims());
+            surfaceCube.draw(trackballCamera, volumeDims);
 
             // Enable color writes and depth blending.
             glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
@@ -0,0 +1,117 @@
+#include "profiler.h"
+#ifdef VOLVIS_PROFILING
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace profiling {
+
+#ifdef VOLVIS_PROFILING
+
+struct Event {
+    const char* name;
+    long long startNs;
+    long long durationNs;
+};
+
+// Events of a single thread. Only the owning thread writes to the buffer so recording an event does not require
+// any locks; the event count is published with release semantics so that the exporter sees complete events.
+// When the buffer is full the oldest events are overwritten.
+struct ThreadBuffer {
+    static constexpr size_t capacity = 1 << 16;
+
+    int threadId;
+    std::array<Event, capacity> events;
+    std::atomic_size_t count { 0 };
+};
+
+struct Registry {
+    std::mutex mutex; // Only taken when a thread records its first event and when exporting.
+    std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+};
+
+static Registry& registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+static ThreadBuffer& threadBuffer()
+{
+    static thread_local ThreadBuffer* pBuffer = [] {
+        Registry& reg = registry();
+        const std::lock_guard lock { reg.mutex };
+        auto pNewBuffer = std::make_unique<ThreadBuffer>();
+        pNewBuffer->threadId = int(reg.threadBuffers.size());
+        reg.threadBuffers.push_back(std::move(pNewBuffer));
+        return reg.threadBuffers.back().get();
+    }();
+    return *pBuffer;
+}
+
+static long long nowNs()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+ScopedZone::ScopedZone(const char* name)
+    : m_name(name)
+    , m_startNs(nowNs())
+{
+}
+
+ScopedZone::~ScopedZone()
+{
+    const long long endNs = nowNs();
+    ThreadBuffer& buffer = threadBuffer();
+    const size_t i = buffer.count.load(std::memory_order_relaxed);
+    buffer.events[i % ThreadBuffer::capacity] = Event { m_name, m_startNs, endNs - m_startNs };
+    buffer.count.store(i + 1, std::memory_order_release);
+}
+
+bool writeChromeTrace(const std::filesystem::path& filePath)
+{
+    std::ofstream file { filePath };
+    if (!file.is_open())
+        return false;
+
+    Registry& reg = registry();
+    const std::lock_guard lock { reg.mutex };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& pBuffer : reg.threadBuffers) {
+        // Name the threads so that they show up in a fixed order in the timeline.
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pBuffer->threadId
+             << ",\"args\":{\"name\":\"thread " << pBuffer->threadId << "\"}}";
+        first = false;
+
+        const size_t count = pBuffer->count.load(std::memory_order_acquire);
+        const size_t begin = count > ThreadBuffer::capacity ? count - ThreadBuffer::capacity : 0;
+        for (size_t i = begin; i < count; i++) {
+            const Event& event = pBuffer->events[i % ThreadBuffer::capacity];
+            // Timestamps are in microseconds.
+            file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"volvis\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBuffer->threadId
+                 << ",\"ts\":" << double(event.startNs) / 1000.0 << ",\"dur\":" << double(event.durationNs) / 1000.0 << '}';
+        }
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
+
+#else
+
+bool writeChromeTrace(const std::filesystem::path&)
+{
+    return false;
+}
+
+#endif
+
+}
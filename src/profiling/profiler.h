@@ -0,0 +1,48 @@
+#pragma once
+#include <filesystem>
+
+// Scoped profiling zones. PROFILE_ZONE("name") records the time between its construction and the end of the
+// enclosing scope on the calling thread. The zones are compiled out unless VOLVIS_PROFILING is defined (see the
+// ENABLE_PROFILING CMake option). The name must be a string literal (only the pointer is stored).
+#ifdef VOLVIS_PROFILING
+#define VOLVIS_PROFILE_CONCAT_IMPL(a, b) a##b
+#define VOLVIS_PROFILE_CONCAT(a, b) VOLVIS_PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_ZONE(name) const ::profiling::ScopedZone VOLVIS_PROFILE_CONCAT(profileZone, __LINE__) { name }
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+namespace profiling {
+
+// Whether the profiling zones were compiled in.
+constexpr bool enabled()
+{
+#ifdef VOLVIS_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef VOLVIS_PROFILING
+class ScopedZone {
+public:
+    explicit ScopedZone(const char* name);
+    ~ScopedZone();
+
+    ScopedZone(const ScopedZone&) = delete;
+    ScopedZone& operator=(const ScopedZone&) = delete;
+
+private:
+    const char* m_name;
+    long long m_startNs;
+};
+#endif
+
+// Write all recorded zones of all threads to a JSON file in the Chrome trace-event format, which can be opened with
+// chrome://tracing or https://ui.perfetto.dev . Call this between frames: threads that are still recording zones
+// may overwrite the oldest events while they are being exported. Returns false if the file could not be written
+// or if profiling was compiled out.
+bool writeChromeTrace(const std::filesystem::path& filePath);
+
+}
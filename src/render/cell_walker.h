@@ -0,0 +1,82 @@
+#pragma once
+#include "render/ray.h"
+#include <algorithm>
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <limits>
+
+namespace render {
+
+// Front-to-back traversal of the unit cells pierced by a ray between ray.tmin and ray.tmax (3D DDA, see
+// "A Fast Voxel Traversal Algorithm for Ray Tracing" by Amanatides and Woo). Cell i spans
+// [i + cellOrigin, i + 1 + cellOrigin) along every axis: use a cellOrigin of -0.5 to walk the voxel regions of
+// nearest neighbour sampling and 0 to walk the cells of trilinear interpolation (voxels at the corners).
+// Every cell is visited exactly once; the walker does not clip against the volume so cells outside of it may be
+// returned at the start or end of the ray.
+class CellWalker {
+public:
+    CellWalker(const Ray& ray, float cellOrigin)
+        : m_tEnter(ray.tmin)
+        , m_tMax(ray.tmax)
+    {
+        static constexpr float infinity = std::numeric_limits<float>::infinity();
+        const glm::vec3 start = ray.origin + ray.tmin * ray.direction - cellOrigin;
+        m_cell = glm::ivec3(glm::floor(start));
+        for (int axis = 0; axis < 3; axis++) {
+            const float direction = ray.direction[axis];
+            if (direction > 0.0f) {
+                m_step[axis] = 1;
+                m_tDelta[axis] = 1.0f / direction;
+                m_tNext[axis] = ray.tmin + (float(m_cell[axis] + 1) - start[axis]) / direction;
+            } else if (direction < 0.0f) {
+                m_step[axis] = -1;
+                m_tDelta[axis] = -1.0f / direction;
+                m_tNext[axis] = ray.tmin + (float(m_cell[axis]) - start[axis]) / direction;
+            } else {
+                m_step[axis] = 0;
+                m_tDelta[axis] = infinity;
+                m_tNext[axis] = infinity;
+            }
+        }
+    }
+
+    // Current cell and the ray parameters at which the ray enters and leaves it.
+    glm::ivec3 cell() const { return m_cell; }
+    float tEnter() const { return m_tEnter; }
+    float tExit() const { return std::min(m_tNext[nextAxis()], m_tMax); }
+
+    // Axis along which the last call to next() moved (-1 before the first step) and the direction of the move.
+    int lastAxis() const { return m_lastAxis; }
+    int lastStep() const { return m_step[m_lastAxis]; }
+
+    // Advance to the next cell along the ray. Returns false once the ray has passed ray.tmax.
+    bool next()
+    {
+        const int axis = nextAxis();
+        m_tEnter = m_tNext[axis];
+        m_tNext[axis] += m_tDelta[axis];
+        m_cell[axis] += m_step[axis];
+        m_lastAxis = axis;
+        return m_tEnter <= m_tMax;
+    }
+
+private:
+    int nextAxis() const
+    {
+        if (m_tNext.x < m_tNext.y)
+            return m_tNext.x < m_tNext.z ? 0 : 2;
+        else
+            return m_tNext.y < m_tNext.z ? 1 : 2;
+    }
+
+private:
+    glm::ivec3 m_cell;
+    glm::ivec3 m_step;
+    glm::vec3 m_tDelta;
+    glm::vec3 m_tNext;
+    float m_tEnter;
+    float m_tMax;
+    int m_lastAxis { -1 };
+};
+
+}
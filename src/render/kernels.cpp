@@ -0,0 +1,129 @@
+#include "kernels.h"
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#if defined(_MSC_VER)
+#include <intrin.h> // __cpuid, _xgetbv
+#endif
+
+namespace render::kernels {
+
+SimdLevel detectSimdLevel()
+{
+#if defined(VOLVIS_X86_KERNELS) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse42 = (info[2] & (1 << 20)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    // The operating system must save the YMM (and for AVX-512 the opmask and ZMM) registers on a context switch.
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = avx && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = avx2 && (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    }
+    if (avx512)
+        return SimdLevel::AVX512;
+    if (avx2)
+        return SimdLevel::AVX2;
+    if (sse42)
+        return SimdLevel::SSE42;
+    return SimdLevel::Scalar;
+#elif defined(VOLVIS_X86_KERNELS)
+    // Reads CPUID and checks that the operating system saves the extended registers.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SimdLevel::SSE42;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+static SimdLevel simdLevelFromEnvironment(SimdLevel detected)
+{
+    const char* pValue = std::getenv("VOLVIS_SIMD");
+    if (!pValue)
+        return detected;
+
+    const std::string_view value { pValue };
+    SimdLevel requested;
+    if (value == "scalar") {
+        requested = SimdLevel::Scalar;
+    } else if (value == "sse4.2" || value == "sse42") {
+        requested = SimdLevel::SSE42;
+    } else if (value == "avx2") {
+        requested = SimdLevel::AVX2;
+    } else if (value == "avx512") {
+        requested = SimdLevel::AVX512;
+    } else {
+        std::cerr << "Unknown VOLVIS_SIMD value \"" << value << "\" (expected scalar, sse4.2, avx2 or avx512); using "
+                  << simdLevelName(detected) << std::endl;
+        return detected;
+    }
+
+    if (requested > detected) {
+        std::cerr << "VOLVIS_SIMD=" << value << " is not supported by this machine; using " << simdLevelName(detected) << std::endl;
+        return detected;
+    }
+    return requested;
+}
+
+SimdLevel defaultSimdLevel()
+{
+    static const SimdLevel level = simdLevelFromEnvironment(detectSimdLevel());
+    return level;
+}
+
+const KernelTable* kernelTable(SimdLevel level)
+{
+    static const SimdLevel detected = detectSimdLevel();
+    if (level > detected)
+        return nullptr;
+
+    switch (level) {
+#ifdef VOLVIS_X86_KERNELS
+    case SimdLevel::SSE42: {
+        return &sse42Kernels;
+    }
+    case SimdLevel::AVX2: {
+        return &avx2Kernels;
+    }
+    case SimdLevel::AVX512: {
+        return &avx512Kernels;
+    }
+#endif
+    default: {
+        return nullptr;
+    }
+    };
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::Scalar: {
+        return "Scalar";
+    }
+    case SimdLevel::SSE42: {
+        return "SSE4.2";
+    }
+    case SimdLevel::AVX2: {
+        return "AVX2";
+    }
+    case SimdLevel::AVX512: {
+        return "AVX-512";
+    }
+    };
+    return "";
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "volume/voxel_type.h"
+#include <cstddef>
+#include <cstdint>
+
+// Hot loops of the raycaster, compiled once per x86 instruction set (kernels_sse42.cpp, kernels_avx2.cpp and
+// kernels_avx512.cpp, each built with its own compiler flags) and selected at runtime. The kernels work on blocks of
+// samples along a ray and produce exactly the same results as the scalar code in volume::Volume,
+// volume::GradientVolume and the Renderer, so that the instruction set never changes the image.
+//
+// The kernel files must not include glm or any other header with inline functions: the linker is free to pick
+// the copy of an inline function from any translation unit, which could be one that was compiled for AVX-512.
+namespace render::kernels {
+
+enum class SimdLevel {
+    Scalar = 0,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+// Voxels of the given type in x-major order; the volume must have fewer than 2^31 voxels (indices are computed in
+// 32 bits). uint8 data must be followed by 2 bytes of padding (see volume::Volume).
+struct VolumeView {
+    const void* data;
+    volume::VoxelType type;
+    int dims[3];
+};
+
+// Gradient voxels (direction x, y, z and magnitude) in x-major order.
+struct GradientView {
+    const float* data;
+    int dims[3];
+};
+
+// RGBA entries of the 1D transfer function and the mapping from value to index (see Renderer::getTFValue).
+struct TransferFunctionView {
+    const float* colors;
+    int size;
+    float indexStart;
+    float indexRange;
+};
+
+// How the ray of a pixel ended in the ISO render mode: it missed the volume (transparent black), passed through the
+// volume without hitting the isosurface (opaque black) or hit the isosurface.
+enum class SurfaceHit : uint8_t {
+    MissedVolume = 0,
+    MissedSurface,
+    HitSurface
+};
+
+// Isosurface hits of the deferred ISO shading pass (see Renderer::GBuffer): the SurfaceHit of each pixel, and the hit
+// position and the (not normalized) gradient there as separate x, y and z arrays.
+struct SurfaceView {
+    const SurfaceHit* hit;
+    const float* position[3];
+    const float* gradient[3];
+};
+
+// Phong shading of the isosurface: the coefficients of Renderer::computePhongShading, the surface color and the
+// positions of the viewer and of the point light.
+struct PhongView {
+    float ambient, diffuse, specular;
+    float color[3];
+    float eye[3];
+    float light[3];
+};
+
+// Phong shading raises the specular cosine to the power 100 (as x^64 * x^32 * x^4). Below this cosine the result
+// would be a denormal number, which is very slow to compute, so the specular term is 0 instead.
+constexpr float minSpecularCosine = 0.42f;
+
+struct KernelTable {
+    SimdLevel level;
+
+    // Trilinearly interpolated volume values at (xs[i], ys[i], zs[i]), 0 outside of the volume.
+    void (*sampleTrilinear)(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out);
+    // Approximation of sampleTrilinear with integer arithmetic: the interpolation weights are quantized to 8 bits
+    // (1/256) and the voxels are blended as signed 16-bit integers, so uint16 voxels must be below 32768. Float
+    // volumes are interpolated exactly like sampleTrilinear. The result is the same for every instruction set.
+    void (*sampleTrilinearFixed)(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out);
+    // Trilinearly interpolated gradients at (xs[i], ys[i], zs[i]), 4 floats per sample, 0 outside of the volume.
+    void (*sampleGradients)(const GradientView& gradients, const float* xs, const float* ys, const float* zs, int count, float* out);
+    // Transfer function lookup: 4 floats (RGBA) per value.
+    void (*lookupTransferFunction)(const TransferFunctionView& tf, const float* values, int count, float* out);
+    // Front-to-back compositing of count RGBA samples into color (RGBA) and opacity. Returns the number of samples
+    // that were composited, which is less than count if the opacity saturated.
+    int (*composite)(const float* rgba, int count, float* color, float* opacity);
+    // Maximum of initial and the values.
+    float (*maximum)(const float* values, int count, float initial);
+    // Phong shaded colors of count isosurface hits, 4 floats (RGBA) per pixel with an opacity of 1. Pixels that did
+    // not hit the surface are black (see SurfaceHit). Computed in exactly the same way as Renderer::computePhongShading.
+    void (*shadeSurfaces)(const SurfaceView& surfaces, const PhongView& phong, int count, float* out);
+};
+
+// Highest level that is supported by both the processor and the operating system.
+SimdLevel detectSimdLevel();
+// The level that new render configs start with: detectSimdLevel(), unless it is overridden with the environment
+// variable VOLVIS_SIMD (scalar, sse4.2, avx2 or avx512). Determined once.
+SimdLevel defaultSimdLevel();
+// Kernels for the given level, or nullptr for SimdLevel::Scalar and for levels that this machine does not support.
+const KernelTable* kernelTable(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+#ifdef VOLVIS_X86_KERNELS
+// Defined in the translation unit of each instruction set; only use them after checking detectSimdLevel().
+extern const KernelTable sse42Kernels;
+extern const KernelTable avx2Kernels;
+extern const KernelTable avx512Kernels;
+#endif
+
+}
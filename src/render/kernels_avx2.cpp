@@ -0,0 +1,292 @@
+// AVX2 kernels, compiled with -mavx2 -ffp-contract=off (see render/kernels.h).
+#include "kernels_x86.h"
+
+namespace render::kernels {
+
+static __m256 lerp(__m256 a, __m256 b, __m256 t)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+static __m256 combine(__m128 lower, __m128 upper)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lower), upper, 1);
+}
+
+static __m256 dot3(const __m256 (&a)[3], const __m256 (&b)[3])
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], b[0]), _mm256_mul_ps(a[1], b[1])), _mm256_mul_ps(a[2], b[2]));
+}
+
+static void normalize3(__m256 (&v)[3])
+{
+    const __m256 inverseLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(dot3(v, v)));
+    for (__m256& component : v)
+        component = _mm256_mul_ps(component, inverseLength);
+}
+
+static __m256 absolute(__m256 x)
+{
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+static __m256 power100(__m256 x)
+{
+    const __m256 cutoff = _mm256_set1_ps(minSpecularCosine);
+    const __m256 x1 = _mm256_max_ps(x, cutoff);
+    const __m256 x2 = _mm256_mul_ps(x1, x1), x4 = _mm256_mul_ps(x2, x2), x8 = _mm256_mul_ps(x4, x4);
+    const __m256 x16 = _mm256_mul_ps(x8, x8), x32 = _mm256_mul_ps(x16, x16), x64 = _mm256_mul_ps(x32, x32);
+    return _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(x64, x32), x4), _mm256_cmp_ps(x, cutoff, _CMP_GE_OQ));
+}
+
+// The cells (x0, y0, z0) of 8 samples, their indices and which of them lie inside of the volume.
+struct Cells8 {
+    __m256 inside;
+    __m256i x0, y0, z0, index;
+};
+
+static Cells8 findCells(const VolumeView& volume, __m256 x, __m256 y, __m256 z)
+{
+    Cells8 cells;
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_cmp_ps(y, zero, _CMP_GE_OQ)), _mm256_cmp_ps(z, zero, _CMP_GE_OQ));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(x, one), _mm256_set1_ps(float(volume.dims[0])), _CMP_LT_OQ));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(y, one), _mm256_set1_ps(float(volume.dims[1])), _CMP_LT_OQ));
+    cells.inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(z, one), _mm256_set1_ps(float(volume.dims[2])), _CMP_LT_OQ));
+
+    cells.x0 = _mm256_cvttps_epi32(x);
+    cells.y0 = _mm256_cvttps_epi32(y);
+    cells.z0 = _mm256_cvttps_epi32(z);
+    cells.index = _mm256_add_epi32(cells.x0,
+        _mm256_mullo_epi32(_mm256_set1_epi32(volume.dims[0]), _mm256_add_epi32(cells.y0, _mm256_mullo_epi32(_mm256_set1_epi32(volume.dims[1]), cells.z0))));
+    return cells;
+}
+
+// Corner pairs (x0, x0 + 1) of the row at offset from the cell origins of integer voxels, as 16-bit words: x0 in the
+// low and x0 + 1 in the high half of every lane. x neighbours are adjacent, so a single 32-bit gather fetches both
+// 16-bit voxels; for bytes it fetches x0 + 2 and x0 + 3 as well, which are masked off. Lanes outside of the volume
+// are not fetched and stay 0.
+template <typename T>
+static __m256i gatherWordPairs(const VolumeView& volume, const Cells8& cells, int offset)
+{
+    const __m256i pairs = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), static_cast<const int*>(volume.data),
+        _mm256_add_epi32(cells.index, _mm256_set1_epi32(offset)), _mm256_castps_si256(cells.inside), int(sizeof(T)));
+    if constexpr (sizeof(T) == 1)
+        return _mm256_or_si256(_mm256_and_si256(pairs, _mm256_set1_epi32(0xFF)), _mm256_slli_epi32(_mm256_and_si256(pairs, _mm256_set1_epi32(0xFF00)), 8));
+    else
+        return pairs;
+}
+
+// The corners (x0, x0 + 1) of the row at offset from the cell origins as floats.
+template <typename T>
+static void gatherCorners(const VolumeView& volume, const Cells8& cells, int offset, __m256& lower, __m256& upper)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        const float* data = static_cast<const float*>(volume.data);
+        const __m256i index = _mm256_add_epi32(cells.index, _mm256_set1_epi32(offset));
+        lower = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), data, index, cells.inside, 4);
+        upper = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), data + 1, index, cells.inside, 4);
+    } else {
+        const __m256i pairs = gatherWordPairs<T>(volume, cells, offset);
+        if constexpr (std::is_signed_v<T>) {
+            lower = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16));
+            upper = _mm256_cvtepi32_ps(_mm256_srai_epi32(pairs, 16));
+        } else {
+            lower = _mm256_cvtepi32_ps(_mm256_and_si256(pairs, _mm256_set1_epi32(0xFFFF)));
+            upper = _mm256_cvtepi32_ps(_mm256_srli_epi32(pairs, 16));
+        }
+    }
+}
+
+// 8 samples per iteration; 4 gathers (8 for floats) fetch all 8 corners.
+template <typename T>
+static void sampleTrilinear8(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m256 x = _mm256_loadu_ps(xs), y = _mm256_loadu_ps(ys), z = _mm256_loadu_ps(zs);
+    const Cells8 cells = findCells(volume, x, y, z);
+    if (_mm256_movemask_ps(cells.inside) == 0) {
+        _mm256_storeu_ps(out, _mm256_setzero_ps());
+        return;
+    }
+
+    const __m256 xFactor = _mm256_sub_ps(x, _mm256_cvtepi32_ps(cells.x0));
+    const __m256 yFactor = _mm256_sub_ps(y, _mm256_cvtepi32_ps(cells.y0));
+    const __m256 zFactor = _mm256_sub_ps(z, _mm256_cvtepi32_ps(cells.z0));
+    const auto pair = [&](int offset) {
+        __m256 lower, upper;
+        gatherCorners<T>(volume, cells, offset, lower, upper);
+        return lerp(lower, upper, xFactor);
+    };
+    const int strideY = volume.dims[0], strideZ = volume.dims[0] * volume.dims[1];
+    const __m256 bottom = lerp(pair(0), pair(strideY), yFactor);
+    const __m256 top = lerp(pair(strideZ), pair(strideZ + strideY), yFactor);
+    _mm256_storeu_ps(out, _mm256_and_ps(lerp(bottom, top, zFactor), cells.inside));
+}
+
+static void sampleTrilinear(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        forEachBlock<8, 1>(xs, ys, zs, count, out,
+            [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinear8<decltype(type)>(volume, x, y, z, result); });
+    });
+}
+
+static __m256i lerpFixed(__m256i a, __m256i b, __m256i w)
+{
+    return _mm256_add_epi32(_mm256_slli_epi32(a, 8), _mm256_mullo_epi32(_mm256_sub_epi32(b, a), w));
+}
+
+static __m256i roundFixed(__m256i value)
+{
+    return _mm256_srai_epi32(_mm256_add_epi32(value, _mm256_set1_epi32(128)), 8);
+}
+
+// Same as sampleTrilinear8 with integer arithmetic (see kernels_x86.h). The gathered corner pairs are blended along x
+// by a single madd, without unpacking them.
+template <typename T>
+static void sampleTrilinearFixed8(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m256 x = _mm256_loadu_ps(xs), y = _mm256_loadu_ps(ys), z = _mm256_loadu_ps(zs);
+    const Cells8 cells = findCells(volume, x, y, z);
+    if (_mm256_movemask_ps(cells.inside) == 0) {
+        _mm256_storeu_ps(out, _mm256_setzero_ps());
+        return;
+    }
+
+    const __m256 scale = _mm256_set1_ps(fixedPointWeightScale);
+    const __m256i xWeight = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(x, _mm256_cvtepi32_ps(cells.x0)), scale));
+    const __m256i xWeights = _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(256), xWeight), _mm256_slli_epi32(xWeight, 16));
+    const __m256i yWeight = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(y, _mm256_cvtepi32_ps(cells.y0)), scale));
+    const __m256i zWeight = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(z, _mm256_cvtepi32_ps(cells.z0)), scale));
+    const auto pair = [&](int offset) { return _mm256_madd_epi16(gatherWordPairs<T>(volume, cells, offset), xWeights); };
+    const int strideY = volume.dims[0], strideZ = volume.dims[0] * volume.dims[1];
+    const __m256i bottom = roundFixed(lerpFixed(pair(0), pair(strideY), yWeight));
+    const __m256i top = roundFixed(lerpFixed(pair(strideZ), pair(strideZ + strideY), yWeight));
+    const __m256 result = _mm256_mul_ps(_mm256_cvtepi32_ps(lerpFixed(bottom, top, zWeight)), _mm256_set1_ps(fixedPointResultScale));
+    _mm256_storeu_ps(out, _mm256_and_ps(result, cells.inside));
+}
+
+static void sampleTrilinearFixed(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        using T = decltype(type);
+        if constexpr (std::is_same_v<T, float>) {
+            sampleTrilinear(volume, xs, ys, zs, count, out);
+        } else {
+            forEachBlock<8, 1>(xs, ys, zs, count, out,
+                [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinearFixed8<T>(volume, x, y, z, result); });
+        }
+    });
+}
+
+// Two gradients per iteration, one in each 128-bit half.
+static void sampleGradients2(const GradientView& gradients, const float* xs, const float* ys, const float* zs, float* out)
+{
+    __m128 lowerCorners[8], lowerFactors[3], upperCorners[8], upperFactors[3];
+    loadGradientCell(gradients, xs[0], ys[0], zs[0], lowerCorners, lowerFactors);
+    loadGradientCell(gradients, xs[1], ys[1], zs[1], upperCorners, upperFactors);
+    __m256 c[8], factors[3];
+    for (int i = 0; i < 8; i++)
+        c[i] = combine(lowerCorners[i], upperCorners[i]);
+    for (int i = 0; i < 3; i++)
+        factors[i] = combine(lowerFactors[i], upperFactors[i]);
+
+    const __m256 bottom = lerp(lerp(c[0], c[1], factors[0]), lerp(c[2], c[3], factors[0]), factors[1]);
+    const __m256 top = lerp(lerp(c[4], c[5], factors[0]), lerp(c[6], c[7], factors[0]), factors[1]);
+    _mm256_storeu_ps(out, lerp(bottom, top, factors[2]));
+}
+
+static void sampleGradients(const GradientView& gradients, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    forEachBlock<2, 4>(xs, ys, zs, count, out,
+        [&](const float* x, const float* y, const float* z, float* result) { sampleGradients2(gradients, x, y, z, result); });
+}
+
+static void lookupTransferFunction8(const TransferFunctionView& tf, const float* values, float* out)
+{
+    const __m256 range01 = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(values), _mm256_set1_ps(tf.indexStart)), _mm256_set1_ps(tf.indexRange));
+    // Negative indices become large unsigned values and are clamped to the last entry, like the conversion to size_t
+    // in Renderer::getTFValue.
+    const __m256i index = _mm256_min_epu32(_mm256_cvttps_epi32(_mm256_mul_ps(range01, _mm256_set1_ps(float(tf.size)))), _mm256_set1_epi32(tf.size - 1));
+    alignas(32) int indices[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(indices), index);
+    for (int lane = 0; lane < 8; lane++)
+        _mm_storeu_ps(out + 4 * lane, _mm_loadu_ps(tf.colors + 4 * size_t(indices[lane])));
+}
+
+static void lookupTransferFunction(const TransferFunctionView& tf, const float* values, int count, float* out)
+{
+    forEachBlock<8, 4>(values, count, out, [&](const float* v, float* result) { lookupTransferFunction8(tf, v, result); });
+}
+
+static int composite(const float* rgba, int count, float* color, float* opacity)
+{
+    return compositeFrontToBack(rgba, count, color, opacity);
+}
+
+static float maximum(const float* values, int count, float initial)
+{
+    __m256 result = _mm256_set1_ps(initial);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        result = _mm256_max_ps(_mm256_loadu_ps(values + i), result);
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, result);
+    return maximumOf(lanes, 8, values + i, count - i, initial);
+}
+
+// Same as shadeSurfaces4 in kernels_sse42.cpp with 8 pixels per iteration.
+static void shadeSurfaces8(const SurfaceView& surfaces, const PhongView& phong, float* out)
+{
+    __m256 gradient[3], view[3], light[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const __m256 position = _mm256_loadu_ps(surfaces.position[axis]);
+        gradient[axis] = _mm256_loadu_ps(surfaces.gradient[axis]);
+        view[axis] = _mm256_sub_ps(_mm256_set1_ps(phong.eye[axis]), position);
+        light[axis] = _mm256_sub_ps(position, _mm256_set1_ps(phong.light[axis]));
+    }
+    normalize3(view);
+    normalize3(light);
+
+    const __m256 projection = dot3(gradient, light);
+    const __m256 cosTheta = _mm256_div_ps(projection, _mm256_sqrt_ps(dot3(gradient, gradient)));
+    const __m256 diffuseMask = _mm256_cmp_ps(cosTheta, cosTheta, _CMP_ORD_Q);
+
+    __m256 reflection[3];
+    for (int axis = 0; axis < 3; axis++)
+        reflection[axis] = _mm256_sub_ps(light[axis], _mm256_mul_ps(_mm256_mul_ps(gradient[axis], projection), _mm256_set1_ps(2.0f)));
+    const __m256 cosPhi = _mm256_div_ps(dot3(reflection, view), _mm256_sqrt_ps(dot3(reflection, reflection)));
+    const __m256 specular = _mm256_mul_ps(_mm256_set1_ps(phong.specular), power100(absolute(cosPhi)));
+
+    const __m256i hits = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(surfaces.hit)));
+    const __m256 hit = _mm256_castsi256_ps(_mm256_cmpeq_epi32(hits, _mm256_set1_epi32(int(SurfaceHit::HitSurface))));
+    const __m256 insideVolume = _mm256_castsi256_ps(_mm256_cmpgt_epi32(hits, _mm256_set1_epi32(int(SurfaceHit::MissedVolume))));
+    __m256 rgb[3];
+    for (int channel = 0; channel < 3; channel++) {
+        const __m256 ambient = _mm256_set1_ps(phong.ambient * phong.color[channel]);
+        const __m256 diffuse = _mm256_and_ps(_mm256_mul_ps(_mm256_set1_ps(phong.diffuse * phong.color[channel]), absolute(cosTheta)), diffuseMask);
+        rgb[channel] = _mm256_and_ps(_mm256_add_ps(_mm256_add_ps(ambient, diffuse), specular), hit);
+    }
+
+    // Transpose to RGBA: pixels (i, i + 4) end up in the two halves of pixels[i].
+    const __m256 alpha = _mm256_and_ps(_mm256_set1_ps(1.0f), insideVolume);
+    const __m256 rg0145 = _mm256_unpacklo_ps(rgb[0], rgb[1]), rg2367 = _mm256_unpackhi_ps(rgb[0], rgb[1]);
+    const __m256 ba0145 = _mm256_unpacklo_ps(rgb[2], alpha), ba2367 = _mm256_unpackhi_ps(rgb[2], alpha);
+    const __m256 pixels[4] {
+        _mm256_shuffle_ps(rg0145, ba0145, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(rg0145, ba0145, _MM_SHUFFLE(3, 2, 3, 2)),
+        _mm256_shuffle_ps(rg2367, ba2367, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(rg2367, ba2367, _MM_SHUFFLE(3, 2, 3, 2))
+    };
+    _mm256_storeu_ps(out, _mm256_permute2f128_ps(pixels[0], pixels[1], 0x20));
+    _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(pixels[2], pixels[3], 0x20));
+    _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(pixels[0], pixels[1], 0x31));
+    _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(pixels[2], pixels[3], 0x31));
+}
+
+static void shadeSurfaces(const SurfaceView& surfaces, const PhongView& phong, int count, float* out)
+{
+    forEachSurfaceBlock<8>(surfaces, count, out, [&](const SurfaceView& block, float* result) { shadeSurfaces8(block, phong, result); });
+}
+
+const KernelTable avx2Kernels { SimdLevel::AVX2, sampleTrilinear, sampleTrilinearFixed, sampleGradients, lookupTransferFunction, composite, maximum, shadeSurfaces };
+
+}
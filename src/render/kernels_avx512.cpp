@@ -0,0 +1,303 @@
+// AVX-512 kernels, compiled with -mavx512f -ffp-contract=off (see render/kernels.h).
+#if defined(__GNUC__) && !defined(__clang__)
+// The AVX-512 intrinsics of GCC 12 trigger false positives in their own headers (GCC bug 105593).
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include "kernels_x86.h"
+
+namespace render::kernels {
+
+static __m512 lerp(__m512 a, __m512 b, __m512 t)
+{
+    return _mm512_add_ps(a, _mm512_mul_ps(t, _mm512_sub_ps(b, a)));
+}
+
+static __m512 combine(__m128 a, __m128 b, __m128 c, __m128 d)
+{
+    __m512 result = _mm512_castps128_ps512(a);
+    result = _mm512_insertf32x4(result, b, 1);
+    result = _mm512_insertf32x4(result, c, 2);
+    return _mm512_insertf32x4(result, d, 3);
+}
+
+static __m512 dot3(const __m512 (&a)[3], const __m512 (&b)[3])
+{
+    return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(a[0], b[0]), _mm512_mul_ps(a[1], b[1])), _mm512_mul_ps(a[2], b[2]));
+}
+
+static void normalize3(__m512 (&v)[3])
+{
+    const __m512 inverseLength = _mm512_div_ps(_mm512_set1_ps(1.0f), _mm512_sqrt_ps(dot3(v, v)));
+    for (__m512& component : v)
+        component = _mm512_mul_ps(component, inverseLength);
+}
+
+static __m512 power100(__m512 x)
+{
+    const __m512 cutoff = _mm512_set1_ps(minSpecularCosine);
+    const __m512 x1 = _mm512_max_ps(x, cutoff);
+    const __m512 x2 = _mm512_mul_ps(x1, x1), x4 = _mm512_mul_ps(x2, x2), x8 = _mm512_mul_ps(x4, x4);
+    const __m512 x16 = _mm512_mul_ps(x8, x8), x32 = _mm512_mul_ps(x16, x16), x64 = _mm512_mul_ps(x32, x32);
+    return _mm512_maskz_mul_ps(_mm512_cmp_ps_mask(x, cutoff, _CMP_GE_OQ), _mm512_mul_ps(x64, x32), x4);
+}
+
+// The cells (x0, y0, z0) of 16 samples, their indices and which of them lie inside of the volume.
+struct Cells16 {
+    __mmask16 inside;
+    __m512i x0, y0, z0, index;
+};
+
+static Cells16 findCells(const VolumeView& volume, __m512 x, __m512 y, __m512 z)
+{
+    Cells16 cells;
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+    __mmask16 inside = _mm512_cmp_ps_mask(x, zero, _CMP_GE_OQ);
+    inside = _mm512_mask_cmp_ps_mask(inside, y, zero, _CMP_GE_OQ);
+    inside = _mm512_mask_cmp_ps_mask(inside, z, zero, _CMP_GE_OQ);
+    inside = _mm512_mask_cmp_ps_mask(inside, _mm512_add_ps(x, one), _mm512_set1_ps(float(volume.dims[0])), _CMP_LT_OQ);
+    inside = _mm512_mask_cmp_ps_mask(inside, _mm512_add_ps(y, one), _mm512_set1_ps(float(volume.dims[1])), _CMP_LT_OQ);
+    cells.inside = _mm512_mask_cmp_ps_mask(inside, _mm512_add_ps(z, one), _mm512_set1_ps(float(volume.dims[2])), _CMP_LT_OQ);
+
+    cells.x0 = _mm512_cvttps_epi32(x);
+    cells.y0 = _mm512_cvttps_epi32(y);
+    cells.z0 = _mm512_cvttps_epi32(z);
+    cells.index = _mm512_add_epi32(cells.x0,
+        _mm512_mullo_epi32(_mm512_set1_epi32(volume.dims[0]), _mm512_add_epi32(cells.y0, _mm512_mullo_epi32(_mm512_set1_epi32(volume.dims[1]), cells.z0))));
+    return cells;
+}
+
+// Corner pairs (x0, x0 + 1) of the row at offset from the cell origins of integer voxels, as 32-bit integers (see
+// gatherWordPairs in kernels_avx2.cpp). Lanes outside of the volume are not fetched and stay 0.
+template <typename T>
+static void gatherIntegerPairs(const VolumeView& volume, const Cells16& cells, int offset, __m512i& lower, __m512i& upper)
+{
+    __m512i pairs = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), cells.inside, _mm512_add_epi32(cells.index, _mm512_set1_epi32(offset)), volume.data, int(sizeof(T)));
+    if constexpr (sizeof(T) == 1)
+        pairs = _mm512_or_si512(_mm512_and_si512(pairs, _mm512_set1_epi32(0xFF)), _mm512_slli_epi32(_mm512_and_si512(pairs, _mm512_set1_epi32(0xFF00)), 8));
+    if constexpr (std::is_signed_v<T>) {
+        lower = _mm512_srai_epi32(_mm512_slli_epi32(pairs, 16), 16);
+        upper = _mm512_srai_epi32(pairs, 16);
+    } else {
+        lower = _mm512_and_si512(pairs, _mm512_set1_epi32(0xFFFF));
+        upper = _mm512_srli_epi32(pairs, 16);
+    }
+}
+
+// The corners (x0, x0 + 1) of the row at offset from the cell origins as floats.
+template <typename T>
+static void gatherCorners(const VolumeView& volume, const Cells16& cells, int offset, __m512& lower, __m512& upper)
+{
+    if constexpr (std::is_same_v<T, float>) {
+        const float* data = static_cast<const float*>(volume.data);
+        const __m512i index = _mm512_add_epi32(cells.index, _mm512_set1_epi32(offset));
+        lower = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), cells.inside, index, data, 4);
+        upper = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), cells.inside, index, data + 1, 4);
+    } else {
+        __m512i lowerInt, upperInt;
+        gatherIntegerPairs<T>(volume, cells, offset, lowerInt, upperInt);
+        lower = _mm512_cvtepi32_ps(lowerInt);
+        upper = _mm512_cvtepi32_ps(upperInt);
+    }
+}
+
+// 16 samples per iteration with masked 32-bit gathers of the corner pairs.
+template <typename T>
+static void sampleTrilinear16(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m512 x = _mm512_loadu_ps(xs), y = _mm512_loadu_ps(ys), z = _mm512_loadu_ps(zs);
+    const Cells16 cells = findCells(volume, x, y, z);
+    if (cells.inside == 0) {
+        _mm512_storeu_ps(out, _mm512_setzero_ps());
+        return;
+    }
+
+    const __m512 xFactor = _mm512_sub_ps(x, _mm512_cvtepi32_ps(cells.x0));
+    const __m512 yFactor = _mm512_sub_ps(y, _mm512_cvtepi32_ps(cells.y0));
+    const __m512 zFactor = _mm512_sub_ps(z, _mm512_cvtepi32_ps(cells.z0));
+    const auto pair = [&](int offset) {
+        __m512 lower, upper;
+        gatherCorners<T>(volume, cells, offset, lower, upper);
+        return lerp(lower, upper, xFactor);
+    };
+    const int strideY = volume.dims[0], strideZ = volume.dims[0] * volume.dims[1];
+    const __m512 bottom = lerp(pair(0), pair(strideY), yFactor);
+    const __m512 top = lerp(pair(strideZ), pair(strideZ + strideY), yFactor);
+    _mm512_storeu_ps(out, _mm512_maskz_mov_ps(cells.inside, lerp(bottom, top, zFactor)));
+}
+
+static void sampleTrilinear(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        forEachBlock<16, 1>(xs, ys, zs, count, out,
+            [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinear16<decltype(type)>(volume, x, y, z, result); });
+    });
+}
+
+static __m512i lerpFixed(__m512i a, __m512i b, __m512i w)
+{
+    return _mm512_add_epi32(_mm512_slli_epi32(a, 8), _mm512_mullo_epi32(_mm512_sub_epi32(b, a), w));
+}
+
+static __m512i roundFixed(__m512i value)
+{
+    return _mm512_srai_epi32(_mm512_add_epi32(value, _mm512_set1_epi32(128)), 8);
+}
+
+// Same as sampleTrilinear16 with integer arithmetic (see kernels_x86.h). The 16-bit madd needs AVX-512BW, so the
+// corner pairs are unpacked and blended along x with lerpFixed, which gives the same result.
+template <typename T>
+static void sampleTrilinearFixed16(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m512 x = _mm512_loadu_ps(xs), y = _mm512_loadu_ps(ys), z = _mm512_loadu_ps(zs);
+    const Cells16 cells = findCells(volume, x, y, z);
+    if (cells.inside == 0) {
+        _mm512_storeu_ps(out, _mm512_setzero_ps());
+        return;
+    }
+
+    const __m512 scale = _mm512_set1_ps(fixedPointWeightScale);
+    const __m512i xWeight = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_sub_ps(x, _mm512_cvtepi32_ps(cells.x0)), scale));
+    const __m512i yWeight = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_sub_ps(y, _mm512_cvtepi32_ps(cells.y0)), scale));
+    const __m512i zWeight = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_sub_ps(z, _mm512_cvtepi32_ps(cells.z0)), scale));
+    const auto pair = [&](int offset) {
+        __m512i lower, upper;
+        gatherIntegerPairs<T>(volume, cells, offset, lower, upper);
+        return lerpFixed(lower, upper, xWeight);
+    };
+    const int strideY = volume.dims[0], strideZ = volume.dims[0] * volume.dims[1];
+    const __m512i bottom = roundFixed(lerpFixed(pair(0), pair(strideY), yWeight));
+    const __m512i top = roundFixed(lerpFixed(pair(strideZ), pair(strideZ + strideY), yWeight));
+    const __m512 result = _mm512_mul_ps(_mm512_cvtepi32_ps(lerpFixed(bottom, top, zWeight)), _mm512_set1_ps(fixedPointResultScale));
+    _mm512_storeu_ps(out, _mm512_maskz_mov_ps(cells.inside, result));
+}
+
+static void sampleTrilinearFixed(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        using T = decltype(type);
+        if constexpr (std::is_same_v<T, float>) {
+            sampleTrilinear(volume, xs, ys, zs, count, out);
+        } else {
+            forEachBlock<16, 1>(xs, ys, zs, count, out,
+                [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinearFixed16<T>(volume, x, y, z, result); });
+        }
+    });
+}
+
+// Four gradients per iteration, one in each 128-bit lane.
+static void sampleGradients4(const GradientView& gradients, const float* xs, const float* ys, const float* zs, float* out)
+{
+    __m128 corners[4][8], factors[4][3];
+    for (int sample = 0; sample < 4; sample++)
+        loadGradientCell(gradients, xs[sample], ys[sample], zs[sample], corners[sample], factors[sample]);
+    __m512 c[8], f[3];
+    for (int i = 0; i < 8; i++)
+        c[i] = combine(corners[0][i], corners[1][i], corners[2][i], corners[3][i]);
+    for (int i = 0; i < 3; i++)
+        f[i] = combine(factors[0][i], factors[1][i], factors[2][i], factors[3][i]);
+
+    const __m512 bottom = lerp(lerp(c[0], c[1], f[0]), lerp(c[2], c[3], f[0]), f[1]);
+    const __m512 top = lerp(lerp(c[4], c[5], f[0]), lerp(c[6], c[7], f[0]), f[1]);
+    _mm512_storeu_ps(out, lerp(bottom, top, f[2]));
+}
+
+static void sampleGradients(const GradientView& gradients, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    forEachBlock<4, 4>(xs, ys, zs, count, out,
+        [&](const float* x, const float* y, const float* z, float* result) { sampleGradients4(gradients, x, y, z, result); });
+}
+
+static void lookupTransferFunction16(const TransferFunctionView& tf, const float* values, float* out)
+{
+    const __m512 range01 = _mm512_div_ps(_mm512_sub_ps(_mm512_loadu_ps(values), _mm512_set1_ps(tf.indexStart)), _mm512_set1_ps(tf.indexRange));
+    // Negative indices become large unsigned values and are clamped to the last entry, like the conversion to size_t
+    // in Renderer::getTFValue.
+    const __m512i index = _mm512_min_epu32(_mm512_cvttps_epi32(_mm512_mul_ps(range01, _mm512_set1_ps(float(tf.size)))), _mm512_set1_epi32(tf.size - 1));
+    alignas(64) int indices[16];
+    _mm512_store_si512(indices, index);
+    for (int lane = 0; lane < 16; lane++)
+        _mm_storeu_ps(out + 4 * lane, _mm_loadu_ps(tf.colors + 4 * size_t(indices[lane])));
+}
+
+static void lookupTransferFunction(const TransferFunctionView& tf, const float* values, int count, float* out)
+{
+    forEachBlock<16, 4>(values, count, out, [&](const float* v, float* result) { lookupTransferFunction16(tf, v, result); });
+}
+
+static int composite(const float* rgba, int count, float* color, float* opacity)
+{
+    return compositeFrontToBack(rgba, count, color, opacity);
+}
+
+static float maximum(const float* values, int count, float initial)
+{
+    __m512 result = _mm512_set1_ps(initial);
+    int i = 0;
+    for (; i + 16 <= count; i += 16)
+        result = _mm512_max_ps(_mm512_loadu_ps(values + i), result);
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, result);
+    return maximumOf(lanes, 16, values + i, count - i, initial);
+}
+
+// Same as shadeSurfaces4 in kernels_sse42.cpp with 16 pixels per iteration.
+static void shadeSurfaces16(const SurfaceView& surfaces, const PhongView& phong, float* out)
+{
+    __m512 gradient[3], view[3], light[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const __m512 position = _mm512_loadu_ps(surfaces.position[axis]);
+        gradient[axis] = _mm512_loadu_ps(surfaces.gradient[axis]);
+        view[axis] = _mm512_sub_ps(_mm512_set1_ps(phong.eye[axis]), position);
+        light[axis] = _mm512_sub_ps(position, _mm512_set1_ps(phong.light[axis]));
+    }
+    normalize3(view);
+    normalize3(light);
+
+    const __m512 projection = dot3(gradient, light);
+    const __m512 cosTheta = _mm512_div_ps(projection, _mm512_sqrt_ps(dot3(gradient, gradient)));
+    const __mmask16 diffuseMask = _mm512_cmp_ps_mask(cosTheta, cosTheta, _CMP_ORD_Q);
+
+    __m512 reflection[3];
+    for (int axis = 0; axis < 3; axis++)
+        reflection[axis] = _mm512_sub_ps(light[axis], _mm512_mul_ps(_mm512_mul_ps(gradient[axis], projection), _mm512_set1_ps(2.0f)));
+    const __m512 cosPhi = _mm512_div_ps(dot3(reflection, view), _mm512_sqrt_ps(dot3(reflection, reflection)));
+    const __m512 specular = _mm512_mul_ps(_mm512_set1_ps(phong.specular), power100(_mm512_abs_ps(cosPhi)));
+
+    const __m512i hits = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(surfaces.hit)));
+    const __mmask16 hit = _mm512_cmpeq_epi32_mask(hits, _mm512_set1_epi32(int(SurfaceHit::HitSurface)));
+    const __mmask16 insideVolume = _mm512_cmpgt_epi32_mask(hits, _mm512_set1_epi32(int(SurfaceHit::MissedVolume)));
+    __m512 rgb[3];
+    for (int channel = 0; channel < 3; channel++) {
+        const __m512 ambient = _mm512_set1_ps(phong.ambient * phong.color[channel]);
+        const __m512 diffuse = _mm512_maskz_mul_ps(diffuseMask, _mm512_set1_ps(phong.diffuse * phong.color[channel]), _mm512_abs_ps(cosTheta));
+        rgb[channel] = _mm512_maskz_add_ps(hit, _mm512_add_ps(ambient, diffuse), specular);
+    }
+
+    // Transpose to RGBA: the 128-bit lanes of pixels[i] hold the pixels (i, i + 4, i + 8, i + 12), which are then
+    // regrouped into 4 consecutive pixels per register.
+    const __m512 alpha = _mm512_maskz_mov_ps(insideVolume, _mm512_set1_ps(1.0f));
+    const __m512 rgLow = _mm512_unpacklo_ps(rgb[0], rgb[1]), rgHigh = _mm512_unpackhi_ps(rgb[0], rgb[1]);
+    const __m512 baLow = _mm512_unpacklo_ps(rgb[2], alpha), baHigh = _mm512_unpackhi_ps(rgb[2], alpha);
+    const __m512 pixels[4] {
+        _mm512_shuffle_ps(rgLow, baLow, _MM_SHUFFLE(1, 0, 1, 0)), _mm512_shuffle_ps(rgLow, baLow, _MM_SHUFFLE(3, 2, 3, 2)),
+        _mm512_shuffle_ps(rgHigh, baHigh, _MM_SHUFFLE(1, 0, 1, 0)), _mm512_shuffle_ps(rgHigh, baHigh, _MM_SHUFFLE(3, 2, 3, 2))
+    };
+    const __m512 lower01 = _mm512_shuffle_f32x4(pixels[0], pixels[1], _MM_SHUFFLE(1, 0, 1, 0));
+    const __m512 lower23 = _mm512_shuffle_f32x4(pixels[2], pixels[3], _MM_SHUFFLE(1, 0, 1, 0));
+    const __m512 upper01 = _mm512_shuffle_f32x4(pixels[0], pixels[1], _MM_SHUFFLE(3, 2, 3, 2));
+    const __m512 upper23 = _mm512_shuffle_f32x4(pixels[2], pixels[3], _MM_SHUFFLE(3, 2, 3, 2));
+    _mm512_storeu_ps(out, _mm512_shuffle_f32x4(lower01, lower23, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm512_storeu_ps(out + 16, _mm512_shuffle_f32x4(lower01, lower23, _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm512_storeu_ps(out + 32, _mm512_shuffle_f32x4(upper01, upper23, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm512_storeu_ps(out + 48, _mm512_shuffle_f32x4(upper01, upper23, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+static void shadeSurfaces(const SurfaceView& surfaces, const PhongView& phong, int count, float* out)
+{
+    forEachSurfaceBlock<16>(surfaces, count, out, [&](const SurfaceView& block, float* result) { shadeSurfaces16(block, phong, result); });
+}
+
+const KernelTable avx512Kernels { SimdLevel::AVX512, sampleTrilinear, sampleTrilinearFixed, sampleGradients, lookupTransferFunction, composite, maximum, shadeSurfaces };
+
+}
@@ -0,0 +1,219 @@
+// SSE4.2 kernels, compiled with -msse4.2 -ffp-contract=off (see render/kernels.h).
+#include "kernels_x86.h"
+
+namespace render::kernels {
+
+// The cells (x0, y0, z0) of 4 samples, their indices and which of them lie inside of the volume.
+struct Cells4 {
+    __m128 inside;
+    int mask;
+    __m128i x0, y0, z0;
+    alignas(16) int indices[4];
+};
+
+static Cells4 findCells(const VolumeView& volume, __m128 x, __m128 y, __m128 z)
+{
+    Cells4 cells;
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmpge_ps(y, zero)), _mm_cmpge_ps(z, zero));
+    inside = _mm_and_ps(inside, _mm_cmplt_ps(_mm_add_ps(x, one), _mm_set1_ps(float(volume.dims[0]))));
+    inside = _mm_and_ps(inside, _mm_cmplt_ps(_mm_add_ps(y, one), _mm_set1_ps(float(volume.dims[1]))));
+    cells.inside = _mm_and_ps(inside, _mm_cmplt_ps(_mm_add_ps(z, one), _mm_set1_ps(float(volume.dims[2]))));
+    cells.mask = _mm_movemask_ps(cells.inside);
+
+    cells.x0 = _mm_cvttps_epi32(x);
+    cells.y0 = _mm_cvttps_epi32(y);
+    cells.z0 = _mm_cvttps_epi32(z);
+    const __m128i index = _mm_add_epi32(cells.x0,
+        _mm_mullo_epi32(_mm_set1_epi32(volume.dims[0]), _mm_add_epi32(cells.y0, _mm_mullo_epi32(_mm_set1_epi32(volume.dims[1]), cells.z0))));
+    _mm_store_si128(reinterpret_cast<__m128i*>(cells.indices), index);
+    return cells;
+}
+
+// 4 samples per iteration. SSE has no gathers, so the index computation and the interpolation are vectorized and the
+// corner pairs are loaded one lane at a time.
+template <typename T>
+static void sampleTrilinear4(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m128 x = _mm_loadu_ps(xs), y = _mm_loadu_ps(ys), z = _mm_loadu_ps(zs);
+    const Cells4 cells = findCells(volume, x, y, z);
+    if (cells.mask == 0) {
+        _mm_storeu_ps(out, _mm_setzero_ps());
+        return;
+    }
+
+    // Corner pairs (x0, x0 + 1) of the rows (y0 z0, y1 z0, y0 z1, y1 z1); lanes outside of the volume stay 0.
+    const size_t strideY = size_t(volume.dims[0]), strideZ = strideY * size_t(volume.dims[1]);
+    const size_t rowOffsets[4] { 0, strideY, strideZ, strideZ + strideY };
+    alignas(16) float corners[8][4] {};
+    for (int lane = 0; lane < 4; lane++) {
+        if ((cells.mask & (1 << lane)) == 0)
+            continue;
+        const T* voxel = static_cast<const T*>(volume.data) + size_t(cells.indices[lane]);
+        for (int row = 0; row < 4; row++) {
+            corners[2 * row][lane] = float(voxel[rowOffsets[row]]);
+            corners[2 * row + 1][lane] = float(voxel[rowOffsets[row] + 1]);
+        }
+    }
+
+    const __m128 xFactor = _mm_sub_ps(x, _mm_cvtepi32_ps(cells.x0));
+    const __m128 yFactor = _mm_sub_ps(y, _mm_cvtepi32_ps(cells.y0));
+    const __m128 zFactor = _mm_sub_ps(z, _mm_cvtepi32_ps(cells.z0));
+    const auto pair = [&](int row) { return lerp(_mm_load_ps(corners[2 * row]), _mm_load_ps(corners[2 * row + 1]), xFactor); };
+    const __m128 bottom = lerp(pair(0), pair(1), yFactor);
+    const __m128 top = lerp(pair(2), pair(3), yFactor);
+    _mm_storeu_ps(out, _mm_and_ps(lerp(bottom, top, zFactor), cells.inside));
+}
+
+static void sampleTrilinear(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        forEachBlock<4, 1>(xs, ys, zs, count, out,
+            [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinear4<decltype(type)>(volume, x, y, z, result); });
+    });
+}
+
+// Same as sampleTrilinear4 with integer arithmetic (see kernels_x86.h). A corner pair is packed into one 32-bit lane
+// and blended along x by a single madd.
+template <typename T>
+static void sampleTrilinearFixed4(const VolumeView& volume, const float* xs, const float* ys, const float* zs, float* out)
+{
+    const __m128 x = _mm_loadu_ps(xs), y = _mm_loadu_ps(ys), z = _mm_loadu_ps(zs);
+    const Cells4 cells = findCells(volume, x, y, z);
+    if (cells.mask == 0) {
+        _mm_storeu_ps(out, _mm_setzero_ps());
+        return;
+    }
+
+    const size_t strideY = size_t(volume.dims[0]), strideZ = strideY * size_t(volume.dims[1]);
+    const size_t rowOffsets[4] { 0, strideY, strideZ, strideZ + strideY };
+    alignas(16) int pairs[4][4] {};
+    for (int lane = 0; lane < 4; lane++) {
+        if ((cells.mask & (1 << lane)) == 0)
+            continue;
+        const T* voxel = static_cast<const T*>(volume.data) + size_t(cells.indices[lane]);
+        for (int row = 0; row < 4; row++)
+            pairs[row][lane] = packPair(voxel[rowOffsets[row]], voxel[rowOffsets[row] + 1]);
+    }
+
+    const __m128 scale = _mm_set1_ps(fixedPointWeightScale);
+    const __m128i xWeights = pairWeights(_mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(cells.x0)), scale)));
+    const __m128i yWeight = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(y, _mm_cvtepi32_ps(cells.y0)), scale));
+    const __m128i zWeight = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(z, _mm_cvtepi32_ps(cells.z0)), scale));
+    const auto pair = [&](int row) { return _mm_madd_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(pairs[row])), xWeights); };
+    const __m128i bottom = roundFixed(lerpFixed(pair(0), pair(1), yWeight));
+    const __m128i top = roundFixed(lerpFixed(pair(2), pair(3), yWeight));
+    const __m128 result = _mm_mul_ps(_mm_cvtepi32_ps(lerpFixed(bottom, top, zWeight)), _mm_set1_ps(fixedPointResultScale));
+    _mm_storeu_ps(out, _mm_and_ps(result, cells.inside));
+}
+
+static void sampleTrilinearFixed(const VolumeView& volume, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    volume::withVoxelType(volume.type, [&](auto type) {
+        using T = decltype(type);
+        if constexpr (std::is_same_v<T, float>) {
+            sampleTrilinear(volume, xs, ys, zs, count, out);
+        } else {
+            forEachBlock<4, 1>(xs, ys, zs, count, out,
+                [&](const float* x, const float* y, const float* z, float* result) { sampleTrilinearFixed4<T>(volume, x, y, z, result); });
+        }
+    });
+}
+
+// One gradient (4 lanes) per iteration.
+static void sampleGradient1(const GradientView& gradients, const float* xs, const float* ys, const float* zs, float* out)
+{
+    __m128 c[8], factors[3];
+    loadGradientCell(gradients, xs[0], ys[0], zs[0], c, factors);
+    const __m128 bottom = lerp(lerp(c[0], c[1], factors[0]), lerp(c[2], c[3], factors[0]), factors[1]);
+    const __m128 top = lerp(lerp(c[4], c[5], factors[0]), lerp(c[6], c[7], factors[0]), factors[1]);
+    _mm_storeu_ps(out, lerp(bottom, top, factors[2]));
+}
+
+static void sampleGradients(const GradientView& gradients, const float* xs, const float* ys, const float* zs, int count, float* out)
+{
+    forEachBlock<1, 4>(xs, ys, zs, count, out,
+        [&](const float* x, const float* y, const float* z, float* result) { sampleGradient1(gradients, x, y, z, result); });
+}
+
+static void lookupTransferFunction4(const TransferFunctionView& tf, const float* values, float* out)
+{
+    const __m128 range01 = _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(values), _mm_set1_ps(tf.indexStart)), _mm_set1_ps(tf.indexRange));
+    // Negative indices become large unsigned values and are clamped to the last entry, like the conversion to size_t
+    // in Renderer::getTFValue.
+    const __m128i index = _mm_min_epu32(_mm_cvttps_epi32(_mm_mul_ps(range01, _mm_set1_ps(float(tf.size)))), _mm_set1_epi32(tf.size - 1));
+    alignas(16) int indices[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+    for (int lane = 0; lane < 4; lane++)
+        _mm_storeu_ps(out + 4 * lane, _mm_loadu_ps(tf.colors + 4 * size_t(indices[lane])));
+}
+
+static void lookupTransferFunction(const TransferFunctionView& tf, const float* values, int count, float* out)
+{
+    forEachBlock<4, 4>(values, count, out, [&](const float* v, float* result) { lookupTransferFunction4(tf, v, result); });
+}
+
+static int composite(const float* rgba, int count, float* color, float* opacity)
+{
+    return compositeFrontToBack(rgba, count, color, opacity);
+}
+
+static float maximum(const float* values, int count, float initial)
+{
+    __m128 result = _mm_set1_ps(initial);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        result = _mm_max_ps(_mm_loadu_ps(values + i), result);
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, result);
+    return maximumOf(lanes, 4, values + i, count - i, initial);
+}
+
+// Phong shading of 4 isosurface hits, with the operations of Renderer::computePhongShading in the same order.
+static void shadeSurfaces4(const SurfaceView& surfaces, const PhongView& phong, float* out)
+{
+    __m128 gradient[3], view[3], light[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const __m128 position = _mm_loadu_ps(surfaces.position[axis]);
+        gradient[axis] = _mm_loadu_ps(surfaces.gradient[axis]);
+        view[axis] = _mm_sub_ps(_mm_set1_ps(phong.eye[axis]), position);
+        light[axis] = _mm_sub_ps(position, _mm_set1_ps(phong.light[axis]));
+    }
+    normalize3(view);
+    normalize3(light);
+
+    // A zero gradient has no direction (0 / 0) and gets no diffuse light.
+    const __m128 projection = dot3(gradient, light);
+    const __m128 cosTheta = _mm_div_ps(projection, _mm_sqrt_ps(dot3(gradient, gradient)));
+    const __m128 diffuseMask = _mm_cmpord_ps(cosTheta, cosTheta);
+
+    // The light vector reflected about the (not normalized) gradient.
+    __m128 reflection[3];
+    for (int axis = 0; axis < 3; axis++)
+        reflection[axis] = _mm_sub_ps(light[axis], _mm_mul_ps(_mm_mul_ps(gradient[axis], projection), _mm_set1_ps(2.0f)));
+    const __m128 cosPhi = _mm_div_ps(dot3(reflection, view), _mm_sqrt_ps(dot3(reflection, reflection)));
+    const __m128 specular = _mm_mul_ps(_mm_set1_ps(phong.specular), power100(absolute(cosPhi)));
+
+    const __m128i hits = _mm_cvtepu8_epi32(_mm_loadu_si32(surfaces.hit));
+    const __m128 hit = _mm_castsi128_ps(_mm_cmpeq_epi32(hits, _mm_set1_epi32(int(SurfaceHit::HitSurface))));
+    const __m128 insideVolume = _mm_castsi128_ps(_mm_cmpgt_epi32(hits, _mm_set1_epi32(int(SurfaceHit::MissedVolume))));
+    __m128 rgba[4];
+    for (int channel = 0; channel < 3; channel++) {
+        const __m128 ambient = _mm_set1_ps(phong.ambient * phong.color[channel]);
+        const __m128 diffuse = _mm_and_ps(_mm_mul_ps(_mm_set1_ps(phong.diffuse * phong.color[channel]), absolute(cosTheta)), diffuseMask);
+        rgba[channel] = _mm_and_ps(_mm_add_ps(_mm_add_ps(ambient, diffuse), specular), hit);
+    }
+    rgba[3] = _mm_and_ps(_mm_set1_ps(1.0f), insideVolume);
+    _MM_TRANSPOSE4_PS(rgba[0], rgba[1], rgba[2], rgba[3]);
+    for (int pixel = 0; pixel < 4; pixel++)
+        _mm_storeu_ps(out + 4 * pixel, rgba[pixel]);
+}
+
+static void shadeSurfaces(const SurfaceView& surfaces, const PhongView& phong, int count, float* out)
+{
+    forEachSurfaceBlock<4>(surfaces, count, out, [&](const SurfaceView& block, float* result) { shadeSurfaces4(block, phong, result); });
+}
+
+const KernelTable sse42Kernels { SimdLevel::SSE42, sampleTrilinear, sampleTrilinearFixed, sampleGradients, lookupTransferFunction, composite, maximum, shadeSurfaces };
+
+}
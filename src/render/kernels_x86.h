@@ -0,0 +1,211 @@
+#pragma once
+#include "kernels.h"
+#include <immintrin.h>
+#include <type_traits>
+
+// Helpers shared by the x86 kernel translation units (kernels_sse42.cpp, kernels_avx2.cpp and kernels_avx512.cpp).
+// Everything in here has internal linkage so that every translation unit gets its own copy, compiled for its own
+// instruction set. Only the SSE4.1 subset is used here; the translation units add wider versions of lerp.
+namespace render::kernels {
+
+static inline __m128 lerp(__m128 a, __m128 b, __m128 t)
+{
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+// Vectors of 3 components with one vector per component, rounded like glm::dot and like v * (1 / length(v)).
+static inline __m128 dot3(const __m128 (&a)[3], const __m128 (&b)[3])
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+}
+
+static inline void normalize3(__m128 (&v)[3])
+{
+    const __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot3(v, v)));
+    for (__m128& component : v)
+        component = _mm_mul_ps(component, inverseLength);
+}
+
+static inline __m128 absolute(__m128 x)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+// x^100 as x^64 * x^32 * x^4, the specular power of Renderer::computePhongShading; 0 below minSpecularCosine and
+// for NaN. Those lanes are clamped before the multiplications so that they cannot produce denormals either.
+static inline __m128 power100(__m128 x)
+{
+    const __m128 cutoff = _mm_set1_ps(minSpecularCosine);
+    const __m128 x1 = _mm_max_ps(x, cutoff);
+    const __m128 x2 = _mm_mul_ps(x1, x1), x4 = _mm_mul_ps(x2, x2), x8 = _mm_mul_ps(x4, x4);
+    const __m128 x16 = _mm_mul_ps(x8, x8), x32 = _mm_mul_ps(x16, x16), x64 = _mm_mul_ps(x32, x32);
+    return _mm_and_ps(_mm_mul_ps(_mm_mul_ps(x64, x32), x4), _mm_cmpge_ps(x, cutoff));
+}
+
+// Fixed-point trilinear interpolation (KernelTable::sampleTrilinearFixed). The weight of the upper neighbour is
+// w = floor(256 * f) for the fractional position f, and two values are blended as a * (256 - w) + b * w:
+//   along x: value * 2^8, at most 23 bits for voxels below 2^15,
+//   along y: value * 2^16, rounded back to value * 2^8,
+//   along z: value * 2^16 in at most 31 bits, converted to float at the end.
+static constexpr float fixedPointWeightScale = 256.0f;
+static constexpr float fixedPointResultScale = 1.0f / 65536.0f;
+
+// Corner pair (lower, upper) as 16-bit words in one lane: the layout of a 32-bit load of two adjacent 16-bit voxels.
+static inline int packPair(int lower, int upper)
+{
+    return int(uint32_t(uint16_t(lower)) | (uint32_t(uint16_t(upper)) << 16));
+}
+
+// (256 - w) in the low and w in the high 16 bits of every lane, to blend a corner pair (x0, x0 + 1) with madd.
+static inline __m128i pairWeights(__m128i w)
+{
+    return _mm_or_si128(_mm_sub_epi32(_mm_set1_epi32(256), w), _mm_slli_epi32(w, 16));
+}
+
+// a * (256 - w) + b * w, computed as a * 256 + (b - a) * w.
+static inline __m128i lerpFixed(__m128i a, __m128i b, __m128i w)
+{
+    return _mm_add_epi32(_mm_slli_epi32(a, 8), _mm_mullo_epi32(_mm_sub_epi32(b, a), w));
+}
+
+static inline __m128i roundFixed(__m128i value)
+{
+    return _mm_srai_epi32(_mm_add_epi32(value, _mm_set1_epi32(128)), 8);
+}
+
+// Run kernel(xs, ys, zs, out) over count samples in blocks of width samples, where out receives outStride floats per
+// sample. The last block is padded with samples at the origin and only its valid results are copied out.
+template <int width, int outStride, typename Kernel>
+static void forEachBlock(const float* xs, const float* ys, const float* zs, int count, float* out, Kernel&& kernel)
+{
+    int i = 0;
+    for (; i + width <= count; i += width)
+        kernel(xs + i, ys + i, zs + i, out + i * outStride);
+    if (i == count)
+        return;
+
+    float x[size_t(width)] {}, y[size_t(width)] {}, z[size_t(width)] {}, result[size_t(width * outStride)];
+    for (int j = 0; i + j < count; j++) {
+        x[j] = xs[i + j];
+        y[j] = ys[i + j];
+        z[j] = zs[i + j];
+    }
+    kernel(x, y, z, result);
+    for (int j = 0; j < (count - i) * outStride; j++)
+        out[i * outStride + j] = result[j];
+}
+
+// Same as forEachBlock for kernels with a single input stream (kernel(values, out)).
+template <int width, int outStride, typename Kernel>
+static void forEachBlock(const float* values, int count, float* out, Kernel&& kernel)
+{
+    int i = 0;
+    for (; i + width <= count; i += width)
+        kernel(values + i, out + i * outStride);
+    if (i == count)
+        return;
+
+    float padded[size_t(width)] {}, result[size_t(width * outStride)];
+    for (int j = 0; i + j < count; j++)
+        padded[j] = values[i + j];
+    kernel(padded, result);
+    for (int j = 0; j < (count - i) * outStride; j++)
+        out[i * outStride + j] = result[j];
+}
+
+// Run kernel(surfaces, out) over count pixels in blocks of width pixels, where out receives RGBA per pixel. The last
+// block is padded with pixels that missed the volume and only its valid results are copied out.
+template <int width, typename Kernel>
+static void forEachSurfaceBlock(const SurfaceView& surfaces, int count, float* out, Kernel&& kernel)
+{
+    const auto offset = [&](int i) {
+        return SurfaceView {
+            surfaces.hit + i,
+            { surfaces.position[0] + i, surfaces.position[1] + i, surfaces.position[2] + i },
+            { surfaces.gradient[0] + i, surfaces.gradient[1] + i, surfaces.gradient[2] + i }
+        };
+    };
+    int i = 0;
+    for (; i + width <= count; i += width)
+        kernel(offset(i), out + 4 * i);
+    if (i == count)
+        return;
+
+    SurfaceHit hit[size_t(width)] {};
+    float position[3][size_t(width)] {}, gradient[3][size_t(width)] {}, result[size_t(4 * width)];
+    for (int j = 0; i + j < count; j++) {
+        hit[j] = surfaces.hit[i + j];
+        for (int axis = 0; axis < 3; axis++) {
+            position[axis][j] = surfaces.position[axis][i + j];
+            gradient[axis][j] = surfaces.gradient[axis][i + j];
+        }
+    }
+    kernel(SurfaceView { hit, { position[0], position[1], position[2] }, { gradient[0], gradient[1], gradient[2] } }, result);
+    for (int j = 0; j < (count - i) * 4; j++)
+        out[i * 4 + j] = result[j];
+}
+
+// The 8 gradients around (x, y, z), in the order x + 2y + 4z, and the interpolation factors along x, y and z
+// (broadcast to all lanes). Outside of the volume everything is 0, which interpolates to a zero gradient exactly like
+// GradientVolume::getGradientLinearInterpolate.
+static inline void loadGradientCell(const GradientView& gradients, float x, float y, float z, __m128 (&corners)[8], __m128 (&factors)[3])
+{
+    const bool inside = (x >= 0.0f) & (y >= 0.0f) & (z >= 0.0f)
+        & (x + 1.0f < float(gradients.dims[0])) & (y + 1.0f < float(gradients.dims[1])) & (z + 1.0f < float(gradients.dims[2]));
+    if (!inside) {
+        for (__m128& corner : corners)
+            corner = _mm_setzero_ps();
+        for (__m128& factor : factors)
+            factor = _mm_setzero_ps();
+        return;
+    }
+
+    const int x0 = int(x), y0 = int(y), z0 = int(z);
+    factors[0] = _mm_set1_ps(x - float(x0));
+    factors[1] = _mm_set1_ps(y - float(y0));
+    factors[2] = _mm_set1_ps(z - float(z0));
+
+    // Gradients are 4 floats, so the two x neighbours of a row are 8 consecutive floats.
+    const size_t strideY = 4 * size_t(gradients.dims[0]);
+    const size_t strideZ = strideY * size_t(gradients.dims[1]);
+    const float* row = gradients.data + 4 * size_t(x0) + strideY * size_t(y0) + strideZ * size_t(z0);
+    const size_t rowOffsets[4] { 0, strideY, strideZ, strideZ + strideY };
+    for (int i = 0; i < 4; i++) {
+        corners[2 * i] = _mm_loadu_ps(row + rowOffsets[i]);
+        corners[2 * i + 1] = _mm_loadu_ps(row + rowOffsets[i] + 4);
+    }
+}
+
+// Front-to-back compositing as in Renderer::traceRayComposite. This is sequential by nature; one sample (RGBA) is
+// composited per iteration with 4-wide SSE.
+static inline int compositeFrontToBack(const float* rgba, int count, float* color, float* opacity)
+{
+    __m128 accumulatedColor = _mm_loadu_ps(color);
+    float accumulatedOpacity = *opacity;
+    int i = 0;
+    while (i < count) {
+        const float* sample = rgba + 4 * i++;
+        const float weight = (1.0f - accumulatedOpacity) * sample[3];
+        // The alpha channel of the accumulated color accumulates the opacity itself.
+        accumulatedColor = _mm_add_ps(accumulatedColor, _mm_mul_ps(_mm_set1_ps(weight), _mm_setr_ps(sample[0], sample[1], sample[2], 1.0f)));
+        accumulatedOpacity += weight;
+        if (accumulatedOpacity >= 1.0f)
+            break;
+    }
+    _mm_storeu_ps(color, accumulatedColor);
+    *opacity = accumulatedOpacity;
+    return i;
+}
+
+// Maximum of initial and the lanes of a vector (stored in lanes) and the remaining values.
+static inline float maximumOf(const float* lanes, int numLanes, const float* values, int count, float initial)
+{
+    float result = initial;
+    for (int i = 0; i < numLanes; i++)
+        result = lanes[i] > result ? lanes[i] : result;
+    for (int i = 0; i < count; i++)
+        result = values[i] > result ? values[i] : result;
+    return result;
+}
+
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// 0 = sequential (single-core), 1 = TBB (multi-core)
+#ifdef NDEBUG
+// If NOT in debug mode then enable parallelism using the TBB library (Intel Threaded Building Blocks).
+#define PARALLELISM 1
+#else
+// Disable multi threading in debug mode.
+#define PARALLELISM 0
+#endif
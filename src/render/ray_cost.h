@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+namespace render {
+
+// Work done while tracing a single ray. The Renderer counts into a thread-local instance while tracing
+// so that the instrumentation can stay compiled in without atomics or extra function arguments.
+struct RayCost {
+    // Interpolated samples, or voxels/cells visited when tracing with the cell walker (RenderConfig::cellTraversal).
+    uint32_t volumeSamples { 0 };
+    uint32_t gradientFetches { 0 };
+    uint32_t bisectionIterations { 0 };
+    uint64_t cycles { 0 };
+
+    bool missed { false };
+    // The ray stopped before leaving the volume (opacity saturated or isosurface found).
+    bool earlyTerminated { false };
+    // Samples that were not taken because the ray terminated early.
+    uint32_t samplesSkipped { 0 };
+    float length { 0.0f };
+};
+
+}
@@ -11,8 +11,36 @@ public:
 
     virtual glm::vec3 position() const = 0;
     virtual glm::vec3 forward() const = 0;
+    // Whether all rays have the same direction (forward()), so that the view can be rendered with shear-warp.
+    virtual bool orthographic() const { return false; }
 
     virtual render::Ray generateRay(const glm::vec2& pixel) const = 0;
 };
 
+// The rays of another camera in the coordinates of a volume that was downsampled by scale (see
+// volume::Volume::downsample), so that a preview is seen from the same view as the full volume.
+class ScaledCamera : public RayTraceCamera {
+public:
+    ScaledCamera(const RayTraceCamera* pCamera, float scale)
+        : m_pCamera(pCamera)
+        , m_scale(scale)
+    {
+    }
+
+    glm::vec3 position() const override { return m_pCamera->position() / m_scale; }
+    glm::vec3 forward() const override { return m_pCamera->forward(); }
+    bool orthographic() const override { return m_pCamera->orthographic(); }
+
+    render::Ray generateRay(const glm::vec2& pixel) const override
+    {
+        render::Ray ray = m_pCamera->generateRay(pixel);
+        ray.origin /= m_scale;
+        return ray;
+    }
+
+private:
+    const RayTraceCamera* m_pCamera;
+    float m_scale;
+};
+
 }
\ No newline at end of file
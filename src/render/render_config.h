@@ -1,6 +1,8 @@
 #pragma once
+#include "render/kernels.h"
 #include <array>
 #include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 #include <cstring> // memcmp  // macOS change TH
 
@@ -14,12 +16,34 @@ enum class RenderMode {
     RenderTF2D
 };
 
+// How the MIP and compositing render modes produce an image.
+enum class RenderBackend {
+    // Trace a ray per pixel.
+    RayCasting,
+    // Composite the volume slice by slice and warp the result onto the screen (see render/shear_warp.h). Only used for
+    // orthographic cameras without the cost heatmap; other views are ray cast.
+    ShearWarp,
+    // Splat the voxels onto the screen brick by brick, front to back (see render/splatting.h). Not used with the cost
+    // heatmap.
+    Splatting
+};
+
+// Which per-pixel cost is visualized by the cost heatmap.
+enum class CostMetric {
+    VolumeSamples,
+    GradientFetches,
+    BisectionIterations,
+    Cycles
+};
+
 struct RenderConfig {
     RenderMode renderMode { RenderMode::RenderSlicer };
+    RenderBackend renderBackend { RenderBackend::RayCasting };
     glm::ivec2 renderResolution;
 
     bool volumeShading { false };
     float isoValue { 95.0f };
+    glm::vec3 isoColor { 0.8f, 0.8f, 0.0f };
 
     // 1D transfer function.
     std::array<glm::vec4, 256> tfColorMap;
@@ -32,6 +56,37 @@ struct RenderConfig {
     float TF2DIntensity;
     float TF2DRadius;
     glm::vec4 TF2DColor;
+
+    // Trace MIP (nearest neighbour) and ISO (nearest neighbour and linear) rays cell by cell instead of with
+    // fixed steps, so that every voxel is visited exactly once and isosurface hits are exact.
+    bool cellTraversal { false };
+    // Skip the uniform tiles of the sparse copy of the volume (see volume::SparseVolume) in MIP, composite and ISO
+    // rays with nearest neighbour or linear interpolation. The renderer builds the sparse copy when this is first set,
+    // unless it was given one (see Renderer::setSparseVolume); the deadline-driven renders trace without it until it is
+    // built.
+    bool sparseTraversal { false };
+    // Skip the parts of the volume whose maximum (see volume::MaxPyramid) cannot raise the maximum of a MIP ray, and
+    // end the ray once it reaches the maximum of the volume. Axis-aligned rays with nearest neighbour interpolation
+    // take the precomputed MIP image along their axis instead. Applies to nearest neighbour and linear interpolation.
+    // The renderer builds the pyramid when this is first set; the deadline-driven renders trace without it until it is
+    // built.
+    bool maxPyramidTraversal { false };
+    // Sample the MIP, composite and 2D transfer function rays that are traced one sample at a time through a
+    // volume::RaySampler, which keeps the corners of the current cell between samples. Off by default: at steps of a
+    // voxel the rays enter a new cell at almost every sample, and the sampler is slower than sampling every position on
+    // its own.
+    bool reuseCellCorners { false };
+
+    // Instruction set of the kernels that trace MIP, composite and 2D transfer function rays with linear
+    // interpolation. Starts at the best level that the machine supports, or at the level set in VOLVIS_SIMD.
+    kernels::SimdLevel simdLevel { kernels::defaultSimdLevel() };
+    // Let the kernels interpolate with 8-bit fixed-point weights and integer arithmetic. Faster, but the samples are
+    // only accurate to about 1/256 of the difference between neighbouring voxels.
+    bool fixedPointInterpolation { false };
+
+    // Instrumentation: show the per-pixel render cost as a false-colour heatmap instead of the rendered image.
+    bool showCostHeatmap { false };
+    CostMetric costMetric { CostMetric::VolumeSamples };
 };
 
 // NOTE(Mathijs): should be replaced by C++20 three-way operator (aka spaceship operator) if we require C++ 20 support from Linux users (GCC10 / Clang10).
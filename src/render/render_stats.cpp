@@ -0,0 +1,47 @@
+#include "render_stats.h"
+
+namespace render {
+
+void RenderStats::addRay(const RayCost& cost)
+{
+    raysCast++;
+    if (cost.missed) {
+        raysMissed++;
+        return;
+    }
+    samplesTaken += cost.volumeSamples;
+    samplesSkipped += cost.samplesSkipped;
+    earlyTerminatedRays += cost.earlyTerminated ? 1 : 0;
+    totalRayLength += double(cost.length);
+}
+
+RenderStats& RenderStats::operator+=(const RenderStats& other)
+{
+    raysCast += other.raysCast;
+    raysMissed += other.raysMissed;
+    samplesTaken += other.samplesTaken;
+    samplesSkipped += other.samplesSkipped;
+    earlyTerminatedRays += other.earlyTerminatedRays;
+    totalRayLength += other.totalRayLength;
+    renderTime += other.renderTime;
+    return *this;
+}
+
+double RenderStats::averageRayLength() const
+{
+    const uint64_t raysHit = raysCast - raysMissed;
+    return raysHit > 0 ? totalRayLength / double(raysHit) : 0.0;
+}
+
+double RenderStats::samplesPerSecond() const
+{
+    return renderTime.count() > 0.0 ? double(samplesTaken) / renderTime.count() : 0.0;
+}
+
+RenderStats operator+(RenderStats lhs, const RenderStats& rhs)
+{
+    lhs += rhs;
+    return lhs;
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "render/ray_cost.h"
+#include <chrono>
+#include <cstdint>
+
+namespace render {
+
+// Statistics of a single render call. Each thread accumulates into its own instance which are
+// combined once at the end of the frame (see Renderer::stats()).
+struct RenderStats {
+    uint64_t raysCast { 0 };
+    uint64_t raysMissed { 0 };
+    uint64_t samplesTaken { 0 };
+    uint64_t samplesSkipped { 0 };
+    uint64_t earlyTerminatedRays { 0 };
+    double totalRayLength { 0.0 };
+    std::chrono::duration<double> renderTime { 0 };
+
+    void addRay(const RayCost& cost);
+    RenderStats& operator+=(const RenderStats& other);
+
+    // Average length of the rays that hit the volume (in voxels).
+    double averageRayLength() const;
+    double samplesPerSecond() const;
+};
+
+RenderStats operator+(RenderStats lhs, const RenderStats& rhs);
+
+}
@@ -1,17 +1,71 @@
 #include "renderer.h"
+#include "cell_walker.h"
+#include "parallelism.h"
+#include "profiling/profiler.h"
 #include <algorithm>
 #include <algorithm> // std::fill
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <glm/common.hpp>
 #include <glm/gtx/component_wise.hpp>
 #include <iostream>
+#include <limits>
+#include <numeric> // std::iota
+#include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <tuple>
+#if defined(_MSC_VER)
+#include <intrin.h> // __rdtsc
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc
+#endif
 
 namespace render {
 
+// Cost of the ray that is currently being traced on this thread.
+static thread_local RayCost t_rayCost;
+
+// Coefficients of the Phong shading model (see Renderer::computePhongShading).
+static constexpr float phongAmbient = 0.1f;
+static constexpr float phongDiffuse = 0.7f;
+static constexpr float phongSpecular = 0.2f;
+
+static uint64_t readCycleCounter()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Record that the current ray stopped at t, skipping the samples between t and ray.tmax.
+static void countEarlyTermination(const Ray& ray, float t, float sampleStep)
+{
+    t_rayCost.earlyTerminated = true;
+    t_rayCost.samplesSkipped += uint32_t(std::max((ray.tmax - t) / sampleStep, 0.0f));
+}
+
+bool TileMask::allComplete() const
+{
+    return std::all_of(std::begin(complete), std::end(complete), [](uint8_t c) { return c != 0; });
+}
+
+void GBuffer::resize(size_t numPixels)
+{
+    hit.resize(numPixels);
+    for (std::vector<float>& component : position)
+        component.resize(numPixels);
+    for (std::vector<float>& component : gradient)
+        component.resize(numPixels);
+}
+
 // The renderer is passed a pointer to the volume, gradinet volume, camera and an initial renderConfig.
 // The camera being pointed to may change each frame (when the user interacts). When the renderConfig
 // changes the setConfig function is called with the updated render config. This gives the Renderer an
@@ -25,6 +79,7 @@ Renderer::Renderer(
     , m_pGradientVolume(pGradientVolume)
     , m_pCamera(pCamera)
     , m_config(initialConfig)
+    , m_volumeSampler(pVolume->sampler())
 {
     resizeImage(initialConfig.renderResolution);
 }
@@ -36,12 +91,37 @@ void Renderer::setConfig(const RenderConfig& config)
         resizeImage(config.renderResolution);
 
     m_config = config;
+    m_costBuffer.resize(m_config.showCostHeatmap ? m_frameBuffer.size() : 0);
+    m_gBuffer.resize(m_config.renderMode == RenderMode::RenderIso ? m_frameBuffer.size() : 0);
+}
+
+void Renderer::setSparseVolume(const volume::SparseVolume* pSparseVolume)
+{
+    m_pSparseVolume = pSparseVolume;
+    m_optIsoSurfaceKey.reset();
 }
 
 // Resize the framebuffer and fill it with black pixels.
+// The tiles used by deadline-driven rendering are sorted by the distance of their center to the center of the screen.
 void Renderer::resizeImage(const glm::ivec2& resolution)
 {
     m_frameBuffer.resize(size_t(resolution.x) * size_t(resolution.y), glm::vec4(0.0f));
+    m_frameBufferValid = false;
+    m_costBuffer.resize(m_config.showCostHeatmap ? m_frameBuffer.size() : 0);
+    m_gBuffer.resize(m_config.renderMode == RenderMode::RenderIso ? m_frameBuffer.size() : 0);
+
+    m_tileMask.numTiles = (resolution + TileMask::tileSize - 1) / TileMask::tileSize;
+    m_tileMask.complete.assign(size_t(m_tileMask.numTiles.x) * size_t(m_tileMask.numTiles.y), 0);
+
+    const auto distanceToCenter = [&](int tile) {
+        const glm::ivec2 tileIndex { tile % m_tileMask.numTiles.x, tile / m_tileMask.numTiles.x };
+        const glm::vec2 tileCenter = (glm::vec2(tileIndex) + 0.5f) * float(TileMask::tileSize);
+        return glm::length(tileCenter - glm::vec2(resolution) / 2.0f);
+    };
+    m_tilePriority.resize(m_tileMask.complete.size());
+    std::iota(std::begin(m_tilePriority), std::end(m_tilePriority), 0);
+    std::stable_sort(std::begin(m_tilePriority), std::end(m_tilePriority),
+        [&](int lhs, int rhs) { return distanceToCenter(lhs) < distanceToCenter(rhs); });
 }
 
 // Clear the framebuffer by setting all pixels to black.
@@ -57,73 +137,91 @@ gsl::span<const glm::vec4> Renderer::frameBuffer() const
     return m_frameBuffer;
 }
 
+// Return a false-colour image of the per-pixel cost of the last frame according to m_config.costMetric.
+// Costs are normalized by the most expensive pixel: blue is cheap, red is the most expensive.
+gsl::span<const glm::vec4> Renderer::costHeatmap()
+{
+    const auto metric = [&](const RayCost& cost) {
+        switch (m_config.costMetric) {
+        case CostMetric::VolumeSamples:
+            return float(cost.volumeSamples);
+        case CostMetric::GradientFetches:
+            return float(cost.gradientFetches);
+        case CostMetric::BisectionIterations:
+            return float(cost.bisectionIterations);
+        case CostMetric::Cycles:
+            return float(cost.cycles);
+        };
+        return 0.0f;
+    };
+    // Piece-wise linear blue -> cyan -> green -> yellow -> red color map.
+    const auto falseColor = [](float t) {
+        static constexpr std::array<glm::vec3, 5> colors {
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+            glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)
+        };
+        const float scaled = std::clamp(t, 0.0f, 1.0f) * float(colors.size() - 1);
+        const size_t i = std::min(size_t(scaled), colors.size() - 2);
+        return glm::vec4(glm::mix(colors[i], colors[i + 1], scaled - float(i)), 1.0f);
+    };
+
+    m_costHeatmap.resize(m_costBuffer.size());
+    float maxCost = 0.0f;
+    for (const RayCost& cost : m_costBuffer)
+        maxCost = std::max(maxCost, metric(cost));
+    const float scale = maxCost > 0.0f ? 1.0f / maxCost : 0.0f;
+    std::transform(std::begin(m_costBuffer), std::end(m_costBuffer), std::begin(m_costHeatmap),
+        [&](const RayCost& cost) { return falseColor(metric(cost) * scale); });
+    return m_costHeatmap;
+}
+
 // Main render function. It computes an image according to the current renderMode.
 // Multithreading is enabled in Release/RelWithDebInfo modes. In Debug mode multithreading is disabled to make debugging easier.
 void Renderer::render()
 {
+    PROFILE_ZONE("Renderer::render");
+    beginStats();
+    const auto start = Clock::now();
+
+    const FrameContext frame = frameContext(true);
+    if (useShearWarp()) {
+        renderShearWarp(frame);
+        m_frameBufferValid = true;
+        endStats(Clock::now() - start);
+        return;
+    }
+    if (useSplatting()) {
+        renderSplatting(frame);
+        m_frameBufferValid = true;
+        endStats(Clock::now() - start);
+        return;
+    }
+    if (isoSurfaceTraced()) {
+        shadeIsoSurfaces();
+        endStats(Clock::now() - start);
+        return;
+    }
     resetImage();
-
-    static constexpr float sampleStep = 1.0f;
-    const glm::vec3 planeNormal = -glm::normalize(m_pCamera->forward());
-    const glm::vec3 volumeCenter = glm::vec3(m_pVolume->dims()) / 2.0f;
-    const Bounds bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) };
-
-    // 0 = sequential (single-core), 1 = TBB (multi-core)
-#ifdef NDEBUG
-    // If NOT in debug mode then enable parallelism using the TBB library (Intel Threaded Building Blocks).
-#define PARALLELISM 1
-#else
-    // Disable multi threading in debug mode.
-#define PARALLELISM 0
-#endif
+    m_optIsoSurfaceKey.reset();
 
 #if PARALLELISM == 0
     // Regular (single threaded) for loops.
+    RenderStats& stats = m_threadStats.local();
     for (int x = 0; x < m_config.renderResolution.x; x++) {
         for (int y = 0; y < m_config.renderResolution.y; y++) {
 #else
     // Parallel for loop (in 2 dimensions) that subdivides the screen into tiles.
     const tbb::blocked_range2d<int> screenRange { 0, m_config.renderResolution.y, 0, m_config.renderResolution.x };
         tbb::parallel_for(screenRange, [&](tbb::blocked_range2d<int> localRange) {
+        PROFILE_ZONE("Renderer::render tile");
+        // Statistics of the thread that is executing this tile.
+        RenderStats& stats = m_threadStats.local();
         // Loop over the pixels in a tile. This function is called on multiple threads at the same time.
         for (int y = std::begin(localRange.rows()); y != std::end(localRange.rows()); y++) {
             for (int x = std::begin(localRange.cols()); x != std::end(localRange.cols()); x++) {
 #endif
-            // Compute a ray for the current pixel.
-            const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
-            Ray ray = m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
-
-            // Compute where the ray enters and exists the volume.
-            // If the ray misses the volume then we continue to the next pixel.
-            if (!instersectRayVolumeBounds(ray, bounds))
-                continue;
-
-            // Get a color for the current pixel according to the current render mode.
-            glm::vec4 color {};
-            switch (m_config.renderMode) {
-            case RenderMode::RenderSlicer: {
-                color = traceRaySlice(ray, volumeCenter, planeNormal);
-                break;
-            }
-            case RenderMode::RenderMIP: {
-                color = traceRayMIP(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderComposite: {
-                color = traceRayComposite(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderIso: {
-                color = traceRayISO(ray, sampleStep);
-                break;
-            }
-            case RenderMode::RenderTF2D: {
-                color = traceRayTF2D(ray, sampleStep);
-                break;
-            }
-            };
-            // Write the resulting color to the screen.
-            fillColor(x, y, color);
+            // Trace the pixel and write the resulting color to the screen.
+            renderPixel(x, y, frame, stats);
 
 #if PARALLELISM == 1
         }
@@ -133,6 +231,323 @@ void Renderer::render()
             }
         }
 #endif
+
+    if (m_config.renderMode == RenderMode::RenderIso) {
+        shadeIsoSurfaces();
+        m_optIsoSurfaceKey = isoSurfaceKey();
+    }
+    m_frameBufferValid = true;
+    endStats(Clock::now() - start);
+}
+
+// Deadline-driven render function. Tiles are traced in priority order (center of the screen first, then outward)
+// until the deadline expires. Tiles that were not traced keep the contents of the previous frame, or of a coarse
+// pass (one ray per 8x8 pixel block) if no previous frame at this resolution exists.
+// The returned mask tells which tiles are complete; call continueRender() to trace the remaining tiles later.
+const TileMask& Renderer::render(Clock::time_point deadline)
+{
+    PROFILE_ZONE("Renderer::render(deadline)");
+    if (useShearWarp() || useSplatting()) {
+        // The object-order backends render the whole image at once; they do not stop at the deadline.
+        render();
+        std::fill(std::begin(m_tileMask.complete), std::end(m_tileMask.complete), uint8_t(1));
+        return m_tileMask;
+    }
+    if (isoSurfaceTraced()) {
+        // Shading is cheap compared to tracing and is always completed, regardless of the deadline.
+        beginStats();
+        const auto start = Clock::now();
+        shadeIsoSurfaces();
+        std::fill(std::begin(m_tileMask.complete), std::end(m_tileMask.complete), uint8_t(1));
+        endStats(Clock::now() - start);
+        return m_tileMask;
+    }
+    m_optIsoSurfaceKey.reset();
+    std::fill(std::begin(m_tileMask.complete), std::end(m_tileMask.complete), uint8_t(0));
+    if (!m_frameBufferValid) {
+        renderCoarse(frameContext(false));
+        m_frameBufferValid = true;
+    }
+    return continueRender(deadline);
+}
+
+// Continue tracing the tiles that were not completed by the previous call to render(deadline).
+// The camera and render config are assumed to be unchanged since that call.
+const TileMask& Renderer::continueRender(Clock::time_point deadline)
+{
+    PROFILE_ZONE("Renderer::continueRender");
+    beginStats();
+    const auto start = Clock::now();
+    const FrameContext frame = frameContext(false);
+
+#if PARALLELISM == 0
+    for (const int tile : m_tilePriority) {
+        if (Clock::now() >= deadline)
+            break;
+        if (!m_tileMask.complete[size_t(tile)])
+            renderTile(tile, frame);
+    }
+#else
+    // Workers pull tiles from a shared queue so that tiles are started in priority order. A tile that has been
+    // started is always finished, so the deadline may be exceeded by at most the time it takes to trace one tile.
+    std::atomic_size_t nextTile { 0 };
+    const int numWorkers = tbb::this_task_arena::max_concurrency();
+    tbb::parallel_for(0, numWorkers, [&](int) {
+        while (Clock::now() < deadline) {
+            const size_t i = nextTile++;
+            if (i >= m_tilePriority.size())
+                break;
+            const int tile = m_tilePriority[i];
+            if (!m_tileMask.complete[size_t(tile)])
+                renderTile(tile, frame);
+        }
+    });
+#endif
+
+    if (m_config.renderMode == RenderMode::RenderIso && m_tileMask.allComplete())
+        m_optIsoSurfaceKey = isoSurfaceKey();
+    endStats(Clock::now() - start);
+    return m_tileMask;
+}
+
+// Reset the per-thread statistics before starting a new render pass.
+void Renderer::beginStats()
+{
+    for (RenderStats& threadStats : m_threadStats)
+        threadStats = RenderStats {};
+}
+
+// Combine the per-thread statistics of the render pass that just finished.
+void Renderer::endStats(std::chrono::duration<double> renderTime)
+{
+    m_stats = m_threadStats.combine(std::plus<RenderStats>());
+    m_stats.renderTime = renderTime;
+}
+
+const RenderStats& Renderer::stats() const
+{
+    return m_stats;
+}
+
+// Starts building optResult on a background thread if it has not been started yet, and takes the result once the build
+// is done (or waits for it).
+template <typename T, typename Build>
+static void takeWhenBuilt(std::optional<T>& optResult, std::future<T>& future, bool wait, Build build)
+{
+    if (!future.valid())
+        future = std::async(std::launch::async, build);
+    if (wait || future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        optResult.emplace(future.get());
+}
+
+// Per-frame state: also resolves the volume sampler for the current interpolation mode, and builds the acceleration
+// structures that the ray casting backend uses.
+Renderer::FrameContext Renderer::frameContext(bool waitForBuilds)
+{
+    m_volumeSampler = m_pVolume->sampler();
+    const bool rayCasting = !useShearWarp() && !useSplatting();
+    if (rayCasting && m_config.maxPyramidTraversal && !m_optMaxPyramid)
+        takeWhenBuilt(m_optMaxPyramid, m_futureMaxPyramid, waitForBuilds, [pVolume = m_pVolume]() { return volume::MaxPyramid(*pVolume); });
+    if (rayCasting && m_config.sparseTraversal && !m_pSparseVolume) {
+        if (!m_optSparseVolume)
+            takeWhenBuilt(m_optSparseVolume, m_futureSparseVolume, waitForBuilds, [pVolume = m_pVolume]() { return volume::SparseVolume(*pVolume); });
+        if (m_optSparseVolume)
+            m_pSparseVolume = &*m_optSparseVolume;
+    }
+    // The kernels implement trilinear interpolation.
+    const bool useKernels = m_pVolume->interpolationMode == volume::InterpolationMode::Linear;
+    return FrameContext {
+        -glm::normalize(m_pCamera->forward()),
+        glm::vec3(m_pVolume->dims()) / 2.0f,
+        Bounds { glm::vec3(0.0f), glm::vec3(m_pVolume->dims() - glm::ivec3(1)) },
+        useKernels ? kernels::kernelTable(m_config.simdLevel) : nullptr
+    };
+}
+
+// Compute the ray of a single pixel and where it enters and exits the volume. Returns false if the ray misses the volume.
+bool Renderer::generatePixelRay(int x, int y, const FrameContext& frame, Ray& ray) const
+{
+    const glm::vec2 pixelPos = glm::vec2(x, y) / glm::vec2(m_config.renderResolution);
+    ray = m_pCamera->generateRay(pixelPos * 2.0f - 1.0f);
+
+    if (!instersectRayVolumeBounds(ray, frame.bounds)) {
+        t_rayCost.missed = true;
+        return false;
+    }
+    t_rayCost.length = std::max(ray.tmax - ray.tmin, 0.0f);
+    return true;
+}
+
+// Compute the color of a single pixel according to the current renderMode.
+glm::vec4 Renderer::tracePixel(int x, int y, const FrameContext& frame) const
+{
+    static constexpr float sampleStep = 1.0f;
+
+    // If the ray misses the volume then the pixel is black.
+    Ray ray;
+    if (!generatePixelRay(x, y, frame, ray))
+        return glm::vec4(0.0f);
+
+    // Get a color for the current pixel according to the current render mode.
+    switch (m_config.renderMode) {
+    case RenderMode::RenderSlicer: {
+        // traceRaySlice and traceRayMIP sample the volume directly, so their samples are counted here.
+        t_rayCost.volumeSamples++;
+        return traceRaySlice(ray, frame.volumeCenter, frame.planeNormal);
+    }
+    case RenderMode::RenderMIP: {
+        if (m_config.cellTraversal && m_pVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour)
+            return traceRayMIPCells(ray);
+        if (useMaxPyramid())
+            return traceRayMIPPyramid(ray, sampleStep);
+        if (useSparseTraversal())
+            return traceRayMIPSparse(ray, sampleStep);
+        if (frame.pKernels)
+            return traceRayMIPKernels(ray, sampleStep, *frame.pKernels);
+        if (m_config.reuseCellCorners)
+            return traceRayMIPRaySampler(ray, sampleStep);
+        t_rayCost.volumeSamples += ray.tmax >= ray.tmin ? uint32_t((ray.tmax - ray.tmin) / sampleStep) + 1 : 0;
+        return traceRayMIP(ray, sampleStep);
+    }
+    case RenderMode::RenderComposite: {
+        if (useSparseTraversal())
+            return traceRayCompositeSparse(ray, sampleStep);
+        if (frame.pKernels)
+            return traceRayCompositeKernels(ray, sampleStep, *frame.pKernels);
+        return traceRayComposite(ray, sampleStep);
+    }
+    case RenderMode::RenderIso: {
+        const std::optional<float> t = traceIsoSurface(ray, sampleStep);
+        return t ? shadeIsoSurface(ray, *t) : glm::vec4(glm::vec3(0.0f), 1.0f);
+    }
+    case RenderMode::RenderTF2D: {
+        if (frame.pKernels)
+            return traceRayTF2DKernels(ray, sampleStep, *frame.pKernels);
+        return traceRayTF2D(ray, sampleStep);
+    }
+    };
+    return glm::vec4(0.0f);
+}
+
+// Trace a single pixel and write the resulting color to the framebuffer.
+// When the cost heatmap is enabled the work done for the pixel is recorded as well.
+// In the ISO render mode only the isosurface hit is traced; it is shaded afterwards by shadeIsoSurfaces().
+void Renderer::renderPixel(int x, int y, const FrameContext& frame, RenderStats& stats)
+{
+    const auto trace = [&]() {
+        if (m_config.renderMode == RenderMode::RenderIso)
+            traceIsoSurfacePixel(x, y, frame);
+        else
+            fillColor(x, y, tracePixel(x, y, frame));
+    };
+
+    t_rayCost = RayCost {};
+    if (m_config.showCostHeatmap) {
+        const uint64_t start = readCycleCounter();
+        trace();
+        t_rayCost.cycles = readCycleCounter() - start;
+        m_costBuffer[size_t(m_config.renderResolution.x) * size_t(y) + size_t(x)] = t_rayCost;
+    } else {
+        trace();
+    }
+    stats.addRay(t_rayCost);
+}
+
+// Trace all pixels of a single tile and mark it as complete.
+void Renderer::renderTile(int tile, const FrameContext& frame)
+{
+    PROFILE_ZONE("Renderer::renderTile");
+    const glm::ivec2 tileIndex { tile % m_tileMask.numTiles.x, tile / m_tileMask.numTiles.x };
+    const glm::ivec2 begin = tileIndex * TileMask::tileSize;
+    const glm::ivec2 end = glm::min(begin + TileMask::tileSize, m_config.renderResolution);
+    RenderStats& stats = m_threadStats.local();
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++) {
+            renderPixel(x, y, frame, stats);
+        }
+    }
+    if (m_config.renderMode == RenderMode::RenderIso) {
+        for (int y = begin.y; y < end.y; y++) {
+            const size_t row = size_t(m_config.renderResolution.x) * size_t(y);
+            shadeIsoSurfaces(row + size_t(begin.x), row + size_t(end.x));
+        }
+    }
+    m_tileMask.complete[size_t(tile)] = 1;
+}
+
+// Fill the framebuffer with a low resolution preview by tracing one ray per block of pixels.
+void Renderer::renderCoarse(const FrameContext& frame)
+{
+    PROFILE_ZONE("Renderer::renderCoarse");
+    static constexpr int blockSize = 8;
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const glm::ivec2 numBlocks = (resolution + blockSize - 1) / blockSize;
+
+    const auto fillBlock = [&](int blockX, int blockY) {
+        const glm::ivec2 begin = glm::ivec2(blockX, blockY) * blockSize;
+        const glm::ivec2 end = glm::min(begin + blockSize, resolution);
+        const glm::vec4 color = tracePixel((begin.x + end.x) / 2, (begin.y + end.y) / 2, frame);
+        for (int y = begin.y; y < end.y; y++) {
+            for (int x = begin.x; x < end.x; x++)
+                fillColor(x, y, color);
+        }
+    };
+
+#if PARALLELISM == 0
+    for (int blockY = 0; blockY < numBlocks.y; blockY++) {
+        for (int blockX = 0; blockX < numBlocks.x; blockX++)
+            fillBlock(blockX, blockY);
+    }
+#else
+    tbb::parallel_for(tbb::blocked_range2d<int>(0, numBlocks.y, 0, numBlocks.x), [&](tbb::blocked_range2d<int> localRange) {
+        for (int blockY = std::begin(localRange.rows()); blockY != std::end(localRange.rows()); blockY++) {
+            for (int blockX = std::begin(localRange.cols()); blockX != std::end(localRange.cols()); blockX++)
+                fillBlock(blockX, blockY);
+        }
+    });
+#endif
+}
+
+// Values below the threshold cannot change a MIP or compositing pixel: MIP starts at 0, and compositing skips the
+// values below the first entry of the transfer function with a nonzero opacity (with a margin for the rounding of
+// getTFValue). Values between two values below the threshold are below it as well.
+float Renderer::transparencyThreshold() const
+{
+    if (m_config.renderMode == RenderMode::RenderMIP)
+        return std::numeric_limits<float>::denorm_min();
+
+    const auto& tfColorMap = m_config.tfColorMap;
+    const auto firstOpaque = std::find_if(std::begin(tfColorMap), std::end(tfColorMap), [](const glm::vec4& tfValue) { return tfValue.a > 0.0f; });
+    if (firstOpaque == std::end(tfColorMap))
+        return std::numeric_limits<float>::infinity();
+    if (firstOpaque == std::begin(tfColorMap))
+        return -std::numeric_limits<float>::infinity();
+    const float firstIndex = float(firstOpaque - std::begin(tfColorMap));
+    return m_config.tfColorMapIndexStart + m_config.tfColorMapIndexRange * (firstIndex - 0.01f) / float(tfColorMap.size());
+}
+
+// Fill every pixel with pixelColor(x, y, ray) if its ray hits the volume, and with black otherwise. Used by the
+// backends that do not trace the rays, to combine the images they render into the framebuffer.
+void Renderer::fillPixels(const FrameContext& frame, const std::function<glm::vec4(int, int, const Ray&)>& pixelColor)
+{
+    const auto fillRow = [&](int y) {
+        RenderStats& stats = m_threadStats.local();
+        for (int x = 0; x < m_config.renderResolution.x; x++) {
+            t_rayCost = RayCost {};
+            Ray ray;
+            fillColor(x, y, generatePixelRay(x, y, frame, ray) ? pixelColor(x, y, ray) : glm::vec4(0.0f));
+            stats.addRay(t_rayCost);
+        }
+    };
+#if PARALLELISM == 0
+    for (int y = 0; y < m_config.renderResolution.y; y++)
+        fillRow(y);
+#else
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_config.renderResolution.y), [&](const tbb::blocked_range<int>& range) {
+        for (int y = range.begin(); y != range.end(); y++)
+            fillRow(y);
+    });
+#endif
 }
 
 // ======= DO NOT MODIFY THIS FUNCTION ========
@@ -174,114 +589,722 @@ glm::vec4 Renderer::traceRayMIP(const Ray& ray, float sampleStep) const
 //   Use the camera position (m_pCamera->position()) as the light position.
 // Use the bisectionAccuracy function (to be implemented) to get a more precise isosurface location between two steps.
 glm::vec4 Renderer::traceRayISO(const Ray& ray, float sampleStep) const
-{   
-    const float R = 0.8f;
-    const float G = 0.8f;
-    const float B = 0.0f;
-
-    auto color = glm::vec3(R, G, B);
- 
-    //if volume shading is disabled, then simply return the isoColor from the isoValue
-    if (!m_config.volumeShading){
-        
-        // The current position along the ray.
-        glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+{
+    const std::optional<float> t = findIsoSurface(ray, sampleStep);
+    return t ? shadeIsoSurface(ray, *t) : glm::vec4(glm::vec3(0.0f), 1.0f);
+}
 
-        // The increment in the ray direction for each sample.
-        const glm::vec3 increment = sampleStep * ray.direction;
+// Ray parameter of the first isosurface crossing along the ray, or nothing if the ray does not hit the isosurface.
+// The crossing is always refined so that the hit can be shaded later on, even if volume shading is disabled now.
+std::optional<float> Renderer::findIsoSurface(const Ray& ray, float sampleStep) const
+{
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
 
-        float res = 0.0f;
+    // Carry the previous sample forward so that every step costs a single interpolation; the
+    // crossing is then refined from the two bracketing values that are already known.
+    float prevT = ray.tmin;
+    float prevVal = sampleVolume(samplePos);
 
-        for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
-            
-            // Get the volume value at the current sample position.
-            float val = m_pVolume->getSampleInterpolate(samplePos);
-            
-            // If the value at the current sample position is greater than the iso value then we have found the isosurface.
-            if (val > m_config.isoValue) {
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        const float val = t == ray.tmin ? prevVal : sampleVolume(samplePos);
 
-                //unica cosa di cui non sono sicuro, nell'esempio la superficie è gialla mentre a me è bianca
-                res = 1.0f;
-                break;
-                
-            }
-            
+        // The isosurface lies between the previous and the current sample position.
+        if (val > m_config.isoValue) {
+            const float preciseT = t == ray.tmin ? t : refineIsoCrossing(ray, prevT, t, prevVal, val, m_config.isoValue);
+            countEarlyTermination(ray, t, sampleStep);
+            return preciseT;
         }
-        return glm::vec4(color * res, 1.0f);
 
-    
+        prevT = t;
+        prevVal = val;
     }
 
-    //if volume shading is enabled, then return the phong-shaded color 
-    //at that location using the local gradient (from m_pGradientVolume)
-    else {
+    return std::nullopt;
+}
 
-        glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
-        const glm::vec3 increment = sampleStep * ray.direction;
+// Find the isosurface hit with the method that is selected by RenderConfig::cellTraversal and the interpolation mode.
+std::optional<float> Renderer::traceIsoSurface(const Ray& ray, float sampleStep) const
+{
+    if (m_config.cellTraversal && m_pVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour)
+        return findIsoSurfaceCellsNearest(ray, sampleStep);
+    if (m_config.cellTraversal && m_pVolume->interpolationMode == volume::InterpolationMode::Linear)
+        return findIsoSurfaceCellsLinear(ray, sampleStep);
+    if (useSparseTraversal())
+        return findIsoSurfaceSparse(ray, sampleStep);
+    return findIsoSurface(ray, sampleStep);
+}
 
-        for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+// Given that the iso value lies somewhere between t0 and t1, find a t for which the value
+// closely matches the iso value (less than 0.01 difference). Add a limit to the number of
+// iterations such that it does not get stuck in degerate cases.
+float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
+{
+    const float v0 = sampleVolume(ray.origin + t0 * ray.direction);
+    const float v1 = sampleVolume(ray.origin + t1 * ray.direction);
+    return refineIsoCrossing(ray, t0, t1, v0, v1, isoValue);
+}
+
+// Locate the iso crossing in [t0, t1] given the (already sampled) values v0 and v1 at the end points.
+// Uses regula falsi with the Illinois modification: the secant through the bracket converges in one or
+// two steps where the volume is close to linear along the ray. Nearest neighbour sampling is piecewise
+// constant along the ray so the secant carries no information there and plain bisection is used instead.
+float Renderer::refineIsoCrossing(const Ray& ray, float t0, float t1, float v0, float v1, float isoValue) const
+{
+    static constexpr int maxIterations = 30; // Maximum number of iterations
+    static constexpr float precision = 0.01f; // Precision of the result
+
+    float a = t0, fa = v0 - isoValue;
+    float b = t1, fb = v1 - isoValue;
+    // Not a bracket (degenerate input); return the end point closest to the iso value.
+    if (fa * fb > 0.0f)
+        return std::abs(fa) <= std::abs(fb) ? a : b;
+    if (fa == fb)
+        return a;
+
+    const bool secant = m_pVolume->interpolationMode != volume::InterpolationMode::NearestNeighbour;
+    float c = a;
+    int side = 0; // End point that was retained by the previous iteration (-1 = a, 1 = b).
+    for (int iteration = 0; iteration < maxIterations; iteration++) {
+        t_rayCost.bisectionIterations++;
+        c = secant ? (a * fb - b * fa) / (fb - fa) : (a + b) / 2.0f;
+
+        const float fc = sampleVolume(ray.origin + c * ray.direction) - isoValue;
+        if (std::abs(fc) < precision || std::abs(b - a) < precision)
+            break;
+
+        if ((fc < 0.0f) == (fa < 0.0f)) {
+            a = c;
+            fa = fc;
+            if (side == -1)
+                fb *= 0.5f;
+            side = -1;
+        } else {
+            b = c;
+            fb = fc;
+            if (side == 1)
+                fa *= 0.5f;
+            side = 1;
+        }
+    }
+
+    return c;
+}
+
+// x^100 as x^64 * x^32 * x^4, which the shading kernels can evaluate in exactly the same way. Below
+// kernels::minSpecularCosine (and for NaN) the result is 0 instead of a slow denormal.
+static float power100(float x)
+{
+    if (!(x >= kernels::minSpecularCosine))
+        return 0.0f;
+    const float x2 = x * x, x4 = x2 * x2, x8 = x4 * x4, x16 = x8 * x8, x32 = x16 * x16, x64 = x32 * x32;
+    return x64 * x32 * x4;
+}
+
+// v * (1 / |v|), rounded like the shading kernels (and like glm::normalize, unless glm is configured to use SIMD).
+static glm::vec3 normalizeExact(const glm::vec3& v)
+{
+    return v * (1.0f / std::sqrt(glm::dot(v, v)));
+}
+
+// Color of the isosurface hit at ray parameter t: Phong shaded with the camera as light source when volume
+// shading is enabled, otherwise the flat iso color.
+glm::vec4 Renderer::shadeIsoSurface(const Ray& ray, float t) const
+{
+    if (!m_config.volumeShading)
+        return glm::vec4(m_config.isoColor, 1.0f);
 
-            float val1 = m_pVolume->getSampleInterpolate(samplePos);
-            float val2 = m_pVolume->getSampleInterpolate(samplePos + increment);
+    const glm::vec3 position = ray.origin + t * ray.direction;
+    return shadeIsoSurfacePoint(position, sampleGradient(position), ray.origin);
+}
 
-            // If the isosurface might be between the current and next sample positions
-            if (val1 > m_config.isoValue || val2 > m_config.isoValue) {
-                float preciseT = bisectionAccuracy(ray, t, t + sampleStep, m_config.isoValue);
-                glm::vec3 precisePos = ray.origin + preciseT * ray.direction;
+// Phong shaded color of the isosurface at position, seen from the camera and lit by a point light.
+glm::vec4 Renderer::shadeIsoSurfacePoint(const glm::vec3& position, const volume::GradientVoxel& gradient, const glm::vec3& light) const
+{
+    const glm::vec3 V = normalizeExact(m_pCamera->position() - position); // View vector
+    const glm::vec3 L = normalizeExact(position - light); // Light vector
+    return glm::vec4(computePhongShading(m_config.isoColor, gradient, L, V), 1.0f);
+}
 
-                volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(precisePos);
-                glm::vec3 V = glm::normalize(m_pCamera->position() - precisePos); // View vector
-                glm::vec3 L = glm::normalize(precisePos - ray.origin ); // Light vector
+// Trace the isosurface hit of a single pixel into the G-buffer, together with the gradient at the hit.
+void Renderer::traceIsoSurfacePixel(int x, int y, const FrameContext& frame)
+{
+    static constexpr float sampleStep = 1.0f;
 
-                glm::vec3 phongShading = computePhongShading(color, gradient, L, V);
+    const size_t pixel = size_t(m_config.renderResolution.x) * size_t(y) + size_t(x);
+    Ray ray;
+    if (!generatePixelRay(x, y, frame, ray)) {
+        m_gBuffer.hit[pixel] = kernels::SurfaceHit::MissedVolume;
+        return;
+    }
+    const std::optional<float> t = traceIsoSurface(ray, sampleStep);
+    m_gBuffer.hit[pixel] = t ? kernels::SurfaceHit::HitSurface : kernels::SurfaceHit::MissedSurface;
+    if (!t)
+        return;
+
+    const glm::vec3 position = ray.origin + *t * ray.direction;
+    const volume::GradientVoxel gradient = sampleGradient(position);
+    for (int axis = 0; axis < 3; axis++) {
+        m_gBuffer.position[size_t(axis)][pixel] = position[axis];
+        m_gBuffer.gradient[size_t(axis)][pixel] = gradient.dir[axis];
+    }
+}
 
-                return glm::vec4(phongShading, 1.0f); 
+// Shade the isosurface hits of the whole G-buffer into the framebuffer.
+void Renderer::shadeIsoSurfaces()
+{
+    PROFILE_ZONE("Renderer::shadeIsoSurfaces");
+#if PARALLELISM == 0
+    shadeIsoSurfaces(0, m_frameBuffer.size());
+#else
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_frameBuffer.size(), 4096), [&](const tbb::blocked_range<size_t>& range) {
+        shadeIsoSurfaces(std::begin(range), std::end(range));
+    });
+#endif
+}
+
+// Shade the isosurface hits of the pixels [begin, end) of the G-buffer: the flat iso color without volume shading,
+// otherwise Phong shading with the camera as viewer and light source, by the SIMD kernels where available.
+// Pixels that did not hit the isosurface are black, and transparent if their ray missed the volume (like tracePixel).
+void Renderer::shadeIsoSurfaces(size_t begin, size_t end)
+{
+    const auto background = [&](size_t pixel) {
+        return glm::vec4(0.0f, 0.0f, 0.0f, m_gBuffer.hit[pixel] == kernels::SurfaceHit::MissedVolume ? 0.0f : 1.0f);
+    };
+    if (!m_config.volumeShading) {
+        for (size_t pixel = begin; pixel < end; pixel++)
+            m_frameBuffer[pixel] = m_gBuffer.hit[pixel] == kernels::SurfaceHit::HitSurface ? glm::vec4(m_config.isoColor, 1.0f) : background(pixel);
+        return;
+    }
+
+    const glm::vec3 eye = m_pCamera->position();
+    if (const kernels::KernelTable* pKernels = kernels::kernelTable(m_config.simdLevel)) {
+        const auto& position = m_gBuffer.position;
+        const auto& gradient = m_gBuffer.gradient;
+        const kernels::SurfaceView surfaces {
+            m_gBuffer.hit.data() + begin,
+            { position[0].data() + begin, position[1].data() + begin, position[2].data() + begin },
+            { gradient[0].data() + begin, gradient[1].data() + begin, gradient[2].data() + begin }
+        };
+        const glm::vec3 color = m_config.isoColor;
+        const kernels::PhongView phong {
+            phongAmbient, phongDiffuse, phongSpecular, { color.x, color.y, color.z }, { eye.x, eye.y, eye.z }, { eye.x, eye.y, eye.z }
+        };
+        static_assert(sizeof(glm::vec4) == 4 * sizeof(float));
+        pKernels->shadeSurfaces(surfaces, phong, int(end - begin), reinterpret_cast<float*>(m_frameBuffer.data() + begin));
+        return;
+    }
+
+    for (size_t pixel = begin; pixel < end; pixel++) {
+        if (m_gBuffer.hit[pixel] != kernels::SurfaceHit::HitSurface) {
+            m_frameBuffer[pixel] = background(pixel);
+            continue;
+        }
+        const glm::vec3 position { m_gBuffer.position[0][pixel], m_gBuffer.position[1][pixel], m_gBuffer.position[2][pixel] };
+        const volume::GradientVoxel gradient { glm::vec3(m_gBuffer.gradient[0][pixel], m_gBuffer.gradient[1][pixel], m_gBuffer.gradient[2][pixel]), 0.0f };
+        m_frameBuffer[pixel] = shadeIsoSurfacePoint(position, gradient, eye);
+    }
+}
+
+bool Renderer::IsoSurfaceKey::operator==(const IsoSurfaceKey& other) const
+{
+    for (size_t i = 0; i < cornerRays.size(); i++) {
+        if (cornerRays[i].origin != other.cornerRays[i].origin || cornerRays[i].direction != other.cornerRays[i].direction)
+            return false;
+    }
+    return config == other.config && interpolationMode == other.interpolationMode && gradientInterpolationMode == other.gradientInterpolationMode;
+}
+
+// Everything that the isosurface hits in the G-buffer depend on.
+Renderer::IsoSurfaceKey Renderer::isoSurfaceKey() const
+{
+    IsoSurfaceKey key;
+    key.config = m_config;
+    key.config.volumeShading = false;
+    key.config.isoColor = glm::vec3(0.0f);
+    key.config.simdLevel = kernels::SimdLevel::Scalar;
+    const std::array<glm::vec2, 4> corners { glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(-1.0f, 1.0f), glm::vec2(1.0f, 1.0f) };
+    for (size_t i = 0; i < corners.size(); i++)
+        key.cornerRays[i] = m_pCamera->generateRay(corners[i]);
+    key.interpolationMode = m_pVolume->interpolationMode;
+    key.gradientInterpolationMode = m_pGradientVolume->interpolationMode;
+    return key;
+}
+
+// Whether the G-buffer holds the isosurface hits of the current frame, so that it only needs to be shaded.
+bool Renderer::isoSurfaceTraced() const
+{
+    return m_config.renderMode == RenderMode::RenderIso && m_optIsoSurfaceKey && *m_optIsoSurfaceKey == isoSurfaceKey();
+}
+
+// Value of a single voxel, or 0 outside of the volume (matching the samplers).
+static float voxelOrZero(const volume::Volume& volume, const glm::ivec3& dims, const glm::ivec3& voxel)
+{
+    if (glm::any(glm::lessThan(voxel, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(voxel, dims)))
+        return 0.0f;
+    return volume.getVoxel(voxel.x, voxel.y, voxel.z);
+}
+
+// MIP with nearest neighbour sampling: the maximum over every voxel that the ray passes through.
+glm::vec4 Renderer::traceRayMIPCells(const Ray& ray) const
+{
+    const glm::ivec3 dims = m_pVolume->dims();
+    float maxVal = 0.0f;
+    CellWalker walker { ray, -0.5f };
+    do {
+        t_rayCost.volumeSamples++;
+        maxVal = std::max(voxelOrZero(*m_pVolume, dims, walker.cell()), maxVal);
+    } while (walker.next());
+
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+// Isosurface with nearest neighbour sampling: the surface is the boundary of the first voxel above the iso value.
+std::optional<float> Renderer::findIsoSurfaceCellsNearest(const Ray& ray, float sampleStep) const
+{
+    const glm::ivec3 dims = m_pVolume->dims();
+    CellWalker walker { ray, -0.5f };
+    do {
+        t_rayCost.volumeSamples++;
+        if (voxelOrZero(*m_pVolume, dims, walker.cell()) > m_config.isoValue) {
+            countEarlyTermination(ray, walker.tEnter(), sampleStep);
+            // Shade slightly inside the voxel so that the nearest neighbour gradient belongs to the voxel that was hit.
+            return std::min(walker.tEnter() + 0.01f, walker.tExit());
+        }
+    } while (walker.next());
+
+    return std::nullopt;
+}
+
+// Evaluate the cubic polynomial c[0] + c[1] * s + c[2] * s^2 + c[3] * s^3.
+static float evaluateCubic(const std::array<float, 4>& c, float s)
+{
+    return c[0] + s * (c[1] + s * (c[2] + s * c[3]));
+}
+
+// Find the first s in [0, length] at which the trilinear interpolation of the 8 cell corners (index x + 2y + 4z)
+// along entry + s * direction (in local cell coordinates) rises above isoValue. Returns a negative value if there is
+// no such s. Along the ray the trilinear interpolant is a cubic in s; the interval is split at the extrema of the
+// cubic and the first monotonic piece that crosses the iso value is refined with regula falsi on the polynomial,
+// without touching the volume again.
+static float cellIsoCrossing(const std::array<float, 8>& corners, const glm::vec3& entry, const glm::vec3& direction, float length, float isoValue)
+{
+    std::array<float, 4> c { -isoValue, 0.0f, 0.0f, 0.0f };
+    for (int corner = 0; corner < 8; corner++) {
+        // Each trilinear weight is a product of three factors that are linear in s: w + dw * s.
+        glm::vec3 w, dw;
+        for (int axis = 0; axis < 3; axis++) {
+            const bool upper = (corner >> axis) & 1;
+            w[axis] = upper ? entry[axis] : 1.0f - entry[axis];
+            dw[axis] = upper ? direction[axis] : -direction[axis];
+        }
+        const float v = corners[size_t(corner)];
+        c[0] += v * w.x * w.y * w.z;
+        c[1] += v * (dw.x * w.y * w.z + w.x * dw.y * w.z + w.x * w.y * dw.z);
+        c[2] += v * (dw.x * dw.y * w.z + dw.x * w.y * dw.z + w.x * dw.y * dw.z);
+        c[3] += v * dw.x * dw.y * dw.z;
+    }
+    if (c[0] > 0.0f)
+        return 0.0f;
+
+    // Split [0, length] at the roots of the derivative c[1] + 2 c[2] s + 3 c[3] s^2.
+    std::array<float, 4> bounds { 0.0f, length, length, length };
+    int numBounds = 1;
+    const auto addExtremum = [&](float s) {
+        if (s > 0.0f && s < length)
+            bounds[size_t(numBounds++)] = s;
+    };
+    const float a = 3.0f * c[3], b = 2.0f * c[2];
+    if (std::abs(a) > 1e-6f) {
+        const float discriminant = b * b - 4.0f * a * c[1];
+        if (discriminant > 0.0f) {
+            const float root = std::sqrt(discriminant);
+            addExtremum((-b - root) / (2.0f * a));
+            addExtremum((-b + root) / (2.0f * a));
+        }
+    } else if (std::abs(b) > 1e-6f) {
+        addExtremum(-c[1] / b);
+    }
+    if (numBounds == 3 && bounds[2] < bounds[1])
+        std::swap(bounds[1], bounds[2]);
+    bounds[size_t(numBounds)] = length;
+
+    for (int piece = 0; piece < numBounds; piece++) {
+        float s0 = bounds[size_t(piece)], s1 = bounds[size_t(piece + 1)];
+        float g0 = evaluateCubic(c, s0), g1 = evaluateCubic(c, s1);
+        if (g0 > 0.0f || g1 <= 0.0f)
+            continue;
+
+        // Illinois regula falsi on the monotonic piece.
+        static constexpr int maxIterations = 10;
+        float s = s0;
+        int side = 0;
+        for (int iteration = 0; iteration < maxIterations; iteration++) {
+            t_rayCost.bisectionIterations++;
+            s = (s0 * g1 - s1 * g0) / (g1 - g0);
+            const float g = evaluateCubic(c, s);
+            if (std::abs(g) < 1e-3f)
+                break;
+            if (g < 0.0f) {
+                s0 = s;
+                g0 = g;
+                if (side == -1)
+                    g1 *= 0.5f;
+                side = -1;
+            } else {
+                s1 = s;
+                g1 = g;
+                if (side == 1)
+                    g0 *= 0.5f;
+                side = 1;
             }
+        }
+        return s;
+    }
+    return -1.0f;
+}
 
+// Isosurface with trilinear interpolation: intersect the ray exactly with the trilinear interpolant of each cell.
+// Cells whose corners are all below the iso value cannot contain the surface and are skipped without solving.
+// Neighbouring cells share a face, so only the 4 corners on the far side need to be fetched after each step.
+std::optional<float> Renderer::findIsoSurfaceCellsLinear(const Ray& ray, float sampleStep) const
+{
+    const glm::ivec3 dims = m_pVolume->dims();
+    glm::ivec3 cell;
+    bool cellInside = false;
+    const auto fetchCorner = [&](int corner) {
+        const int x = cell.x + (corner & 1), y = cell.y + ((corner >> 1) & 1), z = cell.z + (corner >> 2);
+        return cellInside ? m_pVolume->getVoxel(x, y, z) : voxelOrZero(*m_pVolume, dims, glm::ivec3(x, y, z));
+    };
+
+    CellWalker walker { ray, 0.0f };
+    std::array<float, 8> corners;
+    cell = walker.cell();
+    for (int corner = 0; corner < 8; corner++)
+        corners[size_t(corner)] = fetchCorner(corner);
+
+    do {
+        cell = walker.cell();
+        // Only cells at the border of the volume need to bounds check their corners.
+        cellInside = cell.x >= 0 && cell.y >= 0 && cell.z >= 0 && cell.x + 1 < dims.x && cell.y + 1 < dims.y && cell.z + 1 < dims.z;
+        if (walker.lastAxis() >= 0) {
+            // Corners of the lower face (corner bit of the axis cleared) for each axis.
+            static constexpr std::array<std::array<int, 4>, 3> lowerFaces { { { 0, 2, 4, 6 }, { 0, 1, 4, 5 }, { 0, 1, 2, 3 } } };
+            const int axis = walker.lastAxis();
+            const bool stepUp = walker.lastStep() > 0;
+            for (const int lower : lowerFaces[size_t(axis)]) {
+                // The face that was crossed is reused, only the corners on the far side of the new cell are fetched.
+                const int upper = lower | (1 << axis);
+                const int reused = stepUp ? lower : upper;
+                const int fetched = stepUp ? upper : lower;
+                corners[size_t(reused)] = corners[size_t(fetched)];
+                corners[size_t(fetched)] = fetchCorner(fetched);
+            }
         }
+        t_rayCost.volumeSamples++;
+
+        if (*std::max_element(std::begin(corners), std::end(corners)) > m_config.isoValue) {
+            const float tEnter = walker.tEnter();
+            const glm::vec3 entry = ray.origin + tEnter * ray.direction - glm::vec3(cell);
+            const float s = cellIsoCrossing(corners, entry, ray.direction, walker.tExit() - tEnter, m_config.isoValue);
+            if (s >= 0.0f) {
+                countEarlyTermination(ray, tEnter + s, sampleStep);
+                return tEnter + s;
+            }
+        }
+    } while (walker.next());
 
-        return glm::vec4(glm::vec3(0.0f), 1.0f); // Return default color if no intersection found
+    return std::nullopt;
 }
 
-    
-    
+// Ray parameter of the k-th sample along the ray.
+static float sampleParameter(const Ray& ray, float sampleStep, int k)
+{
+    return ray.tmin + float(k) * sampleStep;
+}
 
+// Visit the samples t = ray.tmin + k * sampleStep (t <= ray.tmax) of a ray through a sparse volume front to back by
+// calling visit(firstSample, numSamples, value) until it returns false. The tiles along the ray are walked with a
+// CellWalker; the samples in a uniform tile are passed as a single run with the value of the tile, without sampling
+// them, and all other samples are sampled and passed one at a time. Consecutive runs of the same value are merged, so
+// a region of uniform tiles costs the ray function a single call.
+// The positions of the samples are computed from k instead of being stepped like in the dense ray functions, so that
+// a run costs the same regardless of its length. Every coordinate of the position is monotonic in k, so the samples
+// that lie in the (axis-aligned) part of a tile where the samples are uniform are contiguous: testing the first and
+// last sample of a run is exact.
+template <typename Function>
+static void traverseSparseVolume(const volume::SparseVolume& volume, volume::InterpolationMode interpolationMode, const Ray& ray, float sampleStep, Function&& visit)
+{
+    static constexpr int tileSize = volume::SparseVolume::tileSize;
+    int numSamples = 0;
+    if (ray.tmax >= ray.tmin) {
+        numSamples = int((ray.tmax - ray.tmin) / sampleStep) + 1;
+        while (sampleParameter(ray, sampleStep, numSamples) <= ray.tmax)
+            numSamples++;
+        while (numSamples > 0 && sampleParameter(ray, sampleStep, numSamples - 1) > ray.tmax)
+            numSamples--;
+    }
+
+    const bool nearest = interpolationMode == volume::InterpolationMode::NearestNeighbour;
+    const glm::vec3 dims { volume.dims() };
+    const glm::ivec3 numTiles = volume.numTiles();
+    const auto position = [&](int k) { return ray.origin + sampleParameter(ray, sampleStep, k) * ray.direction; };
+    int runStart = 0, runLength = 0;
+    float runValue = 0.0f;
+    const auto flushRun = [&]() {
+        const bool proceed = runLength == 0 || visit(runStart, runLength, runValue);
+        runLength = 0;
+        return proceed;
+    };
+    const auto visitRun = [&](int firstSample, int length, float value) {
+        if (runLength > 0 && value == runValue && runStart + runLength == firstSample) {
+            runLength += length;
+            return true;
+        }
+        if (!flushRun())
+            return false;
+        runStart = firstSample;
+        runLength = length;
+        runValue = value;
+        return true;
+    };
+    const auto visitSample = [&](int k) {
+        if (!flushRun())
+            return false;
+        t_rayCost.volumeSamples++;
+        return visit(k, 1, volume.getSampleInterpolate(position(k), interpolationMode));
+    };
+
+    // Nearest neighbour samples in [-0.5, tileSize - 0.5) and trilinear samples in [0, tileSize) relative to a tile
+    // read the voxels of that tile (and of the next tiles for the last voxel of trilinear samples).
+    const float cellOrigin = nearest ? -0.5f : 0.0f;
+    const Ray tileRay { (ray.origin - cellOrigin) / float(tileSize), ray.direction / float(tileSize), ray.tmin, ray.tmax };
+    CellWalker walker { tileRay, 0.0f };
+    int k = 0;
+    do {
+        const glm::ivec3 tileIndex = walker.cell();
+        const int exitSample = std::min(numSamples, int(std::ceil((walker.tExit() - ray.tmin) / sampleStep)));
+        const bool insideGrid = (tileIndex.x >= 0) & (tileIndex.y >= 0) & (tileIndex.z >= 0)
+            & (tileIndex.x < numTiles.x) & (tileIndex.y < numTiles.y) & (tileIndex.z < numTiles.z);
+        if (insideGrid && k < exitSample && volume.tile(tileIndex).leaf == volume::SparseVolume::uniformTile) {
+            const volume::SparseVolume::Tile& tile = volume.tile(tileIndex);
+            if (tile.uniformNeighbourhood) {
+                // The samples that the walker attributes to the tile lie at most a rounding error outside of it.
+                if (!visitRun(k, exitSample - k, tile.value))
+                    return;
+                k = exitSample;
+                continue;
+            }
+
+            // The samples in [lower, upper] (nearest neighbour: [lower, upper)) read only voxels of the uniform value.
+            // Same bounds tests and rounding as the samplers of the volume.
+            const glm::vec3 lower { tileIndex * tileSize };
+            const glm::vec3 upper = nearest ? glm::min(lower + float(tileSize), dims) : lower + float(tile.uniformCells ? tileSize : tileSize - 1);
+            const auto uniformSample = [&](int sample) {
+                const glm::vec3 p = position(sample);
+                if (nearest) {
+                    const glm::vec3 voxel = p + 0.5f;
+                    return (voxel.x >= lower.x) & (voxel.y >= lower.y) & (voxel.z >= lower.z)
+                        & (voxel.x < upper.x) & (voxel.y < upper.y) & (voxel.z < upper.z);
+                }
+                return (p.x >= lower.x) & (p.y >= lower.y) & (p.z >= lower.z) & (p.x <= upper.x) & (p.y <= upper.y) & (p.z <= upper.z)
+                    & (p.x + 1.0f < dims.x) & (p.y + 1.0f < dims.y) & (p.z + 1.0f < dims.z);
+            };
+
+            // Samples that the walker attributes to the tile but that read voxels of its neighbours come first or last.
+            for (; k < exitSample && !uniformSample(k); k++) {
+                if (!visitSample(k))
+                    return;
+            }
+            if (k < exitSample) {
+                int last = exitSample - 1;
+                while (!uniformSample(last))
+                    last--;
+                if (!visitRun(k, last - k + 1, tile.value))
+                    return;
+                k = last + 1;
+            }
+        }
+        for (; k < exitSample; k++) {
+            if (!visitSample(k))
+                return;
+        }
+    } while (walker.next());
+
+    for (; k < numSamples; k++) {
+        if (!visitSample(k))
+            return;
+    }
+    flushRun();
 }
 
-// Given that the iso value lies somewhere between t0 and t1, find a t for which the value
-// closely matches the iso value (less than 0.01 difference). Add a limit to the number of
-// iterations such that it does not get stuck in degerate cases.
-float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoValue) const
-{   
-    static constexpr int maxIterations = 30; // Maximum number of iterations
+bool Renderer::useSparseTraversal() const
+{
+    return m_config.sparseTraversal && m_pSparseVolume && m_pVolume->interpolationMode != volume::InterpolationMode::Cubic;
+}
 
-    float precision = 0.01f; // Precision of the result
-    
-    float a = t0; // Start of the interval
-    float b = t1; // End of the interval
-    float c;      // Midpoint of the interval
-    float fc;     // Function value at midpoint
+// Same as traceRayMIP; the samples in a uniform tile contribute its value once.
+glm::vec4 Renderer::traceRayMIPSparse(const Ray& ray, float sampleStep) const
+{
+    float maxVal = 0.0f;
+    traverseSparseVolume(*m_pSparseVolume, m_pVolume->interpolationMode, ray, sampleStep, [&](int, int, float value) {
+        maxVal = std::max(value, maxVal);
+        return true;
+    });
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
 
-    for (int iteration = 0; iteration < maxIterations; iteration++) {
-        c = (a + b) / 2.0f; // Compute the midpoint of the interval
+// Same as traceRayComposite. Uniform tiles that the transfer function makes transparent are skipped and, without
+// shading, the samples in other uniform tiles are composited at once: n samples of opacity a leave (1 - a)^n of the
+// transparency in front of them, and all of them have the same color.
+glm::vec4 Renderer::traceRayCompositeSparse(const Ray& ray, float sampleStep) const
+{
+    float accumulatedOpacity = 0.0f;
+    glm::vec4 accumulatedColor(0.0f);
+    traverseSparseVolume(*m_pSparseVolume, m_pVolume->interpolationMode, ray, sampleStep, [&](int firstSample, int numSamples, float value) {
+        const glm::vec4 tfValue = getTFValue(value);
+        const float tfOpacity = tfValue.a;
+        if (tfOpacity == 0.0f)
+            return true;
+
+        if (numSamples == 1 || m_config.volumeShading) {
+            for (int k = firstSample; k < firstSample + numSamples; k++) {
+                const float t = sampleParameter(ray, sampleStep, k);
+                glm::vec3 tfColor = glm::vec3(tfValue);
+                if (m_config.volumeShading) {
+                    const glm::vec3 precisePos = ray.origin + t * ray.direction;
+                    const volume::GradientVoxel gradient = sampleGradient(precisePos);
+                    const glm::vec3 V = glm::normalize(m_pCamera->position() - precisePos); // View vector
+                    const glm::vec3 L = glm::normalize(precisePos - ray.origin); // Light vector
+                    tfColor = computePhongShading(tfColor, gradient, L, V);
+                }
+
+                accumulatedColor += (1.0f - accumulatedOpacity) * tfOpacity * glm::vec4(tfColor, 1.0f);
+                accumulatedOpacity += (1.0f - accumulatedOpacity) * tfOpacity;
+                if (accumulatedOpacity >= 1.0f) {
+                    countEarlyTermination(ray, t, sampleStep);
+                    return false;
+                }
+            }
+            return true;
+        }
 
-        // Compute the value at the midpoint
-        fc = m_pVolume->getSampleInterpolate(ray.origin + c * ray.direction);
+        const float opacity = (1.0f - accumulatedOpacity) * (1.0f - std::pow(1.0f - tfOpacity, float(numSamples)));
+        accumulatedColor += opacity * glm::vec4(glm::vec3(tfValue), 1.0f);
+        accumulatedOpacity += opacity;
+        if (accumulatedOpacity >= 1.0f) {
+            countEarlyTermination(ray, sampleParameter(ray, sampleStep, firstSample + numSamples - 1), sampleStep);
+            return false;
+        }
+        return true;
+    });
+    return accumulatedColor;
+}
 
-        // Check if the value at midpoint is close enough to isoValue or if the interval is sufficiently small
-        if (std::abs(fc - isoValue) < precision || std::abs(b - a) < precision) {
-            break; // Terminate if close to desired value or interval is too small
+// Same as findIsoSurface. A uniform tile either lies below the iso value and is skipped, or its first sample is the
+// first one above the iso value.
+std::optional<float> Renderer::findIsoSurfaceSparse(const Ray& ray, float sampleStep) const
+{
+    std::optional<float> optHit;
+    float prevT = ray.tmin;
+    float prevVal = 0.0f;
+    traverseSparseVolume(*m_pSparseVolume, m_pVolume->interpolationMode, ray, sampleStep, [&](int firstSample, int numSamples, float value) {
+        const float t = sampleParameter(ray, sampleStep, firstSample);
+        if (value > m_config.isoValue) {
+            optHit = firstSample == 0 ? t : refineIsoCrossing(ray, prevT, t, prevVal, value, m_config.isoValue);
+            countEarlyTermination(ray, t, sampleStep);
+            return false;
         }
+        prevT = sampleParameter(ray, sampleStep, firstSample + numSamples - 1);
+        prevVal = value;
+        return true;
+    });
+    return optHit;
+}
 
-        // Narrow the search interval
-        if (fc < isoValue) {
-            a = c; // Value lies in the upper half
-        } else {
-            b = c; // Value lies in the lower half
+bool Renderer::useMaxPyramid() const
+{
+    return m_config.maxPyramidTraversal && m_optMaxPyramid && m_pVolume->interpolationMode != volume::InterpolationMode::Cubic;
+}
+
+// Same as traceRayMIP. The ray looks up a node of the pyramid whenever it leaves the previous one: the samples in a node
+// whose maximum does not exceed the maximum of the ray so far are stepped over without sampling them. The ray ends once
+// it reaches the maximum of the volume. The samples are stepped exactly like in traceRayMIP, so the result is the same.
+glm::vec4 Renderer::traceRayMIPPyramid(const Ray& ray, float sampleStep) const
+{
+    const volume::MaxPyramid& pyramid = *m_optMaxPyramid;
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+
+    // A ray along an axis with nearest neighbour interpolation samples a single column of voxels (all of them if its
+    // steps along the axis are at most a voxel long), whose maximum the pyramid holds.
+    const int numZero = int(ray.direction.x == 0.0f) + int(ray.direction.y == 0.0f) + int(ray.direction.z == 0.0f);
+    if (numZero == 2 && m_pVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour) {
+        const int axis = ray.direction.x != 0.0f ? 0 : (ray.direction.y != 0.0f ? 1 : 2);
+        const glm::ivec2 axes = volume::otherAxes(axis);
+        const glm::ivec3 dims = m_pVolume->dims();
+        const glm::vec3 exitPos = ray.origin + ray.tmax * ray.direction;
+        const float first = std::min(samplePos[axis], exitPos[axis]), last = std::max(samplePos[axis], exitPos[axis]);
+        const bool wholeColumn = first + 0.5f < 1.0f && last + 0.5f >= float(dims[axis] - 1) && std::abs(ray.direction[axis]) * sampleStep <= 1.0f;
+        if (wholeColumn) {
+            const glm::vec2 column = glm::vec2(samplePos[axes.x], samplePos[axes.y]) + 0.5f;
+            float maxVal = 0.0f;
+            if (column.x >= 0.0f && column.y >= 0.0f && column.x < float(dims[axes.x]) && column.y < float(dims[axes.y]))
+                maxVal = std::max(pyramid.columnMaximum(axis, int(column.x), int(column.y)), 0.0f);
+            return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
         }
     }
 
-    return c; // Return the midpoint of the interval
+    float maxVal = 0.0f;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    volume::RaySampler sampler { *m_pVolume, ray.direction };
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
+        if (maxVal >= pyramid.maximum()) {
+            countEarlyTermination(ray, t, sampleStep);
+            break;
+        }
+        const std::optional<volume::MaxPyramid::Node> optNode = pyramid.findNode(samplePos, maxVal);
+        if (!optNode) {
+            maxVal = std::max(sampleVolume(sampler, samplePos), maxVal);
+            continue;
+        }
+
+        // Visit the samples up to the last one in the node, so that the next iteration takes the first one past it (or
+        // ends the ray if one of them reached the maximum of the volume).
+        const bool skip = optNode->maximum <= maxVal;
+        while (true) {
+            if (!skip) {
+                maxVal = std::max(sampleVolume(sampler, samplePos), maxVal);
+                if (maxVal >= pyramid.maximum())
+                    break;
+            }
+            if (!(t + sampleStep <= ray.tmax && optNode->contains(samplePos + increment)))
+                break;
+            t += sampleStep;
+            samplePos += increment;
+        }
+    }
+
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+// Same samples as traceRayMIP, taken through a volume::RaySampler.
+glm::vec4 Renderer::traceRayMIPRaySampler(const Ray& ray, float sampleStep) const
+{
+    float maxVal = 0.0f;
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    volume::RaySampler sampler { *m_pVolume, ray.direction };
+    for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment)
+        maxVal = std::max(sampleVolume(sampler, samplePos), maxVal);
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+// The sampler for the samples of ray if RenderConfig::reuseCellCorners is set.
+std::optional<volume::RaySampler> Renderer::raySampler(const Ray& ray) const
+{
+    if (!m_config.reuseCellCorners)
+        return {};
+    return volume::RaySampler { *m_pVolume, ray.direction };
 }
 
 // ======= TODO: IMPLEMENT ========
@@ -292,30 +1315,22 @@ float Renderer::bisectionAccuracy(const Ray& ray, float t0, float t1, float isoV
 // Use the given color for the ambient/specular/diffuse (you are allowed to scale these constants by a scalar value).
 // You are free to choose any specular power that you'd like.
 glm::vec3 Renderer::computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& L, const glm::vec3& V)
-{   
-    float ka = 0.1f;
-    float kd = 0.7f;
-    float ks = 0.2f;
-    float alpha = 100.0f;
-
-    // ambient 
-    glm::vec3 ambient = ka * color;
-
-    // diffuse
-    float cos_theta = glm::dot(glm::normalize(gradient.dir), L);
-    glm::vec3 diffuse = (kd * color * std::abs(cos_theta));
-    
-    // check if diffuse contains nan
-    if (glm::any(glm::isnan(diffuse))) {
-        diffuse = glm::vec3(0.0f);
-    }
+{
+    // ambient
+    const glm::vec3 ambient = phongAmbient * color;
+
+    // diffuse; a zero gradient has no direction (0 / 0) and gets no diffuse light
+    const float projection = glm::dot(gradient.dir, L);
+    const float cosTheta = projection / std::sqrt(glm::dot(gradient.dir, gradient.dir));
+    const glm::vec3 diffuse = std::isnan(cosTheta) ? glm::vec3(0.0f) : phongDiffuse * color * std::abs(cosTheta);
 
-    // specular
-    float cos_phi = glm::dot(glm::normalize(glm::reflect(L, gradient.dir)), V);
-    glm::vec3 specular = ks * (glm::vec3(1.0)) * std::pow(std::abs(cos_phi), alpha);
+    // specular with a specular power of 100; the light vector is reflected about the (not normalized) gradient
+    const glm::vec3 R = L - gradient.dir * projection * 2.0f;
+    const float cosPhi = glm::dot(R, V) / std::sqrt(glm::dot(R, R));
+    const glm::vec3 specular { phongSpecular * power100(std::abs(cosPhi)) };
 
-    // return ambient;
-    return  (ambient + diffuse + specular);
+    // The shading kernels (kernels::KernelTable::shadeSurfaces) perform the same operations in the same order.
+    return ambient + diffuse + specular;
 }
 
 // ======= TODO: IMPLEMENT ========
@@ -336,9 +1351,10 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
     // The accumulated color along the ray.
     glm::vec4 accumulatedColor(0.0f);
 
+    std::optional<volume::RaySampler> optSampler = raySampler(ray);
     for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
         // Get the volume value at the current sample position.
-        const float val = m_pVolume->getSampleInterpolate(samplePos);
+        const float val = optSampler ? sampleVolume(*optSampler, samplePos) : sampleVolume(samplePos);
 
         // Get the color and opacity from the 1D transfer function.
         const glm::vec4 tfValue = getTFValue(val);
@@ -349,7 +1365,7 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
         {
             glm::vec3 precisePos = ray.origin + t * ray.direction;
 
-            volume::GradientVoxel gradient = m_pGradientVolume->getGradientInterpolate(precisePos);
+            volume::GradientVoxel gradient = sampleGradient(precisePos);
             glm::vec3 V = glm::normalize(m_pCamera->position() - precisePos); // View vector
             glm::vec3 L = glm::normalize(precisePos - ray.origin ); // Light vector
 
@@ -361,14 +1377,93 @@ glm::vec4 Renderer::traceRayComposite(const Ray& ray, float sampleStep) const
         accumulatedOpacity += (1.0f - accumulatedOpacity) * tfOpacity;
 
         // If the accumulated opacity is 1.0f then we can stop tracing the ray.
-        if (accumulatedOpacity >= 1.0f)
+        if (accumulatedOpacity >= 1.0f) {
+            countEarlyTermination(ray, t, sampleStep);
             break;
+        }
     }
 
     // Return the accumulated color.
     return accumulatedColor;
 }
 
+// Sample the volume and count the sample towards the cost of the current ray.
+float Renderer::sampleVolume(const glm::vec3& coord) const
+{
+    t_rayCost.volumeSamples++;
+    return m_volumeSampler(coord);
+}
+
+// Sample the volume through the sampler of the current ray, which reuses voxels between consecutive samples.
+float Renderer::sampleVolume(volume::RaySampler& sampler, const glm::vec3& coord) const
+{
+    t_rayCost.volumeSamples++;
+    return sampler.sample(coord);
+}
+
+// Sample the gradient volume and count the fetch towards the cost of the current ray.
+volume::GradientVoxel Renderer::sampleGradient(const glm::vec3& coord) const
+{
+    t_rayCost.gradientFetches++;
+    return m_pGradientVolume->getGradientInterpolate(coord);
+}
+
+// Sample the volume (with trilinear interpolation) at every position of the block. The fixed-point kernel blends the
+// voxels as signed 16-bit integers, so it is not used for uint16 volumes with values of 32768 and above.
+void Renderer::sampleVolume(const kernels::KernelTable& kernels, const SampleBlock& block, float* values) const
+{
+    t_rayCost.volumeSamples += uint32_t(block.count);
+    const glm::ivec3 dims = m_pVolume->dims();
+    const volume::VoxelType voxelType = m_pVolume->voxelType();
+    kernels::VolumeView volume { m_pVolume->rawData(), voxelType, { dims.x, dims.y, dims.z } };
+    const float* zs = block.z.data();
+
+    // The kernels compute voxel indices in 32 bits. The samples of a block lie close together, so in volumes of 2^31
+    // voxels and more the block is sampled relative to the lowest slice that it touches. Subtracting a whole number
+    // of slices from z is exact, so the results do not change.
+    std::array<float, SampleBlock::capacity> relativeZs;
+    static constexpr size_t maxKernelIndex = size_t(std::numeric_limits<int32_t>::max());
+    if (m_pVolume->numVoxels() > maxKernelIndex) {
+        const auto [minZ, maxZ] = std::minmax_element(std::begin(block.z), std::begin(block.z) + block.count);
+        const int firstSlice = std::clamp(int(*minZ), 0, dims.z);
+        const size_t sliceSize = size_t(dims.x) * size_t(dims.y);
+        // The cells of the samples reach up to 2 slices above their slice.
+        const size_t numSlices = size_t(std::clamp(*maxZ - float(firstSlice), 0.0f, float(dims.z))) + 2;
+        if (numSlices * sliceSize > maxKernelIndex) {
+            for (int i = 0; i < block.count; i++)
+                values[i] = m_volumeSampler(glm::vec3(block.x[size_t(i)], block.y[size_t(i)], block.z[size_t(i)]));
+            return;
+        }
+        for (int i = 0; i < block.count; i++)
+            relativeZs[size_t(i)] = block.z[size_t(i)] - float(firstSlice);
+        volume.data = static_cast<const std::byte*>(volume.data) + size_t(firstSlice) * sliceSize * volume::voxelSize(voxelType);
+        volume.dims[2] = dims.z - firstSlice;
+        zs = relativeZs.data();
+    }
+
+    if (m_config.fixedPointInterpolation && (voxelType != volume::VoxelType::UInt16 || m_pVolume->maximum() < 32768.0f))
+        kernels.sampleTrilinearFixed(volume, block.x.data(), block.y.data(), zs, block.count, values);
+    else
+        kernels.sampleTrilinear(volume, block.x.data(), block.y.data(), zs, block.count, values);
+}
+
+// Sample the gradient volume at every position of the block. The kernels only implement trilinear interpolation,
+// which the gradient volume also uses for tri-cubic.
+void Renderer::sampleGradients(const kernels::KernelTable& kernels, const SampleBlock& block, volume::GradientVoxel* gradients) const
+{
+    if (m_pGradientVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour) {
+        for (int i = 0; i < block.count; i++)
+            gradients[i] = sampleGradient(glm::vec3(block.x[size_t(i)], block.y[size_t(i)], block.z[size_t(i)]));
+        return;
+    }
+
+    static_assert(sizeof(volume::GradientVoxel) == 4 * sizeof(float));
+    t_rayCost.gradientFetches += uint32_t(block.count);
+    const glm::ivec3 dims = m_pGradientVolume->dims();
+    const kernels::GradientView view { reinterpret_cast<const float*>(m_pGradientVolume->data().data()), { dims.x, dims.y, dims.z } };
+    kernels.sampleGradients(view, block.x.data(), block.y.data(), block.z.data(), block.count, reinterpret_cast<float*>(gradients));
+}
+
 // ======= DO NOT MODIFY THIS FUNCTION ========
 // Looks up the color+opacity corresponding to the given volume value from the 1D tranfer function LUT (m_config.tfColorMap).
 // The value will initially range from (m_config.tfColorMapIndexStart) to (m_config.tfColorMapIndexStart + m_config.tfColorMapIndexRange) .
@@ -390,10 +1485,11 @@ glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep) const
     const glm::vec3 increment = sampleStep * ray.direction;
     float accumulatedOpacity = 0.0f;
 
+    std::optional<volume::RaySampler> optSampler = raySampler(ray);
     for (float t = ray.tmin; t <= ray.tmax; t += sampleStep, samplePos += increment) {
 
-        auto val = m_pVolume->getSampleInterpolate(samplePos);
-        auto gradient = m_pGradientVolume->getGradientInterpolate(samplePos);
+        auto val = optSampler ? sampleVolume(*optSampler, samplePos) : sampleVolume(samplePos);
+        auto gradient = sampleGradient(samplePos);
         auto magnitude = gradient.magnitude;
 
         const float tfOpacity = getTF2DOpacity(val, magnitude);
@@ -402,6 +1498,7 @@ glm::vec4 Renderer::traceRayTF2D(const Ray& ray, float sampleStep) const
 
         if (accumulatedOpacity >= 1.0f){
             accumulatedOpacity = 1.0f;
+            countEarlyTermination(ray, t, sampleStep);
             break;
         }
     }
@@ -432,6 +1529,120 @@ float Renderer::getTF2DOpacity(float intensity, float gradientMagnitude) const
 }
 
 
+// Fill the block with the next samples along the ray. The samples are stepped exactly like in the scalar ray
+// functions (t += sampleStep, samplePos += increment) so that both sample the volume at the same positions.
+// Returns false once the ray has left the volume.
+static bool nextSampleBlock(SampleBlock& block, float& t, glm::vec3& samplePos, const glm::vec3& increment, float sampleStep, float tmax)
+{
+    block.count = 0;
+    for (; block.count < SampleBlock::capacity && t <= tmax; block.count++, t += sampleStep, samplePos += increment) {
+        const size_t i = size_t(block.count);
+        block.t[i] = t;
+        block.x[i] = samplePos.x;
+        block.y[i] = samplePos.y;
+        block.z[i] = samplePos.z;
+    }
+    return block.count > 0;
+}
+
+// Same as traceRayMIP.
+glm::vec4 Renderer::traceRayMIPKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const
+{
+    float maxVal = 0.0f;
+
+    float t = ray.tmin;
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    SampleBlock block;
+    std::array<float, SampleBlock::capacity> values;
+    while (nextSampleBlock(block, t, samplePos, increment, sampleStep, ray.tmax)) {
+        sampleVolume(kernels, block, values.data());
+        maxVal = kernels.maximum(values.data(), block.count, maxVal);
+    }
+
+    return glm::vec4(glm::vec3(maxVal) / m_pVolume->maximum(), 1.0f);
+}
+
+// Same as traceRayComposite. Shading stays scalar and is applied to the transfer function colors of the block
+// before they are composited. When the opacity saturates, the rest of the block has been sampled in vain.
+glm::vec4 Renderer::traceRayCompositeKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const
+{
+    static_assert(sizeof(glm::vec4) == 4 * sizeof(float));
+    const kernels::TransferFunctionView tf {
+        reinterpret_cast<const float*>(m_config.tfColorMap.data()), int(m_config.tfColorMap.size()),
+        m_config.tfColorMapIndexStart, m_config.tfColorMapIndexRange
+    };
+
+    float accumulatedOpacity = 0.0f;
+    glm::vec4 accumulatedColor(0.0f);
+
+    float t = ray.tmin;
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    SampleBlock block, shadingBlock;
+    std::array<float, SampleBlock::capacity> values;
+    std::array<glm::vec4, SampleBlock::capacity> colors;
+    std::array<volume::GradientVoxel, SampleBlock::capacity> gradients;
+    while (nextSampleBlock(block, t, samplePos, increment, sampleStep, ray.tmax)) {
+        sampleVolume(kernels, block, values.data());
+        kernels.lookupTransferFunction(tf, values.data(), block.count, reinterpret_cast<float*>(colors.data()));
+
+        if (m_config.volumeShading) {
+            // Like traceRayComposite, shade at ray.origin + t * ray.direction rather than at the stepped position.
+            shadingBlock.count = block.count;
+            for (size_t i = 0; i < size_t(block.count); i++) {
+                const glm::vec3 precisePos = ray.origin + block.t[i] * ray.direction;
+                shadingBlock.x[i] = precisePos.x;
+                shadingBlock.y[i] = precisePos.y;
+                shadingBlock.z[i] = precisePos.z;
+            }
+            sampleGradients(kernels, shadingBlock, gradients.data());
+            for (size_t i = 0; i < size_t(block.count); i++) {
+                const glm::vec3 precisePos { shadingBlock.x[i], shadingBlock.y[i], shadingBlock.z[i] };
+                const glm::vec3 V = glm::normalize(m_pCamera->position() - precisePos); // View vector
+                const glm::vec3 L = glm::normalize(precisePos - ray.origin); // Light vector
+                colors[i] = glm::vec4(computePhongShading(glm::vec3(colors[i]), gradients[i], L, V), colors[i].a);
+            }
+        }
+
+        const int composited = kernels.composite(reinterpret_cast<const float*>(colors.data()), block.count, &accumulatedColor.x, &accumulatedOpacity);
+        if (accumulatedOpacity >= 1.0f) {
+            countEarlyTermination(ray, block.t[size_t(composited - 1)], sampleStep);
+            break;
+        }
+    }
+
+    return accumulatedColor;
+}
+
+// Same as traceRayTF2D; the opacities are accumulated one sample at a time.
+glm::vec4 Renderer::traceRayTF2DKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const
+{
+    float accumulatedOpacity = 0.0f;
+
+    float t = ray.tmin;
+    glm::vec3 samplePos = ray.origin + ray.tmin * ray.direction;
+    const glm::vec3 increment = sampleStep * ray.direction;
+    SampleBlock block;
+    std::array<float, SampleBlock::capacity> values;
+    std::array<volume::GradientVoxel, SampleBlock::capacity> gradients;
+    while (nextSampleBlock(block, t, samplePos, increment, sampleStep, ray.tmax)) {
+        sampleVolume(kernels, block, values.data());
+        sampleGradients(kernels, block, gradients.data());
+        for (size_t i = 0; i < size_t(block.count); i++) {
+            const float tfOpacity = getTF2DOpacity(values[i], gradients[i].magnitude);
+            accumulatedOpacity += (1.0f - accumulatedOpacity) * tfOpacity * m_config.TF2DColor.a;
+            if (accumulatedOpacity >= 1.0f) {
+                accumulatedOpacity = 1.0f;
+                countEarlyTermination(ray, block.t[i], sampleStep);
+                return m_config.TF2DColor * accumulatedOpacity;
+            }
+        }
+    }
+
+    return m_config.TF2DColor * accumulatedOpacity;
+}
+
 // This function computes if a ray intersects with the axis-aligned bounding box around the volume.
 // If the ray intersects then tmin/tmax are set to the distance at which the ray hits/exists the
 // volume and true is returned. If the ray misses the volume the the function returns false.
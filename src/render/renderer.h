@@ -1,16 +1,30 @@
 #pragma once
+#include "render/kernels.h"
 #include "render/ray.h"
+#include "render/ray_cost.h"
 #include "render/ray_trace_camera.h"
 #include "render/render_config.h"
+#include "render/render_stats.h"
+#include "render/shear_warp.h"
+#include "render/splatting.h"
 #include "volume/gradient_volume.h"
+#include "volume/ray_sampler.h"
+#include "volume/max_pyramid.h"
+#include "volume/sparse_volume.h"
 #include "volume/volume.h"
 #include <cstring> // memcmp
 #include <glm/mat4x4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <gsl/span>
 #include <memory>
+#include <optional>
+#include <tbb/enumerable_thread_specific.h>
 #include <tuple>
 #include <vector>
 
@@ -24,8 +38,40 @@ union Bounds {
     std::array<glm::vec3, 2> lowerUpper;
 };
 
+// Which tiles of the framebuffer have been traced during a deadline-driven render (see Renderer::render(deadline)).
+// Tiles are tileSize x tileSize pixels and stored in row-major order.
+struct TileMask {
+    static constexpr int tileSize = 32;
+
+    glm::ivec2 numTiles { 0 };
+    std::vector<uint8_t> complete;
+
+    bool allComplete() const;
+};
+
+// Consecutive samples along a ray that are processed together by the SIMD kernels (see render/kernels.h).
+struct SampleBlock {
+    static constexpr int capacity = 32;
+
+    int count { 0 };
+    // Ray parameter and position of each sample.
+    std::array<float, capacity> t, x, y, z;
+};
+
+// Isosurface hits of every pixel, traced by the ISO render mode and shaded in a separate pass (see
+// Renderer::shadeIsoSurfaces). Positions and gradients are stored as separate x, y and z arrays for the SIMD kernels.
+struct GBuffer {
+    std::vector<kernels::SurfaceHit> hit;
+    std::array<std::vector<float>, 3> position;
+    std::array<std::vector<float>, 3> gradient;
+
+    void resize(size_t numPixels);
+};
+
 class Renderer {
 public:
+    using Clock = std::chrono::steady_clock;
+
     Renderer(
         const volume::Volume* pVolume,
         const volume::GradientVolume* pGradientVolume,
@@ -33,8 +79,16 @@ public:
         const RenderConfig& config);
 
     void setConfig(const RenderConfig& config);
+    // Sparse copy of the volume for RenderConfig::sparseTraversal, or nullptr to build one from the volume on first use
+    // (see RenderConfig::sparseTraversal).
+    void setSparseVolume(const volume::SparseVolume* pSparseVolume);
     void render();
+    const TileMask& render(Clock::time_point deadline);
+    const TileMask& continueRender(Clock::time_point deadline);
     gsl::span<const glm::vec4> frameBuffer() const;
+    gsl::span<const glm::vec4> costHeatmap();
+    // Statistics of the last call to render() / render(deadline) / continueRender().
+    const RenderStats& stats() const;
 
 protected:
     // These functions will be automatically tested.
@@ -49,9 +103,92 @@ protected:
     static glm::vec3 computePhongShading(const glm::vec3& color, const volume::GradientVoxel& gradient, const glm::vec3& lightDirection, const glm::vec3& viewDirection);
 
 private:
+    // Per-frame constants shared by all pixels.
+    struct FrameContext {
+        glm::vec3 planeNormal;
+        glm::vec3 volumeCenter;
+        Bounds bounds;
+        // Kernels for the MIP, composite and 2D transfer function rays, or nullptr to trace them one sample at a time.
+        const kernels::KernelTable* pKernels;
+    };
+    // The deadline-driven renders do not wait for the acceleration structures that are being built (see
+    // m_futureMaxPyramid), and trace without them until they are ready.
+    FrameContext frameContext(bool waitForBuilds);
+    bool generatePixelRay(int x, int y, const FrameContext& frame, Ray& ray) const;
+    glm::vec4 tracePixel(int x, int y, const FrameContext& frame) const;
+    void renderPixel(int x, int y, const FrameContext& frame, RenderStats& stats);
+    void renderTile(int tile, const FrameContext& frame);
+    void beginStats();
+    void endStats(std::chrono::duration<double> renderTime);
+    void renderCoarse(const FrameContext& frame);
+    void fillPixels(const FrameContext& frame, const std::function<glm::vec4(int, int, const Ray&)>& pixelColor);
+    // Object-order rendering of orthographic MIP and compositing views (RenderBackend::ShearWarp), in shear_warp.cpp.
+    bool useShearWarp() const;
+    void renderShearWarp(const FrameContext& frame);
+    // Object-order rendering of MIP and compositing views with any camera (RenderBackend::Splatting), in splatting.cpp.
+    bool useSplatting() const;
+    void renderSplatting(const FrameContext& frame);
+    // Voxels with values below it do not contribute to MIP and compositing.
+    float transparencyThreshold() const;
+    float refineIsoCrossing(const Ray& ray, float t0, float t1, float v0, float v1, float isoValue) const;
+    glm::vec4 shadeIsoSurface(const Ray& ray, float t) const;
+    glm::vec4 shadeIsoSurfacePoint(const glm::vec3& position, const volume::GradientVoxel& gradient, const glm::vec3& light) const;
+
+    // The ISO render mode traces the isosurface hits into m_gBuffer and shades them in a separate pass, so that
+    // changes to the shading alone (RenderConfig::volumeShading and RenderConfig::isoColor) do not trace again.
+    struct IsoSurfaceKey {
+        // Render config without the fields that only affect the shading.
+        RenderConfig config;
+        // Rays through the corners of the screen, which change whenever the camera does.
+        std::array<Ray, 4> cornerRays;
+        volume::InterpolationMode interpolationMode;
+        volume::InterpolationMode gradientInterpolationMode;
+
+        bool operator==(const IsoSurfaceKey& other) const;
+    };
+    IsoSurfaceKey isoSurfaceKey() const;
+    bool isoSurfaceTraced() const;
+    std::optional<float> traceIsoSurface(const Ray& ray, float sampleStep) const;
+    std::optional<float> findIsoSurface(const Ray& ray, float sampleStep) const;
+    void traceIsoSurfacePixel(int x, int y, const FrameContext& frame);
+    void shadeIsoSurfaces();
+    void shadeIsoSurfaces(size_t begin, size_t end);
+
+    // Exact cell-by-cell variants of the ray functions (RenderConfig::cellTraversal).
+    glm::vec4 traceRayMIPCells(const Ray& ray) const;
+    std::optional<float> findIsoSurfaceCellsNearest(const Ray& ray, float sampleStep) const;
+    std::optional<float> findIsoSurfaceCellsLinear(const Ray& ray, float sampleStep) const;
+
+    // Variants of the ray functions that skip the uniform tiles of m_pSparseVolume (RenderConfig::sparseTraversal).
+    bool useSparseTraversal() const;
+    glm::vec4 traceRayMIPSparse(const Ray& ray, float sampleStep) const;
+    glm::vec4 traceRayCompositeSparse(const Ray& ray, float sampleStep) const;
+    std::optional<float> findIsoSurfaceSparse(const Ray& ray, float sampleStep) const;
+
+    // Variant of traceRayMIP that skips the parts of the volume that cannot raise the maximum of the ray
+    // (RenderConfig::maxPyramidTraversal).
+    bool useMaxPyramid() const;
+    glm::vec4 traceRayMIPPyramid(const Ray& ray, float sampleStep) const;
+
+    // Variant of traceRayMIP that samples through a volume::RaySampler (RenderConfig::reuseCellCorners). The composite
+    // and 2D transfer function rays take the sampler from raySampler.
+    glm::vec4 traceRayMIPRaySampler(const Ray& ray, float sampleStep) const;
+    std::optional<volume::RaySampler> raySampler(const Ray& ray) const;
+
+    // Variants of the ray functions that process blocks of samples with the SIMD kernels (RenderConfig::simdLevel).
+    glm::vec4 traceRayMIPKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const;
+    glm::vec4 traceRayCompositeKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const;
+    glm::vec4 traceRayTF2DKernels(const Ray& ray, float sampleStep, const kernels::KernelTable& kernels) const;
+
     void resizeImage(const glm::ivec2& resolution);
     void resetImage();
 
+    float sampleVolume(const glm::vec3& coord) const;
+    float sampleVolume(volume::RaySampler& sampler, const glm::vec3& coord) const;
+    volume::GradientVoxel sampleGradient(const glm::vec3& coord) const;
+    void sampleVolume(const kernels::KernelTable& kernels, const SampleBlock& block, float* values) const;
+    void sampleGradients(const kernels::KernelTable& kernels, const SampleBlock& block, volume::GradientVoxel* gradients) const;
+
     glm::vec4 getTFValue(float val) const;
     float getTF2DOpacity(float val, float gradientMagnitude) const;
 
@@ -62,9 +199,49 @@ protected:
     const volume::Volume* m_pVolume;
     const volume::GradientVolume* m_pGradientVolume;
     const render::RayTraceCamera* m_pCamera;
+    const volume::SparseVolume* m_pSparseVolume { nullptr };
     RenderConfig m_config;
+    // Samples m_pVolume with its interpolation mode and voxel type, resolved at the start of every frame.
+    volume::Volume::Sampler m_volumeSampler;
 
     std::vector<glm::vec4> m_frameBuffer;
+    // Whether m_frameBuffer holds a previous frame at the current resolution that untraced tiles can fall back to.
+    bool m_frameBufferValid { false };
+
+    TileMask m_tileMask;
+    // Tile indices sorted by distance to the center of the screen.
+    std::vector<int> m_tilePriority;
+
+    // The volume encoded for shear-warp along each principal axis, built on first use and again whenever the values
+    // that are transparent change; and the intermediate image of the last shear-warp frame.
+    std::array<std::optional<RunLengthVolume>, 3> m_runLengthVolumes;
+    std::vector<glm::vec4> m_intermediateImage;
+    // The bricks of the volume for RenderBackend::Splatting, built on first use, and the partial image of every group
+    // of bricks of the last splatting frame.
+    std::optional<VolumeBricks> m_optVolumeBricks;
+    std::vector<std::vector<glm::vec4>> m_partialImages;
+    // The maxima of the volume for RenderConfig::maxPyramidTraversal, built on first use.
+    std::optional<volume::MaxPyramid> m_optMaxPyramid;
+    // The sparse copy of the volume for RenderConfig::sparseTraversal, built on first use if setSparseVolume did not
+    // provide one.
+    std::optional<volume::SparseVolume> m_optSparseVolume;
+    // The builds of the structures above on a background thread, so that the deadline-driven renders stay within their
+    // frame time. After the structures, so that destruction waits for the builds before the structures are destroyed.
+    std::future<volume::MaxPyramid> m_futureMaxPyramid;
+    std::future<volume::SparseVolume> m_futureSparseVolume;
+
+    // Per-pixel cost of the last frame; only allocated while the cost heatmap is enabled.
+    std::vector<RayCost> m_costBuffer;
+    std::vector<glm::vec4> m_costHeatmap;
+
+    // Isosurface hits of the ISO render mode; only allocated in that mode. m_optIsoSurfaceKey is set once every
+    // pixel of m_gBuffer has been traced.
+    GBuffer m_gBuffer;
+    std::optional<IsoSurfaceKey> m_optIsoSurfaceKey;
+
+    // Statistics are accumulated per thread and combined at the end of the frame (no atomics while tracing).
+    tbb::enumerable_thread_specific<RenderStats> m_threadStats;
+    RenderStats m_stats;
 };
 
 }
@@ -0,0 +1,322 @@
+#include "shear_warp.h"
+#include "parallelism.h"
+#include "renderer.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace render {
+
+glm::vec2 ShearWarpFactorization::sliceOffset(int slice) const
+{
+    return origin + float(slice) * shear;
+}
+
+glm::vec2 ShearWarpFactorization::project(const glm::vec3& point) const
+{
+    return glm::vec2(point[uAxis], point[vAxis]) + point[axis] * shear + origin;
+}
+
+ShearWarpFactorization factorizeView(const glm::vec3& direction, const glm::ivec3& dims)
+{
+    const glm::vec3 d = glm::normalize(direction);
+    const glm::vec3 absD = glm::abs(d);
+    ShearWarpFactorization out {};
+    out.axis = absD.x >= absD.y && absD.x >= absD.z ? 0 : (absD.y >= absD.z ? 1 : 2);
+    const glm::ivec2 axes = volume::otherAxes(out.axis);
+    out.uAxis = axes.x;
+    out.vAxis = axes.y;
+    out.numSlices = dims[out.axis];
+    out.reversed = d[out.axis] < 0.0f;
+
+    // A ray moves by d / d[axis] from one slice to the next, so the slices shift by the opposite amount to keep it on
+    // the same intermediate pixel. The origin keeps all offsets positive.
+    out.shear = -glm::vec2(d[out.uAxis], d[out.vAxis]) / d[out.axis];
+    const glm::vec2 extent = out.shear * float(out.numSlices - 1);
+    out.origin = glm::max(-extent, glm::vec2(0.0f));
+    out.imageSize = glm::ivec2(dims[out.uAxis], dims[out.vAxis]) + glm::ivec2(glm::ceil(glm::abs(extent))) + 1;
+    out.sliceDistance = 1.0f / absD[out.axis];
+    return out;
+}
+
+RunLengthVolume::RunLengthVolume(const volume::Volume& volume, int axis, float threshold)
+    : m_axis(axis)
+    , m_threshold(threshold)
+{
+    PROFILE_ZONE("RunLengthVolume");
+    const glm::ivec3 dims = volume.dims();
+    const glm::ivec2 axes = volume::otherAxes(axis);
+    m_sliceSize = glm::ivec2(dims[axes.x], dims[axes.y]);
+    m_slices.resize(size_t(dims[axis]));
+
+    const std::array<size_t, 3> strides { 1, size_t(dims.x), size_t(dims.x) * size_t(dims.y) };
+    const size_t strideU = strides[size_t(axes.x)], strideV = strides[size_t(axes.y)], strideS = strides[size_t(axis)];
+    const size_t sliceVoxels = size_t(m_sliceSize.x) * size_t(m_sliceSize.y);
+    std::vector<float> minTransparent(m_slices.size(), std::numeric_limits<float>::max());
+
+    volume::withVoxelType(volume.voxelType(), [&](auto type) {
+        using T = decltype(type);
+        const gsl::span<const T> voxels = volume.data<T>();
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, m_slices.size()), [&](const tbb::blocked_range<size_t>& range) {
+            // Opaque voxels of the slice, dilated along u and then along v.
+            std::vector<uint8_t> opaque(sliceVoxels), dilatedU(sliceVoxels), kept(sliceVoxels);
+            for (size_t s = range.begin(); s != range.end(); s++) {
+                const T* pSlice = voxels.data() + s * strideS;
+                for (int v = 0; v < m_sliceSize.y; v++) {
+                    for (int u = 0; u < m_sliceSize.x; u++) {
+                        const float value = float(pSlice[size_t(u) * strideU + size_t(v) * strideV]);
+                        const bool isOpaque = !(value < threshold);
+                        if (!isOpaque)
+                            minTransparent[s] = std::min(minTransparent[s], value);
+                        opaque[size_t(u) + size_t(m_sliceSize.x) * size_t(v)] = isOpaque;
+                    }
+                }
+                for (int v = 0; v < m_sliceSize.y; v++) {
+                    const uint8_t* pRow = &opaque[size_t(m_sliceSize.x) * size_t(v)];
+                    for (int u = 0; u < m_sliceSize.x; u++) {
+                        const bool left = u > 0 && pRow[u - 1], right = u + 1 < m_sliceSize.x && pRow[u + 1];
+                        dilatedU[size_t(u) + size_t(m_sliceSize.x) * size_t(v)] = pRow[u] || left || right;
+                    }
+                }
+                for (int v = 0; v < m_sliceSize.y; v++) {
+                    for (int u = 0; u < m_sliceSize.x; u++) {
+                        const size_t i = size_t(u) + size_t(m_sliceSize.x) * size_t(v);
+                        const bool below = v > 0 && dilatedU[i - size_t(m_sliceSize.x)], above = v + 1 < m_sliceSize.y && dilatedU[i + size_t(m_sliceSize.x)];
+                        kept[i] = dilatedU[i] || below || above;
+                    }
+                }
+
+                Slice& slice = m_slices[s];
+                slice.rowBegin.resize(size_t(m_sliceSize.y) + 1);
+                for (int v = 0; v < m_sliceSize.y; v++) {
+                    slice.rowBegin[size_t(v)] = uint32_t(slice.runs.size());
+                    const uint8_t* pKept = &kept[size_t(m_sliceSize.x) * size_t(v)];
+                    for (int u = 0; u < m_sliceSize.x;) {
+                        if (!pKept[u]) {
+                            u++;
+                            continue;
+                        }
+                        Run run { u, u, slice.values.size() };
+                        for (; run.end < m_sliceSize.x && pKept[run.end]; run.end++)
+                            slice.values.push_back(float(pSlice[size_t(run.end) * strideU + size_t(v) * strideV]));
+                        slice.runs.push_back(run);
+                        u = run.end;
+                    }
+                }
+                slice.rowBegin.back() = uint32_t(slice.runs.size());
+            }
+        });
+    });
+
+    // Without transparent voxels every voxel is kept, and the value is only read with a weight of 0.
+    const auto minValue = std::min_element(std::begin(minTransparent), std::end(minTransparent));
+    if (minValue != std::end(minTransparent) && *minValue < threshold)
+        m_transparentValue = *minValue;
+}
+
+int RunLengthVolume::axis() const
+{
+    return m_axis;
+}
+
+float RunLengthVolume::threshold() const
+{
+    return m_threshold;
+}
+
+glm::ivec2 RunLengthVolume::sliceSize() const
+{
+    return m_sliceSize;
+}
+
+int RunLengthVolume::numSlices() const
+{
+    return int(m_slices.size());
+}
+
+gsl::span<const RunLengthVolume::Run> RunLengthVolume::runs(int slice, int row) const
+{
+    const Slice& s = m_slices[size_t(slice)];
+    return gsl::span<const Run>(s.runs.data() + s.rowBegin[size_t(row)], s.rowBegin[size_t(row) + 1] - s.rowBegin[size_t(row)]);
+}
+
+const float* RunLengthVolume::values(int slice) const
+{
+    return m_slices[size_t(slice)].values.data();
+}
+
+float RunLengthVolume::transparentValue() const
+{
+    return m_transparentValue;
+}
+
+size_t RunLengthVolume::numStoredVoxels() const
+{
+    size_t out = 0;
+    for (const Slice& slice : m_slices)
+        out += slice.values.size();
+    return out;
+}
+
+bool Renderer::useShearWarp() const
+{
+    return m_config.renderBackend == RenderBackend::ShearWarp && m_pCamera->orthographic() && !m_config.showCostHeatmap
+        && (m_config.renderMode == RenderMode::RenderMIP || m_config.renderMode == RenderMode::RenderComposite);
+}
+
+// Shear-warp rendering (see render/shear_warp.h): the slices of the volume along the principal axis are composited
+// front to back into an intermediate image that is aligned with the slices, which is then warped onto the framebuffer.
+// The voxels are read in memory order, a row of a slice at a time, and only the runs of voxels that can contribute are
+// read at all. Samples lie on the slices, at (bilinear) intermediate pixels, instead of at fixed steps along the rays,
+// so the image is close to but not the same as the ray cast image. Cubic interpolation is done bilinearly as well.
+void Renderer::renderShearWarp(const FrameContext& frame)
+{
+    PROFILE_ZONE("Renderer::renderShearWarp");
+    const Ray centerRay = m_pCamera->generateRay(glm::vec2(0.0f));
+    const ShearWarpFactorization view = factorizeView(centerRay.direction, m_pVolume->dims());
+    const bool mip = m_config.renderMode == RenderMode::RenderMIP;
+    const bool nearest = m_pVolume->interpolationMode == volume::InterpolationMode::NearestNeighbour;
+
+    // The transfer function as looked up by getTFValue, with the opacities corrected for the distance between the
+    // slices (traceRayComposite takes a sample every unit).
+    auto sliceTF = m_config.tfColorMap;
+    for (glm::vec4& tfValue : sliceTF)
+        tfValue.a = 1.0f - std::pow(1.0f - tfValue.a, view.sliceDistance);
+    const auto lookupTF = [&](float value) {
+        const float range01 = (value - m_config.tfColorMapIndexStart) / m_config.tfColorMapIndexRange;
+        return sliceTF[std::min(static_cast<size_t>(range01 * static_cast<float>(sliceTF.size())), sliceTF.size() - 1)];
+    };
+
+    const float threshold = transparencyThreshold();
+    std::optional<RunLengthVolume>& optEncoded = m_runLengthVolumes[size_t(view.axis)];
+    if (!optEncoded || optEncoded->threshold() != threshold)
+        optEncoded.emplace(*m_pVolume, view.axis, threshold);
+    const RunLengthVolume& encoded = *optEncoded;
+
+    // Composite the slices. The rows of the intermediate image are independent, so every slice is composited in
+    // parallel over its rows. The two rows of voxels that a row of the intermediate image samples are decoded into
+    // buffers that hold the transparent value wherever voxels were left out.
+    const glm::ivec2 sliceSize = encoded.sliceSize();
+    m_intermediateImage.assign(size_t(view.imageSize.x) * size_t(view.imageSize.y), glm::vec4(0.0f));
+    const size_t bufferSize = size_t(sliceSize.x) + 2;
+    tbb::enumerable_thread_specific<std::vector<float>> rowBuffers { std::vector<float>(2 * bufferSize, encoded.transparentValue()) };
+    for (int i = 0; i < view.numSlices; i++) {
+        const int slice = view.reversed ? view.numSlices - 1 - i : i;
+        const float* pValues = encoded.values(slice);
+
+        // Intermediate pixel p samples the slice at p - offset = (p - cell - 1) + weight.
+        const glm::vec2 offset = view.sliceOffset(slice);
+        const glm::ivec2 cell { glm::floor(offset) };
+        glm::vec2 weight = 1.0f - (offset - glm::vec2(cell));
+        if (nearest)
+            weight = glm::vec2(glm::greaterThanEqual(weight, glm::vec2(0.5f)));
+        // The intermediate pixels whose samples lie inside of the slice (see instersectRayVolumeBounds).
+        const glm::ivec2 first { glm::ceil(offset) };
+        const glm::ivec2 last { glm::floor(offset + glm::vec2(sliceSize - 1)) };
+
+        const auto compositeRow = [&](int y) {
+            std::vector<float>& buffer = rowBuffers.local();
+            // Rows v and v + 1 of the slice; index -1 and sliceSize.x hold the transparent value as well.
+            const int v = y - cell.y - 1;
+            const std::array<float*, 2> rows { buffer.data() + 1, buffer.data() + bufferSize + 1 };
+            std::array<gsl::span<const RunLengthVolume::Run>, 2> runs;
+            for (size_t r = 0; r < 2; r++) {
+                const int row = v + int(r);
+                if (row >= 0 && row < sliceSize.y)
+                    runs[r] = encoded.runs(slice, row);
+                for (const RunLengthVolume::Run& run : runs[r])
+                    std::copy(pValues + run.value, pValues + run.value + size_t(run.end - run.begin), rows[r] + run.begin);
+            }
+
+            glm::vec4* pPixels = &m_intermediateImage[size_t(view.imageSize.x) * size_t(y)];
+            uint64_t samples = 0;
+            const auto compositeSpan = [&](int begin, int end) {
+                for (int x = std::max(begin, first.x); x <= std::min(end, last.x); x++) {
+                    const int u = x - cell.x - 1;
+                    const float value0 = (1.0f - weight.x) * rows[0][u] + weight.x * rows[0][u + 1];
+                    const float value1 = (1.0f - weight.x) * rows[1][u] + weight.x * rows[1][u + 1];
+                    const float value = (1.0f - weight.y) * value0 + weight.y * value1;
+                    samples++;
+
+                    glm::vec4& pixel = pPixels[x];
+                    if (mip) {
+                        pixel.x = std::max(pixel.x, value);
+                        continue;
+                    }
+                    if (pixel.a >= 1.0f)
+                        continue;
+                    const glm::vec4 tfValue = lookupTF(value);
+                    if (tfValue.a == 0.0f)
+                        continue;
+                    glm::vec3 tfColor = glm::vec3(tfValue);
+                    if (m_config.volumeShading) {
+                        // The light is at the camera, and both are infinitely far away.
+                        glm::vec3 position;
+                        position[view.axis] = float(slice);
+                        position[view.uAxis] = float(x) - offset.x;
+                        position[view.vAxis] = float(y) - offset.y;
+                        const glm::vec3 direction = glm::normalize(centerRay.direction);
+                        tfColor = computePhongShading(tfColor, m_pGradientVolume->getGradientInterpolate(position), direction, -direction);
+                    }
+                    pixel += (1.0f - pixel.a) * tfValue.a * glm::vec4(tfColor, 1.0f);
+                }
+            };
+
+            // Only the pixels that sample a voxel of a run: voxels [begin, end) are sampled by pixels
+            // [begin + cell.x, end + cell.x]. The runs of both rows are merged in order into spans.
+            size_t next0 = 0, next1 = 0;
+            int spanBegin = 0, spanEnd = -1;
+            while (next0 < runs[0].size() || next1 < runs[1].size()) {
+                const bool take0 = next1 == runs[1].size() || (next0 < runs[0].size() && runs[0][next0].begin < runs[1][next1].begin);
+                const RunLengthVolume::Run& run = take0 ? runs[0][next0++] : runs[1][next1++];
+                if (run.begin + cell.x > spanEnd + 1) {
+                    compositeSpan(spanBegin, spanEnd);
+                    spanBegin = run.begin + cell.x;
+                }
+                spanEnd = std::max(spanEnd, run.end + cell.x);
+            }
+            compositeSpan(spanBegin, spanEnd);
+            m_threadStats.local().samplesTaken += samples;
+
+            for (size_t r = 0; r < 2; r++) {
+                for (const RunLengthVolume::Run& run : runs[r])
+                    std::fill(rows[r] + run.begin, rows[r] + run.end, encoded.transparentValue());
+            }
+        };
+#if PARALLELISM == 0
+        for (int y = first.y; y <= last.y; y++)
+            compositeRow(y);
+#else
+        tbb::parallel_for(tbb::blocked_range<int>(first.y, last.y + 1), [&](const tbb::blocked_range<int>& range) {
+            for (int y = range.begin(); y != range.end(); y++)
+                compositeRow(y);
+        });
+#endif
+    }
+
+    // Warp: the ray of every pixel passes through the same point of the intermediate image in all slices.
+    const auto intermediatePixel = [&](const glm::ivec2& pixel) {
+        if (glm::any(glm::lessThan(pixel, glm::ivec2(0))) || glm::any(glm::greaterThanEqual(pixel, view.imageSize)))
+            return glm::vec4(0.0f);
+        return m_intermediateImage[size_t(view.imageSize.x) * size_t(pixel.y) + size_t(pixel.x)];
+    };
+    fillPixels(frame, [&](int, int, const Ray& ray) {
+        const glm::vec2 position = view.project(ray.origin);
+        const glm::ivec2 pixel { glm::floor(position) };
+        const glm::vec2 weight = position - glm::vec2(pixel);
+        const glm::vec4 row0 = glm::mix(intermediatePixel(pixel), intermediatePixel(pixel + glm::ivec2(1, 0)), weight.x);
+        const glm::vec4 row1 = glm::mix(intermediatePixel(pixel + glm::ivec2(0, 1)), intermediatePixel(pixel + glm::ivec2(1, 1)), weight.x);
+        const glm::vec4 color = glm::mix(row0, row1, weight.y);
+        if (mip)
+            return glm::vec4(glm::vec3(color.x) / m_pVolume->maximum(), 1.0f);
+        return color;
+    });
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "volume/volume.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <gsl/span>
+#include <vector>
+
+namespace render {
+
+// Factorization of an orthographic view into a shear of the slices of the volume along its principal axis (the axis
+// that is most parallel to the viewing direction) and a 2D warp of the intermediate image (Lacroute & Levoy, 1994).
+// Voxel (u, v) of slice s is projected onto intermediate pixel (u, v) + sliceOffset(s), so every ray passes through the
+// same intermediate pixel in all slices and the slices can be composited one after the other with bilinear weights
+// that are constant per slice.
+struct ShearWarpFactorization {
+    // The principal axis, and the axes of the volume along u and v (along x whenever possible, so that the rows of a
+    // slice are contiguous in memory).
+    int axis;
+    int uAxis, vAxis;
+    int numSlices;
+    // Whether the rays traverse the slices from the last to the first.
+    bool reversed;
+    // Offset of the intermediate image between consecutive slices, and of slice 0.
+    glm::vec2 shear;
+    glm::vec2 origin;
+    glm::ivec2 imageSize;
+    // Distance along a ray between consecutive slices (at least 1).
+    float sliceDistance;
+
+    glm::vec2 sliceOffset(int slice) const;
+    // The intermediate pixel of the ray through point.
+    glm::vec2 project(const glm::vec3& point) const;
+};
+
+ShearWarpFactorization factorizeView(const glm::vec3& direction, const glm::ivec3& dims);
+
+// The voxels of a volume slice by slice along one axis, with the voxels that cannot contribute to an image left out
+// (Lacroute & Levoy). A voxel is transparent if its value lies below the threshold; a voxel is left out if it and its 8
+// neighbours in the slice are transparent, so that every bilinear sample that touches an opaque voxel reads only voxels
+// that are kept. The kept voxels of every row of a slice are stored as runs, which the shear-warp renderer walks in
+// memory order. Values below the threshold must interpolate to values below the threshold; the renderer chooses it so.
+class RunLengthVolume {
+public:
+    // Voxels [begin, end) of a row of a slice. Their values start at values(slice)[value].
+    struct Run {
+        int begin, end;
+        size_t value;
+    };
+
+public:
+    RunLengthVolume(const volume::Volume& volume, int axis, float threshold);
+
+    int axis() const;
+    float threshold() const;
+    // Number of voxels along u and v of a slice (see ShearWarpFactorization).
+    glm::ivec2 sliceSize() const;
+    int numSlices() const;
+    gsl::span<const Run> runs(int slice, int row) const;
+    const float* values(int slice) const;
+    // A transparent value to use for voxels that were left out.
+    float transparentValue() const;
+    size_t numStoredVoxels() const;
+
+private:
+    struct Slice {
+        // The runs of row v are runs[rowBegin[v]] up to runs[rowBegin[v + 1]].
+        std::vector<uint32_t> rowBegin;
+        std::vector<Run> runs;
+        std::vector<float> values;
+    };
+
+    int m_axis;
+    float m_threshold;
+    glm::ivec2 m_sliceSize;
+    float m_transparentValue { 0.0f };
+    std::vector<Slice> m_slices;
+};
+
+}
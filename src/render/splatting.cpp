@@ -0,0 +1,273 @@
+#include "splatting.h"
+#include "parallelism.h"
+#include "renderer.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <utility>
+
+namespace render {
+
+VolumeBricks::VolumeBricks(const volume::Volume& volume)
+{
+    PROFILE_ZONE("VolumeBricks");
+    const glm::ivec3 dims = volume.dims();
+    const glm::ivec3 numBricks = (dims + brickSize - 1) / brickSize;
+    m_bricks.resize(size_t(numBricks.x) * size_t(numBricks.y) * size_t(numBricks.z));
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, m_bricks.size()), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            const glm::ivec3 brickIndex { int(i % size_t(numBricks.x)), int(i / size_t(numBricks.x) % size_t(numBricks.y)), int(i / (size_t(numBricks.x) * size_t(numBricks.y))) };
+            Brick& brick = m_bricks[i];
+            brick.begin = brickIndex * brickSize;
+            brick.end = glm::min(brick.begin + brickSize, dims);
+            brick.maximum = std::numeric_limits<float>::lowest();
+            for (int z = brick.begin.z; z < brick.end.z; z++) {
+                for (int y = brick.begin.y; y < brick.end.y; y++) {
+                    for (int x = brick.begin.x; x < brick.end.x; x++)
+                        brick.maximum = std::max(brick.maximum, volume.getVoxel(x, y, z));
+                }
+            }
+        }
+    });
+}
+
+const std::vector<VolumeBricks::Brick>& VolumeBricks::bricks() const
+{
+    return m_bricks;
+}
+
+void readBrick(const volume::Volume& volume, const VolumeBricks::Brick& brick, float* pValues)
+{
+    const glm::ivec3 dims = volume.dims();
+    volume::withVoxelType(volume.voxelType(), [&](auto type) {
+        using T = decltype(type);
+        const gsl::span<const T> voxels = volume.data<T>();
+        for (int z = brick.begin.z; z < brick.end.z; z++) {
+            for (int y = brick.begin.y; y < brick.end.y; y++) {
+                const T* pRow = voxels.data() + size_t(dims.x) * (size_t(y) + size_t(dims.y) * size_t(z));
+                pValues = std::transform(pRow + brick.begin.x, pRow + brick.end.x, pValues, [](T value) { return float(value); });
+            }
+        }
+    });
+}
+
+ScreenProjection screenProjection(const RayTraceCamera& camera, const glm::ivec2& resolution)
+{
+    const Ray center = camera.generateRay(glm::vec2(0.0f));
+    const Ray right = camera.generateRay(glm::vec2(1.0f, 0.0f));
+    const Ray top = camera.generateRay(glm::vec2(0.0f, 1.0f));
+
+    ScreenProjection out {};
+    out.orthographic = camera.orthographic();
+    out.origin = center.origin;
+    out.forward = glm::normalize(center.direction);
+    if (out.orthographic) {
+        out.right = right.origin - center.origin;
+        out.up = top.origin - center.origin;
+    } else {
+        out.right = right.direction / glm::dot(right.direction, out.forward) - out.forward;
+        out.up = top.direction / glm::dot(top.direction, out.forward) - out.forward;
+    }
+    out.resolution = glm::vec2(resolution);
+    out.pixelRight = out.right / glm::dot(out.right, out.right) * out.resolution.x / 2.0f;
+    out.pixelUp = out.up / glm::dot(out.up, out.up) * out.resolution.y / 2.0f;
+    out.pixelsPerUnitAtDepth1 = out.resolution / 2.0f / glm::vec2(glm::length(out.right), glm::length(out.up));
+    return out;
+}
+
+bool Renderer::useSplatting() const
+{
+    return m_config.renderBackend == RenderBackend::Splatting && !m_config.showCostHeatmap
+        && (m_config.renderMode == RenderMode::RenderMIP || m_config.renderMode == RenderMode::RenderComposite);
+}
+
+// Splatting (Westover, 1990): every voxel that is not transparent is projected onto the screen and its footprint is
+// composited into the pixels that it covers. The footprint is a Gaussian that sums to about one over a unit grid, so
+// that the voxels along a ray add up to the opacity of one sample of traceRayComposite per unit of length (the voxels
+// are classified before they are splatted). MIP takes the largest value over a footprint of about a voxel instead.
+// The bricks of the volume that are transparent as a whole are skipped, and the others are sorted front to back and
+// split into consecutive groups, which are splatted in parallel into a partial image each. The partial images are
+// composited in order at the end. Visibility is only ordered per brick and per voxel within a brick, so the image is
+// close to but not the same as the ray cast image.
+void Renderer::renderSplatting(const FrameContext& frame)
+{
+    PROFILE_ZONE("Renderer::renderSplatting");
+    const ScreenProjection projection = screenProjection(*m_pCamera, m_config.renderResolution);
+    const bool mip = m_config.renderMode == RenderMode::RenderMIP;
+    const glm::vec3 cameraPosition = m_pCamera->position();
+    if (!m_optVolumeBricks)
+        m_optVolumeBricks.emplace(*m_pVolume);
+
+    // The bricks that can contribute, sorted by the depth of their centres.
+    const float threshold = transparencyThreshold();
+    std::vector<std::pair<float, const VolumeBricks::Brick*>> bricks;
+    for (const VolumeBricks::Brick& brick : m_optVolumeBricks->bricks()) {
+        if (brick.maximum < threshold)
+            continue;
+        const glm::vec3 center = glm::vec3(brick.begin + brick.end - 1) / 2.0f;
+        const float depth = projection.orthographic ? glm::dot(center - projection.origin, projection.forward) : glm::distance(center, projection.origin);
+        bricks.emplace_back(depth, &brick);
+    }
+    std::sort(std::begin(bricks), std::end(bricks), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+    // Standard deviation of the footprint in voxels, and its radius in standard deviations; in pixels the footprint is
+    // at least wide enough not to fall between the pixels. The radius of the MIP footprint in voxels and in pixels.
+    static constexpr float footprintSigma = 0.55f, minFootprintSigma = 0.5f, footprintCutoff = 2.5f;
+    static constexpr float mipRadius = 0.5f, minMipRadius = 0.5f;
+    // The Gaussian relative to its peak as a function of the squared distance to its centre (in units of the radius),
+    // scaled such that the footprint keeps the weight that lies beyond the radius.
+    static constexpr int footprintTableSize = 64;
+    std::array<float, footprintTableSize + 1> footprintTable;
+    const float truncatedWeight = 1.0f - std::exp(-0.5f * footprintCutoff * footprintCutoff);
+    for (int i = 0; i <= footprintTableSize; i++)
+        footprintTable[size_t(i)] = std::exp(-0.5f * footprintCutoff * footprintCutoff * float(i) / float(footprintTableSize)) / truncatedWeight;
+
+    const glm::ivec2 resolution = m_config.renderResolution;
+    const auto splatBrick = [&](const VolumeBricks::Brick& brick, float* pValues, glm::vec4* pImage) {
+        // Voxels front to back: slice by slice along the axis that is most parallel to the viewing direction, and along
+        // every axis in the direction in which the view traverses the brick.
+        const glm::vec3 center = glm::vec3(brick.begin + brick.end - 1) / 2.0f;
+        const glm::vec3 direction = projection.orthographic ? projection.forward : center - projection.origin;
+        const glm::vec3 absDirection = glm::abs(direction);
+        const int axis = absDirection.x >= absDirection.y && absDirection.x >= absDirection.z ? 0 : (absDirection.y >= absDirection.z ? 1 : 2);
+        const glm::ivec2 otherAxes = volume::otherAxes(axis);
+        const std::array<int, 3> axes { axis, otherAxes.y, otherAxes.x };
+        const glm::ivec3 size = brick.end - brick.begin;
+        readBrick(*m_pVolume, brick, pValues);
+
+        // Index into pValues and position of the first voxel, and their steps and number of steps per loop.
+        const std::array<ptrdiff_t, 3> strides { 1, ptrdiff_t(size.x), ptrdiff_t(size.x) * ptrdiff_t(size.y) };
+        ptrdiff_t firstIndex = 0;
+        glm::vec3 firstPosition { brick.begin };
+        std::array<ptrdiff_t, 3> indexSteps;
+        std::array<glm::vec3, 3> positionSteps;
+        std::array<int, 3> numSteps;
+        for (size_t loop = 0; loop < 3; loop++) {
+            const int a = axes[loop];
+            const bool increasing = direction[a] >= 0.0f;
+            indexSteps[loop] = increasing ? strides[size_t(a)] : -strides[size_t(a)];
+            positionSteps[loop] = glm::vec3(0.0f);
+            positionSteps[loop][a] = increasing ? 1.0f : -1.0f;
+            numSteps[loop] = size[a];
+            if (!increasing) {
+                firstIndex += strides[size_t(a)] * ptrdiff_t(size[a] - 1);
+                firstPosition[a] = float(brick.end[a] - 1);
+            }
+        }
+
+        uint64_t samples = 0;
+        ptrdiff_t index0 = firstIndex;
+        glm::vec3 position0 = firstPosition;
+        for (int i = 0; i < numSteps[0]; i++, index0 += indexSteps[0], position0 += positionSteps[0]) {
+            ptrdiff_t index1 = index0;
+            glm::vec3 position1 = position0;
+            for (int j = 0; j < numSteps[1]; j++, index1 += indexSteps[1], position1 += positionSteps[1]) {
+                ptrdiff_t index = index1;
+                glm::vec3 position = position1;
+                for (int k = 0; k < numSteps[2]; k++, index += indexSteps[2], position += positionSteps[2]) {
+                    const float value = pValues[index];
+                    if (value < threshold)
+                        continue;
+                    const glm::vec4 tfValue = mip ? glm::vec4(0.0f) : getTFValue(value);
+                    if (!mip && tfValue.a == 0.0f)
+                        continue;
+                    const glm::vec3 screen = projection.project(position);
+                    if (!projection.orthographic && screen.z <= 0.0f)
+                        continue;
+
+                    // Pixels whose distance to the centre of the footprint is below its radius (MIP: along x and y).
+                    const glm::vec2 pixelsPerUnit = projection.pixelsPerUnit(screen.z);
+                    const glm::vec2 sigma = glm::max(footprintSigma * pixelsPerUnit, glm::vec2(minFootprintSigma));
+                    const glm::vec2 radius = mip ? glm::max(mipRadius * pixelsPerUnit, glm::vec2(minMipRadius)) : footprintCutoff * sigma;
+                    const glm::ivec2 first = glm::max(glm::ivec2(glm::ceil(glm::vec2(screen) - radius)), glm::ivec2(0));
+                    const glm::ivec2 last = glm::min(glm::ivec2(glm::floor(glm::vec2(screen) + radius)), resolution - 1);
+                    if (first.x > last.x || first.y > last.y)
+                        continue;
+                    samples++;
+
+                    if (mip) {
+                        for (int y = first.y; y <= last.y; y++) {
+                            glm::vec4* pRow = pImage + size_t(resolution.x) * size_t(y);
+                            for (int x = first.x; x <= last.x; x++)
+                                pRow[x].x = std::max(pRow[x].x, value);
+                        }
+                        continue;
+                    }
+
+                    glm::vec3 tfColor = glm::vec3(tfValue);
+                    if (m_config.volumeShading) {
+                        // The same light and view vectors as traceRayComposite.
+                        const glm::vec3 L = projection.orthographic ? projection.forward : glm::normalize(position - cameraPosition);
+                        const glm::vec3 V = glm::normalize(cameraPosition - position);
+                        tfColor = computePhongShading(tfColor, m_pGradientVolume->getGradientInterpolate(position), L, V);
+                    }
+                    // The footprint as a density per unit area (the transparency of a sample is exp(density * log(1 - a))).
+                    const float logTransparency = std::log(1.0f - tfValue.a);
+                    const float peakDensity = pixelsPerUnit.x * pixelsPerUnit.y / (2.0f * glm::pi<float>() * sigma.x * sigma.y);
+                    for (int y = first.y; y <= last.y; y++) {
+                        const float dy = (float(y) - screen.y) / radius.y;
+                        glm::vec4* pRow = pImage + size_t(resolution.x) * size_t(y);
+                        for (int x = first.x; x <= last.x; x++) {
+                            const float dx = (float(x) - screen.x) / radius.x;
+                            const float distance2 = dx * dx + dy * dy;
+                            glm::vec4& pixel = pRow[x];
+                            if (distance2 > 1.0f || pixel.a >= 1.0f)
+                                continue;
+                            const float density = peakDensity * footprintTable[size_t(distance2 * float(footprintTableSize) + 0.5f)];
+                            const float alpha = 1.0f - std::exp(density * logTransparency);
+                            pixel += (1.0f - pixel.a) * alpha * glm::vec4(tfColor, 1.0f);
+                        }
+                    }
+                }
+            }
+        }
+        m_threadStats.local().samplesTaken += samples;
+    };
+
+    // Consecutive groups of bricks, one per thread, each splatted into its own partial image.
+#if PARALLELISM == 0
+    const size_t numGroups = std::min(bricks.size(), size_t(1));
+#else
+    const size_t numGroups = std::min(bricks.size(), size_t(tbb::this_task_arena::max_concurrency()));
+#endif
+    const size_t numPixels = size_t(resolution.x) * size_t(resolution.y);
+    m_partialImages.resize(numGroups);
+    const auto splatGroup = [&](size_t group) {
+        std::vector<glm::vec4>& image = m_partialImages[group];
+        image.assign(numPixels, glm::vec4(0.0f));
+        std::vector<float> values(size_t(VolumeBricks::brickSize) * VolumeBricks::brickSize * VolumeBricks::brickSize);
+        for (size_t i = group * bricks.size() / numGroups; i != (group + 1) * bricks.size() / numGroups; i++)
+            splatBrick(*bricks[i].second, values.data(), image.data());
+    };
+#if PARALLELISM == 0
+    for (size_t group = 0; group < numGroups; group++)
+        splatGroup(group);
+#else
+    tbb::parallel_for(size_t(0), numGroups, splatGroup);
+#endif
+
+    // Composite the partial images front to back. Pixels whose rays miss the volume stay black, as with ray casting.
+    fillPixels(frame, [&](int x, int y, const Ray&) {
+        const size_t pixel = size_t(resolution.x) * size_t(y) + size_t(x);
+        glm::vec4 color { 0.0f };
+        for (const std::vector<glm::vec4>& image : m_partialImages) {
+            if (mip)
+                color.x = std::max(color.x, image[pixel].x);
+            else
+                color += (1.0f - color.a) * image[pixel];
+        }
+        if (mip)
+            return glm::vec4(glm::vec3(color.x) / m_pVolume->maximum(), 1.0f);
+        return color;
+    });
+}
+
+}
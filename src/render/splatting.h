@@ -0,0 +1,68 @@
+#pragma once
+#include "render/ray_trace_camera.h"
+#include "volume/volume.h"
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+namespace render {
+
+// The volume divided into bricks of brickSize^3 voxels (smaller at the far faces of the volume) with their largest
+// value, so that the splatting renderer can skip the bricks that are transparent as a whole.
+class VolumeBricks {
+public:
+    static constexpr int brickSize = 16;
+
+    struct Brick {
+        // Voxels [begin, end).
+        glm::ivec3 begin, end;
+        float maximum;
+    };
+
+public:
+    explicit VolumeBricks(const volume::Volume& volume);
+
+    const std::vector<Brick>& bricks() const;
+
+private:
+    std::vector<Brick> m_bricks;
+};
+
+// Copies the voxels of brick to pValues in x-major order.
+void readBrick(const volume::Volume& volume, const VolumeBricks::Brick& brick, float* pValues);
+
+// The projection of a camera onto the pixels of the renderer (see Renderer::generatePixelRay), recovered from the
+// rays of the camera. Assumes that the screen of the camera is a rectangle perpendicular to its viewing direction.
+struct ScreenProjection {
+    bool orthographic;
+    // The ray through the centre of the screen, and the offsets of the rays through its right and top edges: of their
+    // origins for an orthographic camera and of their directions (at unit distance) otherwise.
+    glm::vec3 origin, forward;
+    glm::vec3 right, up;
+    glm::vec2 resolution;
+    // right and up scaled such that their dot product with an offset (divided by the depth for a perspective camera)
+    // gives the offset in pixels, and the pixels per unit length at depth 1.
+    glm::vec3 pixelRight, pixelUp;
+    glm::vec2 pixelsPerUnitAtDepth1;
+
+    // The pixel (x, y) onto which point projects, and its distance in front of the camera (z). Inline, as the splatting
+    // renderer projects every voxel that it splats.
+    glm::vec3 project(const glm::vec3& point) const
+    {
+        // Renderer::generatePixelRay maps pixel p onto screen position p / resolution * 2 - 1.
+        const glm::vec3 relative = point - origin;
+        const float depth = glm::dot(relative, forward);
+        const float scale = orthographic ? 1.0f : 1.0f / depth;
+        return glm::vec3(glm::dot(relative, pixelRight) * scale + resolution.x / 2.0f, glm::dot(relative, pixelUp) * scale + resolution.y / 2.0f, depth);
+    }
+    // Number of pixels along x and y that a unit length perpendicular to the viewing direction covers at depth.
+    glm::vec2 pixelsPerUnit(float depth) const
+    {
+        return orthographic ? pixelsPerUnitAtDepth1 : pixelsPerUnitAtDepth1 / depth;
+    }
+};
+
+ScreenProjection screenProjection(const RayTraceCamera& camera, const glm::ivec2& resolution);
+
+}
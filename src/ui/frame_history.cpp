@@ -0,0 +1,66 @@
+#include "ui/frame_history.h"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+namespace ui {
+
+void FrameHistory::push(const render::RenderStats& stats)
+{
+    m_stats[m_next] = stats;
+    m_frameTimesMs[m_next] = float(stats.renderTime.count() * 1000.0);
+    m_next = (m_next + 1) % capacity;
+    m_size = std::min(m_size + 1, capacity);
+}
+
+void FrameHistory::clear()
+{
+    m_frameTimesMs.fill(0.0f);
+    m_next = 0;
+    m_size = 0;
+}
+
+size_t FrameHistory::size() const
+{
+    return m_size;
+}
+
+const render::RenderStats& FrameHistory::operator[](size_t i) const
+{
+    assert(i < m_size);
+    return m_stats[(m_next + capacity - m_size + i) % capacity];
+}
+
+const render::RenderStats& FrameHistory::latest() const
+{
+    return (*this)[m_size - 1];
+}
+
+const float* FrameHistory::frameTimesMs() const
+{
+    return m_frameTimesMs.data();
+}
+
+int FrameHistory::plotOffset() const
+{
+    // Until the buffer is full the unused (zero) entries are drawn first so that the graph scrolls in from the right.
+    return int(m_next);
+}
+
+bool FrameHistory::writeCSV(const std::filesystem::path& filePath) const
+{
+    std::ofstream file { filePath };
+    if (!file.is_open())
+        return false;
+
+    file << "frame,render_time_ms,rays_cast,rays_missed,samples_taken,samples_skipped,early_terminated_rays,average_ray_length,samples_per_second\n";
+    for (size_t i = 0; i < m_size; i++) {
+        const render::RenderStats& stats = (*this)[i];
+        file << i << ',' << stats.renderTime.count() * 1000.0 << ',' << stats.raysCast << ',' << stats.raysMissed << ','
+             << stats.samplesTaken << ',' << stats.samplesSkipped << ',' << stats.earlyTerminatedRays << ','
+             << stats.averageRayLength() << ',' << stats.samplesPerSecond() << '\n';
+    }
+    return bool(file);
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "render/render_stats.h"
+#include <array>
+#include <cstddef>
+#include <filesystem>
+
+namespace ui {
+
+// Ring buffer with the render statistics of the most recent frames.
+class FrameHistory {
+public:
+    static constexpr size_t capacity = 256;
+
+    void push(const render::RenderStats& stats);
+    void clear();
+
+    size_t size() const;
+    // Frames are indexed from oldest (0) to newest (size() - 1).
+    const render::RenderStats& operator[](size_t i) const;
+    const render::RenderStats& latest() const;
+
+    // Frame times in milliseconds in ring buffer order; the oldest frame is at plotOffset().
+    // This matches the layout expected by ImGui::PlotLines.
+    const float* frameTimesMs() const;
+    int plotOffset() const;
+
+    // Write all frames in the history to a CSV file (oldest first). Returns false if the file could not be written.
+    bool writeCSV(const std::filesystem::path& filePath) const;
+
+private:
+    std::array<render::RenderStats, capacity> m_stats {};
+    std::array<float, capacity> m_frameTimesMs {};
+    size_t m_next { 0 };
+    size_t m_size { 0 };
+};
+
+}
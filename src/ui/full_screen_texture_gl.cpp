@@ -1,5 +1,6 @@
 #include "ui/full_screen_texture_gl.h"
 #include "opengl.h"
+#include "profiling/profiler.h"
 #include "ui/gl_error.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/vec3.hpp>
@@ -80,12 +81,14 @@ FullScreenTextureGL::~FullScreenTextureGL()
 
 void FullScreenTextureGL::update(gsl::span<const glm::vec3> frameBuffer, const glm::ivec2& resolution)
 {
+    PROFILE_ZONE("FullScreenTextureGL::update");
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, resolution.x, resolution.y, 0, GL_RGB, GL_FLOAT, frameBuffer.data());
 }
 
 void FullScreenTextureGL::update(gsl::span<const glm::vec4> frameBuffer, const glm::ivec2& resolution)
 {
+    PROFILE_ZONE("FullScreenTextureGL::update");
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, resolution.x, resolution.y, 0, GL_RGBA, GL_FLOAT, frameBuffer.data());
 }
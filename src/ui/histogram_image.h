@@ -0,0 +1,18 @@
+#pragma once
+#include <GL/glew.h> // Include before glfw3
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <vector>
+
+namespace ui {
+
+// The histogram shown behind a transfer function widget: one opacity per pixel (0 to 255), row by row from the top.
+// Computing it only reads the volume, so it can be done on any thread; only the upload needs the OpenGL context.
+struct HistogramImage {
+    glm::ivec2 resolution { 0 };
+    std::vector<uint8_t> opacity;
+};
+
+// Upload the image to a new texture, which draws it in white with the stored opacity.
+GLuint createHistogramTexture(const HistogramImage& image);
+}
@@ -1,5 +1,8 @@
 #include "menu.h"
+#include "profiling/profiler.h"
 #include "render/renderer.h"
+#include <array>
+#include <cfloat> // FLT_MAX
 #include <filesystem>
 #include <fmt/format.h>
 #include <imgui.h>
@@ -29,6 +32,11 @@ void Menu::setInterpolationModeChangedCallback(InterpolationModeChangedCallback&
     m_optInterpolationModeChangedCallback = std::move(callback);
 }
 
+void Menu::setProjectionChangedCallback(ProjectionChangedCallback&& callback)
+{
+    m_optProjectionChangedCallback = std::move(callback);
+}
+
 render::RenderConfig Menu::renderConfig() const
 {
     return m_renderConfig;
@@ -39,6 +47,11 @@ volume::InterpolationMode Menu::interpolationMode() const
     return m_interpolationMode;
 }
 
+bool Menu::orthographic() const
+{
+    return m_orthographic;
+}
+
 void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 {
     m_baseRenderResolution = baseRenderResolution;
@@ -48,24 +61,44 @@ void Menu::setBaseRenderResolution(const glm::ivec2& baseRenderResolution)
 
 // This function handles a part of the volume loading where we create the widget histograms, set some config values
 //  and set the menu volume information
-void Menu::setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume)
+void Menu::setLoadedVolume(const LoadedVolume& loadedVolume)
 {
-    m_tfWidget = TransferFunctionWidget(volume);
-    m_tf2DWidget = TransferFunction2DWidget(volume, gradientVolume);
+    const volume::Volume& volume = *loadedVolume.pVolume;
+    m_tfWidget = TransferFunctionWidget(volume, loadedVolume.histogramImage);
+    m_tf2DWidget = TransferFunction2DWidget(volume, loadedVolume.histogramImage2D);
 
     m_tfWidget->updateRenderConfig(m_renderConfig);
     m_tf2DWidget->updateRenderConfig(m_renderConfig);
 
     const glm::ivec3 dim = volume.dims();
-    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel value range: {} - {}\n",
-        volume.fileName(), dim.x, dim.y, dim.z, volume.minimum(), volume.maximum());
-    m_volumeMax = int(volume.maximum());
+    static constexpr std::array<const char*, 4> voxelTypeNames { "uint8", "int16", "uint16", "float32" };
+    m_volumeInfo = fmt::format("Volume info:\n{}\nDimensions: ({}, {}, {})\nVoxel type: {}\nVoxel value range: {} - {}\n",
+        volume.fileName(), dim.x, dim.y, dim.z, voxelTypeNames[size_t(volume.voxelType())], volume.minimum(), volume.maximum());
+    if (loadedVolume.stride > 1)
+        m_volumeInfo += fmt::format("Preview: every {}th voxel\n", loadedVolume.stride);
+    else
+        m_volumeInfo += fmt::format("Load time: {:.0f}ms\n", loadedVolume.loadTime.count() * 1000.0);
+    m_volumeMin = volume.minimum();
+    m_volumeMax = volume.maximum();
     m_volumeLoaded = true;
+    m_frameHistory.clear();
+}
+
+void Menu::setLoadingProgress(std::optional<float> optProgress)
+{
+    m_optLoadingProgress = optProgress;
+}
+
+// Record the statistics of a render pass for the performance overview in the Raycaster tab.
+void Menu::addRenderStats(const render::RenderStats& stats)
+{
+    m_frameHistory.push(stats);
 }
 
 // This function draws the menu
 void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime)
 {
+    PROFILE_ZONE("Menu::drawMenu");
     static bool open = 1;
     ImGui::Begin("VolVis", &open, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove);
     ImGui::SetWindowPos(ImVec2(float(pos.x), float(pos.y)));
@@ -76,6 +109,7 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
     if (m_volumeLoaded) {
         const auto renderConfigBefore = m_renderConfig;
         const auto interpolationModeBefore = m_interpolationMode;
+        const bool orthographicBefore = m_orthographic;
 
         showRayCastTab(renderTime);
         showTransFuncTab();
@@ -85,6 +119,8 @@ void Menu::drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::
             callRenderConfigChangedCallback();
         if (m_interpolationMode != interpolationModeBefore)
             callInterpolationModeChangedCallback();
+        if (m_orthographic != orthographicBefore)
+            callProjectionChangedCallback();
     }
 
     ImGui::EndTabBar();
@@ -96,7 +132,10 @@ void Menu::showLoadVolTab()
 {
     if (ImGui::BeginTabItem("Load")) {
 
-        if (ImGui::Button("Load volume")) {
+        if (m_optLoadingProgress) {
+            ImGui::Text("Loading volume...");
+            ImGui::ProgressBar(*m_optLoadingProgress);
+        } else if (ImGui::Button("Load volume")) {
             nfdchar_t* pOutPath = nullptr;
             nfdresult_t result = NFD_OpenDialog("fld", nullptr, &pOutPath);
 
@@ -123,6 +162,7 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         const std::string renderText = fmt::format("rendering time: {}ms\nrendering resolution: ({}, {})\n",
             std::chrono::duration_cast<std::chrono::milliseconds>(renderTime).count(), m_renderConfig.renderResolution.x, m_renderConfig.renderResolution.y);
         ImGui::Text("%s", renderText.c_str());
+        showRenderStats();
         ImGui::NewLine();
 
         int* pRenderModeInt = reinterpret_cast<int*>(&m_renderConfig.renderMode);
@@ -133,13 +173,24 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::RadioButton("Compositing", pRenderModeInt, int(render::RenderMode::RenderComposite));
         ImGui::RadioButton("2D Transfer Function", pRenderModeInt, int(render::RenderMode::RenderTF2D));
 
+        ImGui::Checkbox("Orthographic projection", &m_orthographic);
+        int* pRenderBackendInt = reinterpret_cast<int*>(&m_renderConfig.renderBackend);
+        ImGui::Text("MIP / Compositing:");
+        ImGui::RadioButton("Ray casting", pRenderBackendInt, int(render::RenderBackend::RayCasting));
+        ImGui::SameLine();
+        ImGui::RadioButton("Shear-warp (orthographic only)", pRenderBackendInt, int(render::RenderBackend::ShearWarp));
+        ImGui::SameLine();
+        ImGui::RadioButton("Splatting", pRenderBackendInt, int(render::RenderBackend::Splatting));
+
         ImGui::NewLine();
 
         ImGui::Checkbox("Volume Shading", &m_renderConfig.volumeShading);
 
         ImGui::NewLine();
 
-        ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, 0.1f, 0.0f, float(m_volumeMax));
+        // Steps of 0.1 over the 255 values of a byte volume, and the same share of the value range for any other.
+        ImGui::DragFloat("Iso Value", &m_renderConfig.isoValue, (m_volumeMax - m_volumeMin) / 2550.0f, m_volumeMin, m_volumeMax);
+        ImGui::ColorEdit3("Iso Color", &m_renderConfig.isoColor.x);
 
         ImGui::NewLine();
 
@@ -153,11 +204,85 @@ void Menu::showRayCastTab(std::chrono::duration<double> renderTime)
         ImGui::RadioButton("Nearest Neighbour", pInterpolationModeInt, int(volume::InterpolationMode::NearestNeighbour));
         ImGui::RadioButton("Linear", pInterpolationModeInt, int(volume::InterpolationMode::Linear));
         ImGui::RadioButton("TriCubic", pInterpolationModeInt, int(volume::InterpolationMode::Cubic));
+        ImGui::Checkbox("Exact cell traversal (MIP / IsoSurface)", &m_renderConfig.cellTraversal);
+        ImGui::Checkbox("Skip uniform tiles (MIP / Compositing / IsoSurface)", &m_renderConfig.sparseTraversal);
+        ImGui::Checkbox("Skip with max pyramid (MIP)", &m_renderConfig.maxPyramidTraversal);
+        ImGui::Checkbox("Reuse cell corners along rays (MIP / Compositing / 2D TF)", &m_renderConfig.reuseCellCorners);
+
+        ImGui::NewLine();
+
+        // Only the instruction sets that this machine supports are offered.
+        int* pSimdLevelInt = reinterpret_cast<int*>(&m_renderConfig.simdLevel);
+        ImGui::Text("SIMD kernels (MIP / Compositing / 2D TF with linear interpolation):");
+        for (int level = 0; level <= int(render::kernels::detectSimdLevel()); level++) {
+            if (level > 0)
+                ImGui::SameLine();
+            ImGui::RadioButton(render::kernels::simdLevelName(render::kernels::SimdLevel(level)), pSimdLevelInt, level);
+        }
+        if (m_renderConfig.simdLevel != render::kernels::SimdLevel::Scalar)
+            ImGui::Checkbox("Fixed-point interpolation", &m_renderConfig.fixedPointInterpolation);
+
+        ImGui::NewLine();
+
+        ImGui::Checkbox("Cost heatmap", &m_renderConfig.showCostHeatmap);
+        if (m_renderConfig.showCostHeatmap) {
+            int* pCostMetricInt = reinterpret_cast<int*>(&m_renderConfig.costMetric);
+            ImGui::RadioButton("Volume samples", pCostMetricInt, int(render::CostMetric::VolumeSamples));
+            ImGui::RadioButton("Gradient fetches", pCostMetricInt, int(render::CostMetric::GradientFetches));
+            ImGui::RadioButton("Bisection iterations", pCostMetricInt, int(render::CostMetric::BisectionIterations));
+            ImGui::RadioButton("Cycles", pCostMetricInt, int(render::CostMetric::Cycles));
+            ImGui::Text("Blue = cheap, red = most expensive pixel of the frame.");
+        }
 
         ImGui::EndTabItem();
     }
 }
 
+// This renders the statistics of the last render pass and a graph of the recent frame times.
+void Menu::showRenderStats()
+{
+    if (m_frameHistory.size() == 0)
+        return;
+
+    const render::RenderStats& stats = m_frameHistory.latest();
+    const std::string statsText = fmt::format(
+        "rays cast: {} ({} missed the volume)\nsamples taken: {} (skipped: {})\nearly terminated rays: {}\n"
+        "average ray length: {:.1f} voxels\nsamples per second: {:.1f}M\n",
+        stats.raysCast, stats.raysMissed, stats.samplesTaken, stats.samplesSkipped, stats.earlyTerminatedRays,
+        stats.averageRayLength(), stats.samplesPerSecond() / 1e6);
+    ImGui::Text("%s", statsText.c_str());
+
+    ImGui::PlotLines("Frame time (ms)", m_frameHistory.frameTimesMs(), int(FrameHistory::capacity), m_frameHistory.plotOffset(),
+        nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+    if (ImGui::Button("Export statistics (CSV)")) {
+        nfdchar_t* pOutPath = nullptr;
+        nfdresult_t result = NFD_SaveDialog("csv", nullptr, &pOutPath);
+        if (result == NFD_OKAY) {
+            std::filesystem::path path = pOutPath;
+            if (!path.has_extension())
+                path.replace_extension("csv");
+            if (!m_frameHistory.writeCSV(path))
+                std::cerr << "Failed to write render statistics to " << path << std::endl;
+        }
+    }
+
+    if (profiling::enabled()) {
+        ImGui::SameLine();
+        if (ImGui::Button("Export profile (Chrome trace)")) {
+            nfdchar_t* pOutPath = nullptr;
+            nfdresult_t result = NFD_SaveDialog("json", nullptr, &pOutPath);
+            if (result == NFD_OKAY) {
+                std::filesystem::path path = pOutPath;
+                if (!path.has_extension())
+                    path.replace_extension("json");
+                if (!profiling::writeChromeTrace(path))
+                    std::cerr << "Failed to write profile to " << path << std::endl;
+            }
+        }
+    }
+}
+
 // This renders the 1D Transfer Function Widget.
 void Menu::showTransFuncTab()
 {
@@ -190,4 +315,10 @@ void Menu::callInterpolationModeChangedCallback() const
         (*m_optInterpolationModeChangedCallback)(m_interpolationMode);
 }
 
+void Menu::callProjectionChangedCallback() const
+{
+    if (m_optProjectionChangedCallback)
+        (*m_optProjectionChangedCallback)(m_orthographic);
+}
+
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include "render/render_config.h"
+#include "render/render_stats.h"
+#include "ui/frame_history.h"
 #include "ui/transfer_func.h"
 #include "ui/transfer_func_2d.h"
+#include "ui/volume_loader.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
 #include <chrono>
@@ -26,40 +29,54 @@ public:
     void setRenderConfigChangedCallback(RenderConfigChangedCallback&& callback);
     using InterpolationModeChangedCallback = std::function<void(volume::InterpolationMode)>;
     void setInterpolationModeChangedCallback(InterpolationModeChangedCallback&& callback);
+    using ProjectionChangedCallback = std::function<void(bool orthographic)>;
+    void setProjectionChangedCallback(ProjectionChangedCallback&& callback);
 
     render::RenderConfig renderConfig() const;
     volume::InterpolationMode interpolationMode() const;
+    bool orthographic() const;
 
     void setBaseRenderResolution(const glm::ivec2& baseRenderResolution);
-    void setLoadedVolume(const volume::Volume& volume, const volume::GradientVolume& gradientVolume);
+    void setLoadedVolume(const LoadedVolume& loadedVolume);
+    // Shows the progress instead of the load button while a volume is being loaded (see VolumeLoader::progress).
+    void setLoadingProgress(std::optional<float> optProgress);
+    void addRenderStats(const render::RenderStats& stats);
 
     void drawMenu(const glm::ivec2& pos, const glm::ivec2& size, std::chrono::duration<double> renderTime);
 
 private:
     void showLoadVolTab();
     void showRayCastTab(std::chrono::duration<double> renderTime);
+    void showRenderStats();
     void showTransFuncTab();
     void show2DTransFuncTab();
 
     void callRenderConfigChangedCallback() const;
     void callInterpolationModeChangedCallback() const;
+    void callProjectionChangedCallback() const;
 
 private:
     bool m_volumeLoaded = false;
+    std::optional<float> m_optLoadingProgress;
     std::string m_volumeInfo;
-    int m_volumeMax;
+    // Value range of the volume, which bounds the iso value.
+    float m_volumeMin, m_volumeMax;
 
     std::optional<TransferFunctionWidget> m_tfWidget;
     std::optional<TransferFunction2DWidget> m_tf2DWidget;
 
+    FrameHistory m_frameHistory;
+
     glm::ivec2 m_baseRenderResolution;
     float m_resolutionScale { 1.0f };
     render::RenderConfig m_renderConfig {};
     volume::InterpolationMode m_interpolationMode { volume::InterpolationMode::NearestNeighbour };
+    bool m_orthographic { false };
 
     std::optional<LoadVolumeCallback> m_optLoadVolumeCallback;
     std::optional<RenderConfigChangedCallback> m_optRenderConfigChangedCallback;
     std::optional<InterpolationModeChangedCallback> m_optInterpolationModeChangedCallback;
+    std::optional<ProjectionChangedCallback> m_optProjectionChangedCallback;
 };
 
 }
@@ -61,6 +61,11 @@ void Trackball::setWorldScale(float scale)
     m_worldScale = scale;
 }
 
+void Trackball::setOrthographic(bool orthographic)
+{
+    m_orthographic = orthographic;
+}
+
 glm::vec3 Trackball::position() const
 {
     return m_cameraPos;
@@ -73,6 +78,12 @@ glm::mat4 Trackball::viewMatrix() const
 
 glm::mat4 Trackball::projectionMatrix() const
 {
+    if (m_orthographic) {
+        const float halfHeight = m_distanceFromLookAt * std::tan(m_fovy / 2.0f);
+        const float halfWidth = m_aspectRatio * halfHeight;
+        // The camera may be closer to the volume than its size; the near plane lies behind it.
+        return glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, -1000.0f, 1000.0f);
+    }
     return glm::perspective(m_fovy, m_aspectRatio, 10.0f, 1000.0f);
 }
 
@@ -91,16 +102,28 @@ glm::vec3 Trackball::forward() const
     return m_rotation * glm::vec3(0, 0, 1);
 }
 
+bool Trackball::orthographic() const
+{
+    return m_orthographic;
+}
+
 // This function generates a ray with its origin at cameraPos, going through pixel pixel on the virtual screen
+// With an orthographic projection the rays run parallel to forward() from the plane of the camera instead.
 render::Ray Trackball::generateRay(const glm::vec2& pixel) const
 {
     const float halfScreenPlaceHeight = std::tan(m_fovy / 2.0f);
     const float halfScreenPlaceWidth = m_aspectRatio * halfScreenPlaceHeight;
-    const glm::vec3 cameraSpaceDirection = glm::normalize(glm::vec3(pixel.x * halfScreenPlaceWidth, pixel.y * halfScreenPlaceHeight, 1.0f));
 
     render::Ray ray;
-    ray.origin = m_cameraPos;
-    ray.direction = m_rotation * cameraSpaceDirection;
+    if (m_orthographic) {
+        const glm::vec3 cameraSpaceOffset { pixel.x * halfScreenPlaceWidth, pixel.y * halfScreenPlaceHeight, 0.0f };
+        ray.origin = m_cameraPos + m_rotation * (m_distanceFromLookAt * cameraSpaceOffset);
+        ray.direction = forward();
+    } else {
+        const glm::vec3 cameraSpaceDirection = glm::normalize(glm::vec3(pixel.x * halfScreenPlaceWidth, pixel.y * halfScreenPlaceHeight, 1.0f));
+        ray.origin = m_cameraPos;
+        ray.direction = m_rotation * cameraSpaceDirection;
+    }
     ray.tmin = std::numeric_limits<float>::lowest();
     ray.tmax = std::numeric_limits<float>::max();
     return ray;
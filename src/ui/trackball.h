@@ -20,6 +20,8 @@ public:
     void setLookAt(const glm::vec3& lookAt);
     void setDistance(float distance);
     void setWorldScale(float scale);
+    // An orthographic projection shows the plane through the look-at point at the same size as the perspective one.
+    void setOrthographic(bool orthographic);
 
     glm::vec3 position() const override;
     glm::mat4 viewMatrix() const override;
@@ -28,6 +30,7 @@ public:
     glm::vec3 left() const;
     glm::vec3 up() const;
     glm::vec3 forward() const override;
+    bool orthographic() const override;
 
     // Generate ray given pixel in NDC space (-1 to +1)
     render::Ray generateRay(const glm::vec2& pixel) const override;
@@ -42,6 +45,7 @@ private:
 private:
     const Window* m_pWindow;
     float m_fovy, m_aspectRatio;
+    bool m_orthographic { false };
 
     // Indication of world scale used to scale zoom / translate speed.
     float m_worldScale { 1.0f };
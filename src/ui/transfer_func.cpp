@@ -1,6 +1,9 @@
 ﻿#include "ui/transfer_func.h"
+#include "profiling/profiler.h"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -8,9 +11,11 @@
 #include <gsl/span>
 #include <imgui.h>
 #include <iostream>
+#include <limits>
+#include <tbb/parallel_for.h>
 
 static GLuint createTexture();
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity);
+static std::vector<uint8_t> createHistogramBars(gsl::span<const size_t> data, int width, float opacity);
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
 
@@ -22,36 +27,42 @@ static constexpr size_t sentinel = static_cast<size_t>(-1);
 
 namespace ui {
 
-TransferFunctionWidget::TransferFunctionWidget(const volume::Volume& volume)
+TransferFunctionWidget::TransferFunctionWidget(const volume::Volume& volume, const HistogramImage& histogramImage)
     : m_colorMap(256)
-    , m_minValue(volume.minimum())
+    , m_minValue(volume.histogramBegin())
     , m_maxValue(volume.maximum())
     , m_interactingPoint(sentinel)
     , m_selectedPoint(sentinel)
-    , m_histogramImg(createTexture())
+    , m_histogramImg(createHistogramTexture(histogramImage))
     , m_colorMapImg(createTexture())
 {
     m_tfPoints.push_back(TFPoint { glm::vec2(0.0f), glm::vec3(0.0f) });
     m_tfPoints.push_back(TFPoint { glm::vec2(0.7f, 0.03f), glm::vec3(0.7f) });
     m_tfPoints.push_back(TFPoint { glm::vec2(1.0f), glm::vec3(1.0f) });
 
-    const auto histogram = volume.histogram();
-    const auto imgData = createHistogramImage(histogram, histogramOpacity);
-
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GLsizei(histogram.size()), GLsizei(widgetSize.y), 0, GL_RGBA, GL_FLOAT, imgData.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     updateColormap();
 }
 
+// The histogram of the volume is computed once when it is loaded. The image has one column per bin, but no more
+// columns than the widget has pixels.
+HistogramImage TransferFunctionWidget::createHistogramImage(const volume::Volume& volume)
+{
+    const std::vector<size_t>& histogram = volume.histogram();
+    // Empty volumes (and float volumes that only hold NaNs) have no bins.
+    if (histogram.empty())
+        return HistogramImage {};
+    const int width = int(std::min(histogram.size(), size_t(widgetSize.x)));
+    return HistogramImage { glm::ivec2(width, widgetSize.y), createHistogramBars(histogram, width, histogramOpacity) };
+}
+
 void TransferFunctionWidget::updateRenderConfig(render::RenderConfig& renderConfig) const
 {
     assert(m_colorMap.size() == renderConfig.tfColorMap.size());
     std::copy(std::begin(m_colorMap), std::end(m_colorMap), std::begin(renderConfig.tfColorMap));
-    // Color map ranges from 0 to volume.maximum(). See volume.histogram() for details...
-    renderConfig.tfColorMapIndexStart = 0;
-    renderConfig.tfColorMapIndexRange = m_maxValue;
+    // Color map ranges from the first histogram bin (0 for unsigned volumes) to volume.maximum(), like the histogram
+    // image behind it. See volume.histogram() for details...
+    renderConfig.tfColorMapIndexStart = m_minValue;
+    renderConfig.tfColorMapIndexRange = std::max(m_maxValue - m_minValue, std::numeric_limits<float>::min());
 }
 
 // Draw the widget and handle interactions.
@@ -255,20 +266,27 @@ GLuint createTexture()
     return tex;
 }
 
-// Compute a histogram texture from the histogram vector
-static std::vector<glm::vec4> createHistogramImage(gsl::span<const int> data, float opacity)
+// Compute a histogram texture (the opacity of every pixel) of the given width from the histogram vector. Every column
+// covers an equal share of the bins and shows the fullest of them (max-pooling), so that narrow peaks stay visible.
+static std::vector<uint8_t> createHistogramBars(gsl::span<const size_t> data, int width, float opacity)
 {
-    const int maxVal = *std::max_element(std::begin(data), std::end(data));
-    const glm::uvec2 res { data.size(), widgetSize.y };
-
+    PROFILE_ZONE("TransferFunctionWidget createHistogramImage");
+    std::vector<size_t> columns(static_cast<size_t>(width));
+    tbb::parallel_for(0, width, [&](int x) {
+        const size_t first = size_t(x) * data.size() / size_t(width);
+        const size_t last = size_t(x + 1) * data.size() / size_t(width);
+        columns[size_t(x)] = *std::max_element(std::begin(data) + std::ptrdiff_t(first), std::begin(data) + std::ptrdiff_t(last));
+    });
+
+    const size_t maxVal = *std::max_element(std::begin(columns), std::end(columns));
     const float scale = float(widgetSize.y) / (float(maxVal) * 1.1f);
-    std::vector<glm::vec4> imgData(static_cast<size_t>(res.x * res.y));
-    for (unsigned x = 0; x < res.x; x++) {
-        for (unsigned y = 0; y < res.y; y++) {
-            const size_t index = static_cast<size_t>(x + y * res.x);
-            imgData[index] = (static_cast<float>(res.y - y) < static_cast<float>(data[x]) * scale) ? glm::vec4(1.f, 1.f, 1.f, opacity) : glm::vec4(0.f);
-        }
-    }
+    const uint8_t bar = uint8_t(std::lround(opacity * 255.0f));
+    std::vector<uint8_t> imgData(size_t(width) * size_t(widgetSize.y));
+    tbb::parallel_for(0, widgetSize.y, [&](int y) {
+        uint8_t* row = imgData.data() + size_t(y) * size_t(width);
+        for (size_t x = 0; x < columns.size(); x++)
+            row[x] = (static_cast<float>(widgetSize.y - y) < static_cast<float>(columns[x]) * scale) ? bar : uint8_t(0);
+    });
     return imgData;
 }
 
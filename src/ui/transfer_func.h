@@ -1,5 +1,6 @@
 #pragma once
 #include "render/render_config.h"
+#include "ui/histogram_image.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
 #include <glm/vec2.hpp>
@@ -10,7 +11,9 @@ namespace ui {
 
 class TransferFunctionWidget {
 public:
-    TransferFunctionWidget(const volume::Volume& volume);
+    TransferFunctionWidget(const volume::Volume& volume, const HistogramImage& histogramImage);
+
+    static HistogramImage createHistogramImage(const volume::Volume& volume);
 
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig) const;
@@ -1,18 +1,25 @@
 #include "transfer_func_2d.h"
+#include "profiling/profiler.h"
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <imgui.h>
 #include <iostream>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
 #include <vector>
 
 static ImVec2 glmToIm(const glm::vec2& v);
 static glm::vec2 ImToGlm(const ImVec2& v);
-static std::vector<glm::vec4> createHistogramImage(
-    const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res);
+template <typename T>
+static std::vector<size_t> binVoxels(const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res);
 
 namespace ui {
 
@@ -20,25 +27,36 @@ namespace ui {
 static constexpr float pointRadius = 8.0f;
 static constexpr glm::ivec2 widgetSize { 475, 300 };
 
-TransferFunction2DWidget::TransferFunction2DWidget(const volume::Volume& volume, const volume::GradientVolume& gradient)
+TransferFunction2DWidget::TransferFunction2DWidget(const volume::Volume& volume, const HistogramImage& histogramImage)
     : m_intensity(92.34f)
     , m_maxIntensity(volume.maximum())
     , m_radius(125.26f)
     , m_color(0.0f, 0.8f, 0.6f, 0.3f)
     , m_interactingPoint(-1)
-    , m_histogramImg(0)
+    , m_histogramImg(createHistogramTexture(histogramImage))
 {
-    const glm::ivec2 res = glm::ivec2(volume.maximum(), gradient.maxMagnitude() + 1);
-    const auto imgData = createHistogramImage(volume, gradient, res);
-
-    glGenTextures(1, &m_histogramImg);
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, m_histogramImg);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, res.x, res.y, 0, GL_RGBA, GL_FLOAT, imgData.data());
+}
+
+// Compute a histogram image (the opacity of every pixel) from the volume and gradient data. There is one bin per
+// integer voxel value and gradient magnitude, with at least one column for float volumes with values below 1, but no
+// more bins than the widget has pixels.
+HistogramImage TransferFunction2DWidget::createHistogramImage(const volume::Volume& volume, const volume::GradientVolume& gradient)
+{
+    PROFILE_ZONE("TransferFunction2DWidget createHistogramImage");
+    if (volume.numVoxels() == 0)
+        return HistogramImage {};
+    const glm::ivec2 res = glm::min(glm::ivec2(std::max(volume.maximum(), 1.0f), gradient.maxMagnitude() + 1), widgetSize);
+    const std::vector<size_t> bins = volume::withVoxelType(volume.voxelType(), [&](auto type) { return binVoxels<decltype(type)>(volume, gradient, res); });
+
+    // Logarithmic scale: empty bins and bins with a single voxel are transparent, the fullest bin is opaque.
+    const size_t maxCount = *std::max_element(std::begin(bins), std::end(bins));
+    const float factor = 255.0f / std::log(float(std::max(maxCount, size_t(2))));
+    HistogramImage image { res, std::vector<uint8_t>(bins.size()) };
+    std::transform(std::begin(bins), std::end(bins), std::begin(image.opacity),
+        [&](size_t count) {
+            return count > 1 ? uint8_t(std::lround(std::log(float(count)) * factor)) : uint8_t(0);
+        });
+    return image;
 }
 
 // Draw the widget and handle interactions
@@ -211,30 +229,35 @@ static glm::vec2 ImToGlm(const ImVec2& v)
     return glm::vec2(v.x, v.y);
 }
 
-// Compute a histogram texture from the volume and gradient data
-static std::vector<glm::vec4> createHistogramImage(
+// Count the voxels per (value, gradient magnitude) bin of a res.x by res.y image, with the gradient magnitude going
+// up. Voxel values [0, max(maximum, 1)] and magnitudes [0, maxMagnitude + 1) are scaled to the image; when there are
+// as many columns (rows) as integer values (magnitudes), bin i holds the values in [i, i + 1).
+template <typename T>
+static std::vector<size_t> binVoxels(
     const volume::Volume& volume, const volume::GradientVolume& gradient, const glm::ivec2& res)
 {
-    const size_t numPixels = static_cast<size_t>(res.x * res.y);
-    std::vector<int> bins(numPixels, 0);
-    for (int z = 0; z < volume.dims().z; z++) {
-        for (int y = 0; y < volume.dims().y; y++) {
-            for (int x = 0; x < volume.dims().x; x++) {
-                const size_t imgX = static_cast<size_t>(volume.getVoxel(x, y, z));
-                const size_t imgY = static_cast<size_t>(res.y - 1) - static_cast<size_t>(gradient.getGradient(x, y, z).magnitude);
-                const size_t index = imgX + imgY * static_cast<size_t>(res.x);
-                bins[index]++;
-            }
+    const gsl::span<const T> voxels = volume.data<T>();
+    const gsl::span<const volume::GradientVoxel> gradients = gradient.data();
+    const float xScale = float(res.x) / std::max(volume.maximum(), 1.0f);
+    const float yScale = float(res.y) / float(int(gradient.maxMagnitude() + 1));
+    const size_t numPixels = size_t(res.x) * size_t(res.y);
+
+    // Every thread counts into its own bins, which are summed at the end.
+    tbb::enumerable_thread_specific<std::vector<size_t>> threadBins(numPixels, 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, voxels.size(), 1 << 16), [&](const tbb::blocked_range<size_t>& range) {
+        std::vector<size_t>& bins = threadBins.local();
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            if (std::isnan(float(voxels[i])))
+                continue;
+            // Negative (int16 and float) values fall into the first column.
+            const int imgX = std::min(int(std::max(float(voxels[i]), 0.0f) * xScale), res.x - 1);
+            const int imgY = res.y - 1 - std::min(int(gradients[i].magnitude * yScale), res.y - 1);
+            bins[size_t(imgX) + size_t(imgY) * size_t(res.x)]++;
         }
-    }
+    });
 
-    const int maxCount = *std::max_element(std::begin(bins), std::end(bins));
-    const float factor = 1.0f / std::log(float(maxCount));
-
-    std::vector<glm::vec4> imageData(numPixels, glm::vec4(0.0f));
-    std::transform(std::begin(bins), std::end(bins), std::begin(imageData),
-        [&](int count) {
-            return glm::vec4(1.0f, 1.0f, 1.0f, std::log(float(count)) * factor);
-        });
-    return imageData;
+    std::vector<size_t> bins(numPixels, 0);
+    for (const std::vector<size_t>& localBins : threadBins)
+        std::transform(std::begin(bins), std::end(bins), std::begin(localBins), std::begin(bins), std::plus<size_t>());
+    return bins;
 }
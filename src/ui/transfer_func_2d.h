@@ -1,5 +1,6 @@
 #pragma once
 #include "render/render_config.h"
+#include "ui/histogram_image.h"
 #include "volume/gradient_volume.h"
 #include "volume/volume.h"
 #include <GL/glew.h> // Include before glfw3
@@ -10,7 +11,9 @@ namespace ui {
 
 class TransferFunction2DWidget {
 public:
-    TransferFunction2DWidget(const volume::Volume& volume, const volume::GradientVolume& gradient);
+    TransferFunction2DWidget(const volume::Volume& volume, const HistogramImage& histogramImage);
+
+    static HistogramImage createHistogramImage(const volume::Volume& volume, const volume::GradientVolume& gradient);
 
     void draw();
     void updateRenderConfig(render::RenderConfig& renderConfig);
@@ -0,0 +1,132 @@
+#include "volume_loader.h"
+#include "profiling/profiler.h"
+#include "ui/transfer_func.h"
+#include "ui/transfer_func_2d.h"
+#include <fmt/format.h>
+#include <glm/gtx/component_wise.hpp>
+#include <iostream>
+#include <tbb/flow_graph.h>
+
+namespace ui {
+
+// Reads every stride-th voxel of the region straight from the file, so that the preview does not wait for the whole
+// region to be read.
+static LoadedVolume loadPreview(const std::filesystem::path& filePath, volume::Volume::Region region, int stride)
+{
+    LoadedVolume preview;
+    region.stride = std::max(region.stride, 1) * stride;
+    preview.pVolume = std::make_unique<volume::Volume>(filePath, region);
+    preview.pGradientVolume = std::make_unique<volume::GradientVolume>(*preview.pVolume);
+    preview.histogramImage = TransferFunctionWidget::createHistogramImage(*preview.pVolume);
+    preview.histogramImage2D = TransferFunction2DWidget::createHistogramImage(*preview.pVolume, *preview.pGradientVolume);
+    preview.stride = stride;
+    return preview;
+}
+
+LoadedVolume loadVolume(const std::filesystem::path& filePath, const volume::Volume::Region& region, const LoadCallbacks& callbacks)
+{
+    PROFILE_ZONE("loadVolume");
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+
+    LoadedVolume result;
+    // A node of the graph that runs function and records when it ran.
+    using Node = tbb::flow::continue_node<tbb::flow::continue_msg>;
+    tbb::flow::graph graph;
+    const auto phase = [&](LoadPhase loadPhase, auto function, tbb::flow::node_priority_t priority = tbb::flow::no_priority) {
+        return Node(graph, [&result, &start, &callbacks, loadPhase, function](tbb::flow::continue_msg) {
+            LoadedVolume::PhaseTime& time = result.phaseTimes[size_t(loadPhase)];
+            time.start = clock::now() - start;
+            function();
+            time.end = clock::now() - start;
+            if (callbacks.phaseCompleted)
+                callbacks.phaseCompleted(loadPhase);
+        }, priority);
+    };
+
+    Node read = phase(LoadPhase::Read, [&]() {
+        result.pVolume = std::make_unique<volume::Volume>(filePath, region, volume::Volume::Properties::Defer);
+    });
+    // Alongside Read, and before the other phases, which may take a while when there are fewer threads than phases.
+    Node preview = phase(LoadPhase::Preview, [&]() {
+        const int stride = (glm::compMax(volume::Volume::regionDims(filePath, region)) + previewResolution - 1) / previewResolution;
+        if (callbacks.previewReady && stride > 1)
+            callbacks.previewReady(loadPreview(filePath, region, stride));
+    }, 1);
+    Node properties = phase(LoadPhase::Properties, [&]() { result.pVolume->computeProperties(); });
+    Node gradients = phase(LoadPhase::Gradients, [&]() { result.pGradientVolume = std::make_unique<volume::GradientVolume>(*result.pVolume); });
+    Node histogram = phase(LoadPhase::Histogram, [&]() {
+        result.histogramImage = TransferFunctionWidget::createHistogramImage(*result.pVolume);
+    });
+    Node histogram2D = phase(LoadPhase::Histogram2D, [&]() {
+        result.histogramImage2D = TransferFunction2DWidget::createHistogramImage(*result.pVolume, *result.pGradientVolume);
+    });
+    tbb::flow::make_edge(read, properties);
+    tbb::flow::make_edge(read, gradients);
+    tbb::flow::make_edge(properties, histogram);
+    tbb::flow::make_edge(properties, histogram2D);
+    tbb::flow::make_edge(gradients, histogram2D);
+
+    preview.try_put(tbb::flow::continue_msg());
+    read.try_put(tbb::flow::continue_msg());
+    graph.wait_for_all();
+    result.loadTime = clock::now() - start;
+
+    std::cout << fmt::format("Loaded {} in {:.1f}ms", filePath.filename().string(), result.loadTime.count() * 1000.0) << std::endl;
+    for (size_t i = 0; i < numLoadPhases; i++) {
+        const LoadedVolume::PhaseTime& time = result.phaseTimes[i];
+        std::cout << fmt::format("  {:<12} {:8.1f}ms - {:8.1f}ms ({:.1f}ms)", loadPhaseNames[i],
+            time.start.count() * 1000.0, time.end.count() * 1000.0, (time.end - time.start).count() * 1000.0)
+                  << std::endl;
+    }
+    return result;
+}
+
+bool VolumeLoader::start(const std::filesystem::path& filePath, const volume::Volume::Region& region)
+{
+    if (m_futureVolume.valid())
+        return false;
+    if (glm::compMin(volume::Volume::regionDims(filePath, region)) <= 0) {
+        std::cerr << "No voxels of " << filePath.string() << " in the region to load" << std::endl;
+        return false;
+    }
+
+    m_completedPhases = 0;
+    const LoadCallbacks callbacks {
+        [this](LoadPhase) { m_completedPhases++; },
+        [this](LoadedVolume&& preview) {
+            std::lock_guard lock { m_previewMutex };
+            m_optPreview = std::move(preview);
+        }
+    };
+    m_futureVolume = std::async(std::launch::async, [=]() { return loadVolume(filePath, region, callbacks); });
+    return true;
+}
+
+std::optional<float> VolumeLoader::progress() const
+{
+    if (!m_futureVolume.valid())
+        return {};
+    return float(m_completedPhases) / float(numLoadPhases);
+}
+
+std::optional<LoadedVolume> VolumeLoader::takePreview()
+{
+    std::lock_guard lock { m_previewMutex };
+    std::optional<LoadedVolume> optPreview = std::move(m_optPreview);
+    m_optPreview.reset();
+    return optPreview;
+}
+
+std::optional<LoadedVolume> VolumeLoader::takeVolume()
+{
+    if (!m_futureVolume.valid() || m_futureVolume.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return {};
+
+    {
+        std::lock_guard lock { m_previewMutex };
+        m_optPreview.reset();
+    }
+    return m_futureVolume.get();
+}
+}
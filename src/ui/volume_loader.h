@@ -0,0 +1,91 @@
+#pragma once
+#include "ui/histogram_image.h"
+#include "volume/gradient_volume.h"
+#include "volume/volume.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace ui {
+
+// The phases of loading a volume. Everything after Read only depends on the voxels and the phases listed with it, so
+// the phases run concurrently where they can:
+//   Preview (see LoadCallbacks::previewReady), which reads the file on its own
+//   Read -> Properties (value range, histogram) -> Histogram
+//   Read -> Gradients -> Histogram2D (which also needs the value range)
+enum class LoadPhase {
+    Read = 0,
+    Preview,
+    Properties,
+    Gradients,
+    Histogram,
+    Histogram2D
+};
+constexpr size_t numLoadPhases = 6;
+constexpr std::array<const char*, numLoadPhases> loadPhaseNames { "Read", "Preview", "Properties", "Gradients", "Histogram", "Histogram2D" };
+
+// A volume with everything that the viewer derives from it. Only the upload of the histogram images is left to the
+// OpenGL thread.
+struct LoadedVolume {
+    std::unique_ptr<volume::Volume> pVolume;
+    std::unique_ptr<volume::GradientVolume> pGradientVolume;
+    HistogramImage histogramImage, histogramImage2D;
+    // pVolume holds every stride-th voxel of the loaded region along every axis: 1, or more for a preview.
+    int stride { 1 };
+
+    // Start and end of every phase, relative to the start of loading.
+    struct PhaseTime {
+        std::chrono::duration<double> start, end;
+    };
+    std::array<PhaseTime, numLoadPhases> phaseTimes;
+    std::chrono::duration<double> loadTime;
+};
+
+// Called by the threads that load a volume.
+struct LoadCallbacks {
+    std::function<void(LoadPhase)> phaseCompleted;
+    // A downsampled copy of the volume (with previewResolution voxels along its longest axis) with its gradients and
+    // histograms, read from the file while the full volume is being read. Not called for volumes that are that small
+    // already.
+    std::function<void(LoadedVolume&&)> previewReady;
+};
+constexpr int previewResolution = 64;
+
+// Load a volume (or only a region of it) from an .fld file and print how long every phase took. The region has to
+// hold at least one voxel of the file (see VolumeLoader::start).
+LoadedVolume loadVolume(const std::filesystem::path& filePath, const volume::Volume::Region& region = {}, const LoadCallbacks& callbacks = {});
+
+// Loads volumes on a background thread so that the window stays responsive. The UI thread polls for the preview and
+// for the loaded volume every frame and swaps them in between two frames, so rendering never sees a volume that is
+// still being built.
+class VolumeLoader {
+public:
+    // Waits for a volume that is still being loaded.
+    ~VolumeLoader() = default;
+
+    // Start loading, unless a volume is being loaded already or the region holds no voxels of the file (a region
+    // outside of the file, or a file that cannot be read). Returns whether loading started.
+    bool start(const std::filesystem::path& filePath, const volume::Volume::Region& region = {});
+    // The fraction of the load phases that completed, if a volume is being loaded.
+    std::optional<float> progress() const;
+
+    // The preview and the loaded volume, each returned once. A preview that was not taken before the volume finished
+    // loading is dropped.
+    std::optional<LoadedVolume> takePreview();
+    std::optional<LoadedVolume> takeVolume();
+
+private:
+    std::atomic_int m_completedPhases { 0 };
+    std::mutex m_previewMutex;
+    std::optional<LoadedVolume> m_optPreview;
+
+    // Last, so that it is destroyed (which waits for the loading thread) before the members that thread uses.
+    std::future<LoadedVolume> m_futureVolume;
+};
+}
@@ -1,9 +1,11 @@
 #include "gradient_volume.h"
+#include "profiling/profiler.h"
 #include <algorithm>
 #include <exception>
 #include <glm/geometric.hpp>
 #include <glm/vector_relational.hpp>
 #include <gsl/span>
+#include <tbb/parallel_for.h>
 
 namespace volume {
 
@@ -31,13 +33,14 @@ static float computeMinMagnitude(gsl::span<const GradientVoxel> data)
         ->magnitude;
 }
 
-// Compute a gradient volume from a volume
+// Compute a gradient volume from a volume, one slice per task
 static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
 {
+    PROFILE_ZONE("computeGradientVolume");
     const auto dim = volume.dims();
 
-    std::vector<GradientVoxel> out(static_cast<size_t>(dim.x * dim.y * dim.z));
-    for (int z = 1; z < dim.z - 1; z++) {
+    std::vector<GradientVoxel> out(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    tbb::parallel_for(1, std::max(dim.z - 1, 1), [&](int z) {
         for (int y = 1; y < dim.y - 1; y++) {
             for (int x = 1; x < dim.x - 1; x++) {
                 const float gx = (volume.getVoxel(x + 1, y, z) - volume.getVoxel(x - 1, y, z)) / 2.0f;
@@ -45,11 +48,11 @@ static std::vector<GradientVoxel> computeGradientVolume(const Volume& volume)
                 const float gz = (volume.getVoxel(x, y, z + 1) - volume.getVoxel(x, y, z - 1)) / 2.0f;
 
                 const glm::vec3 v { gx, gy, gz };
-                const size_t index = static_cast<size_t>(x + dim.x * (y + dim.y * z));
+                const size_t index = size_t(x) + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z));
                 out[index] = GradientVoxel { v, glm::length(v) };
             }
         }
-    }
+    });
     return out;
 }
 
@@ -76,6 +79,11 @@ glm::ivec3 GradientVolume::dims() const
     return m_dim;
 }
 
+gsl::span<const GradientVoxel> GradientVolume::data() const
+{
+    return m_data;
+}
+
 // This function returns a gradientVoxel at coord based on the current interpolation mode.
 GradientVoxel GradientVolume::getGradientInterpolate(const glm::vec3& coord) const
 {
@@ -175,7 +183,7 @@ GradientVoxel GradientVolume::linearInterpolate(const GradientVoxel& g0, const G
 // This function returns a gradientVoxel without using interpolation
 GradientVoxel GradientVolume::getGradient(int x, int y, int z) const
 {
-    const size_t i = static_cast<size_t>(x + m_dim.x * (y + m_dim.y * z));
+    const size_t i = size_t(x) + size_t(m_dim.x) * (size_t(y) + size_t(m_dim.y) * size_t(z));
     return m_data[i];
 }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "volume.h"
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <gsl/span>
 #include <string>
 #include <vector>
 
@@ -25,6 +26,8 @@ public:
     float minMagnitude() const;
     float maxMagnitude() const;
     glm::ivec3 dims() const;
+    // Gradients in x-major order (index = x + dims.x * (y + dims.y * z)).
+    gsl::span<const GradientVoxel> data() const;
 
 protected:
     GradientVoxel getGradientNearestNeighbor(const glm::vec3& coord) const;
@@ -0,0 +1,128 @@
+#include "max_pyramid.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <glm/vec2.hpp>
+#include <glm/vector_relational.hpp>
+#include <gsl/span>
+#include <limits>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+MaxPyramid::MaxPyramid(const Volume& volume)
+    : m_dims(volume.dims())
+{
+    PROFILE_ZONE("MaxPyramid");
+    const size_t strideY = size_t(m_dims.x), strideZ = size_t(m_dims.x) * size_t(m_dims.y);
+
+    Level bricks;
+    bricks.size = (m_dims + brickSize - 1) / brickSize;
+    bricks.maxima.resize(size_t(bricks.size.x) * size_t(bricks.size.y) * size_t(bricks.size.z));
+    for (int axis = 0; axis < 3; axis++) {
+        const glm::ivec2 axes = otherAxes(axis);
+        m_axisImages[size_t(axis)].assign(size_t(m_dims[axes.x]) * size_t(m_dims[axes.y]), std::numeric_limits<float>::lowest());
+    }
+
+    withVoxelType(volume.voxelType(), [&](auto type) {
+        using T = decltype(type);
+        const gsl::span<const T> voxels = volume.data<T>();
+
+        // Level 0: the voxels of a brick up to and including the first voxels of the next bricks.
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, bricks.maxima.size()), [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                const glm::ivec3 index { int(i % size_t(bricks.size.x)), int(i / size_t(bricks.size.x) % size_t(bricks.size.y)), int(i / (size_t(bricks.size.x) * size_t(bricks.size.y))) };
+                const glm::ivec3 begin = index * brickSize;
+                const glm::ivec3 end = glm::min(begin + brickSize + 1, m_dims);
+                float maximum = std::numeric_limits<float>::lowest();
+                for (int z = begin.z; z < end.z; z++) {
+                    for (int y = begin.y; y < end.y; y++) {
+                        const T* pRow = voxels.data() + size_t(y) * strideY + size_t(z) * strideZ;
+                        for (int x = begin.x; x < end.x; x++)
+                            maximum = std::max(maximum, float(pRow[x]));
+                    }
+                }
+                bricks.maxima[i] = maximum;
+            }
+        });
+
+        // The images along x and y get a row per slice along z, so the slices can be split over the threads; the image
+        // along z gets a row per row along y.
+        std::vector<float>& imageX = m_axisImages[0];
+        std::vector<float>& imageY = m_axisImages[1];
+        tbb::parallel_for(tbb::blocked_range<int>(0, m_dims.z), [&](const tbb::blocked_range<int>& range) {
+            for (int z = range.begin(); z != range.end(); z++) {
+                for (int y = 0; y < m_dims.y; y++) {
+                    const T* pRow = voxels.data() + size_t(y) * strideY + size_t(z) * strideZ;
+                    float& rowMaximum = imageX[size_t(y) + size_t(m_dims.y) * size_t(z)];
+                    float* pImageY = &imageY[size_t(m_dims.x) * size_t(z)];
+                    for (int x = 0; x < m_dims.x; x++) {
+                        const float value = float(pRow[x]);
+                        rowMaximum = std::max(rowMaximum, value);
+                        pImageY[x] = std::max(pImageY[x], value);
+                    }
+                }
+            }
+        });
+        std::vector<float>& imageZ = m_axisImages[2];
+        tbb::parallel_for(tbb::blocked_range<int>(0, m_dims.y), [&](const tbb::blocked_range<int>& range) {
+            for (int y = range.begin(); y != range.end(); y++) {
+                float* pImageZ = &imageZ[size_t(m_dims.x) * size_t(y)];
+                for (int z = 0; z < m_dims.z; z++) {
+                    const T* pRow = voxels.data() + size_t(y) * strideY + size_t(z) * strideZ;
+                    for (int x = 0; x < m_dims.x; x++)
+                        pImageZ[x] = std::max(pImageZ[x], float(pRow[x]));
+                }
+            }
+        });
+    });
+
+    // Every next level takes the maximum of (up to) 2^3 nodes of the level below. The levels of an empty volume have no
+    // nodes along its empty axes.
+    m_levels.push_back(std::move(bricks));
+    while (glm::any(glm::greaterThan(m_levels.back().size, glm::ivec3(1)))) {
+        const Level& children = m_levels.back();
+        Level parents;
+        parents.size = (children.size + 1) / 2;
+        parents.maxima.assign(size_t(parents.size.x) * size_t(parents.size.y) * size_t(parents.size.z), std::numeric_limits<float>::lowest());
+        for (int z = 0; z < children.size.z; z++) {
+            for (int y = 0; y < children.size.y; y++) {
+                for (int x = 0; x < children.size.x; x++) {
+                    const size_t child = size_t(x) + size_t(children.size.x) * (size_t(y) + size_t(children.size.y) * size_t(z));
+                    const size_t parent = size_t(x / 2) + size_t(parents.size.x) * (size_t(y / 2) + size_t(parents.size.y) * size_t(z / 2));
+                    parents.maxima[parent] = std::max(parents.maxima[parent], children.maxima[child]);
+                }
+            }
+        }
+        m_levels.push_back(std::move(parents));
+    }
+}
+
+glm::ivec3 MaxPyramid::dims() const
+{
+    return m_dims;
+}
+
+int MaxPyramid::numLevels() const
+{
+    return int(m_levels.size());
+}
+
+glm::ivec3 MaxPyramid::levelSize(int level) const
+{
+    return m_levels[size_t(level)].size;
+}
+
+float MaxPyramid::maximum() const
+{
+    const Level& top = m_levels.back();
+    return top.maxima.empty() ? std::numeric_limits<float>::lowest() : top.maxima[0];
+}
+
+float MaxPyramid::columnMaximum(int axis, int u, int v) const
+{
+    const glm::ivec2 axes = otherAxes(axis);
+    return m_axisImages[size_t(axis)][size_t(u) + size_t(m_dims[axes.x]) * size_t(v)];
+}
+
+}
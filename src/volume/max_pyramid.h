@@ -0,0 +1,85 @@
+#pragma once
+#include "volume/volume.h"
+#include <array>
+#include <cstddef>
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+#include <optional>
+#include <vector>
+
+namespace volume {
+
+// Maxima of a volume for MIP rays that skip the parts of the volume that cannot raise their maximum (see
+// RenderConfig::maxPyramidTraversal). Level 0 divides the volume into bricks of brickSize^3 voxels; every next level
+// merges 2^3 nodes of the level below, up to a single node that covers the whole volume. The maximum of a node includes
+// the first voxels of the next nodes along x, y and z, so that no nearest neighbour or trilinear sample in the node
+// exceeds it.
+// Also holds the MIP image of the volume along each axis: the maximum of every column of voxels parallel to that axis.
+class MaxPyramid {
+public:
+    static constexpr int brickSize = 8;
+
+    // The voxels [lower, upper) of a node, and its maximum.
+    struct Node {
+        glm::vec3 lower, upper;
+        float maximum;
+
+        bool contains(const glm::vec3& position) const
+        {
+            return position.x >= lower.x && position.y >= lower.y && position.z >= lower.z && position.x < upper.x && position.y < upper.y && position.z < upper.z;
+        }
+    };
+
+public:
+    explicit MaxPyramid(const Volume& volume);
+
+    glm::ivec3 dims() const;
+    int numLevels() const;
+    glm::ivec3 levelSize(int level) const;
+    // The maximum of node index of level (see the class comment), and of the whole volume (the lowest float if it is
+    // empty).
+    float maximum(int level, const glm::ivec3& index) const
+    {
+        const Level& l = m_levels[size_t(level)];
+        return l.maxima[size_t(index.x) + size_t(l.size.x) * (size_t(index.y) + size_t(l.size.y) * size_t(index.z))];
+    }
+    float maximum() const;
+
+    // The node that holds position: the largest one whose maximum is at most value, or the brick at level 0 if even
+    // that exceeds value. Nothing if position lies outside of the volume. Inline, as MIP rays look up a node whenever
+    // they enter one.
+    std::optional<Node> findNode(const glm::vec3& position, float value) const
+    {
+        if (!(position.x >= 0.0f && position.y >= 0.0f && position.z >= 0.0f && position.x < float(m_dims.x) && position.y < float(m_dims.y) && position.z < float(m_dims.z)))
+            return std::nullopt;
+
+        glm::ivec3 index = glm::ivec3(position) / brickSize;
+        float nodeMaximum = maximum(0, index);
+        int level = 0;
+        while (nodeMaximum <= value && level + 1 < int(m_levels.size())) {
+            const float parentMaximum = maximum(level + 1, index / 2);
+            if (parentMaximum > value)
+                break;
+            nodeMaximum = parentMaximum;
+            index /= 2;
+            level++;
+        }
+        const int size = brickSize << level;
+        return Node { glm::vec3(index * size), glm::vec3(glm::min((index + 1) * size, m_dims)), nodeMaximum };
+    }
+
+    // The maximum of the column of voxels along axis through voxel (u, v) of the other two axes (in the order x, y, z).
+    float columnMaximum(int axis, int u, int v) const;
+
+private:
+    struct Level {
+        glm::ivec3 size;
+        std::vector<float> maxima;
+    };
+
+    glm::ivec3 m_dims;
+    std::vector<Level> m_levels;
+    std::array<std::vector<float>, 3> m_axisImages;
+};
+
+}
@@ -0,0 +1,290 @@
+#include "procedural_volume.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <glm/glm.hpp>
+#include <glm/gtx/component_wise.hpp>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <vector>
+
+namespace volume {
+
+// Computes the voxels of the row (y, z) of a scene, in [0, 1], for x from 0 to dims.x. The row starts out as 0.
+using RowFunction = std::function<void(int y, int z, float* row)>;
+
+static constexpr float twoPi = 6.28318530718f;
+
+// The finaliser of MurmurHash3. The scenes only use their own random numbers (instead of those of <random>, whose
+// distributions differ between standard libraries), so that they are the same on every platform.
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+// Random number in [0, 1) for every (seed, i, j).
+static float random(uint32_t seed, uint32_t i, uint32_t j = 0)
+{
+    return float(hash(seed ^ hash(i ^ hash(j + 0x9e3779b9u))) >> 8) * (1.0f / 16777216.0f);
+}
+
+static float random(uint32_t seed, uint32_t i, uint32_t j, float low, float high)
+{
+    return low + (high - low) * random(seed, i, j);
+}
+
+// Fractal value noise: octaves of random values on a lattice, each interpolated with smoothstep weights. The first
+// octave has 4 lattice cells along the longest axis, so the noise looks the same at every resolution.
+static RowFunction noiseScene(const ProceduralVolumeSettings& settings)
+{
+    static constexpr int numOctaves = 4;
+    const float baseFrequency = 4.0f / float(glm::compMax(settings.dims));
+    return [=](int y, int z, float* row) {
+        const auto smooth = [](float f) { return f * f * (3.0f - 2.0f * f); };
+        float amplitude = 1.0f, totalAmplitude = 0.0f;
+        for (int octave = 0; octave < numOctaves; octave++) {
+            const uint32_t seed = hash(settings.seed + uint32_t(octave));
+            const float frequency = baseFrequency * float(1 << octave);
+            const float py = float(y) * frequency, pz = float(z) * frequency;
+            const int y0 = int(py), z0 = int(pz);
+            const float wy = smooth(py - float(y0)), wz = smooth(pz - float(z0));
+            const auto lattice = [&](int x, int dy, int dz) { return random(seed, uint32_t(x), uint32_t(y0 + dy) + (uint32_t(z0 + dz) << 16)); };
+            // Along the row the noise interpolates lattice columns that were already interpolated along y and z.
+            const auto column = [&](int x) {
+                const float bottom = glm::mix(lattice(x, 0, 0), lattice(x, 1, 0), wy);
+                const float top = glm::mix(lattice(x, 0, 1), lattice(x, 1, 1), wy);
+                return glm::mix(bottom, top, wz);
+            };
+            int cell = -1;
+            float lower = 0.0f, upper = 0.0f;
+            for (int x = 0; x < settings.dims.x; x++) {
+                const float px = float(x) * frequency;
+                const int x0 = int(px);
+                if (x0 != cell) {
+                    cell = x0;
+                    lower = column(x0);
+                    upper = column(x0 + 1);
+                }
+                row[x] += amplitude * glm::mix(lower, upper, smooth(px - float(x0)));
+            }
+            totalAmplitude += amplitude;
+            amplitude *= 0.5f;
+        }
+        // The sum of the octaves clusters around 0.5; stretch it to use more of the value range.
+        for (int x = 0; x < settings.dims.x; x++)
+            row[x] = std::clamp((row[x] / totalAmplitude - 0.5f) * 2.5f + 0.5f, 0.0f, 1.0f);
+    };
+}
+
+// Nested spheres: the values step down from 1 at the centre to 1 / numShells at the outer sphere.
+static RowFunction spheresScene(const ProceduralVolumeSettings& settings)
+{
+    static constexpr int numShells = 5;
+    const glm::vec3 center = glm::vec3(settings.dims - 1) / 2.0f;
+    const float radius = 0.95f * float(glm::compMin(settings.dims)) / 2.0f;
+    return [=](int y, int z, float* row) {
+        const float dy = float(y) - center.y, dz = float(z) - center.z;
+        for (int x = 0; x < settings.dims.x; x++) {
+            const float dx = float(x) - center.x;
+            const float r = std::sqrt(dx * dx + dy * dy + dz * dz) / radius;
+            if (r < 1.0f)
+                row[x] = float(numShells - int(r * float(numShells))) / float(numShells);
+        }
+    };
+}
+
+// The voxels of the row within radius of center (in the plane of the row), with their squared distance to center
+// divided by radius^2.
+template <typename Function>
+static void forEachVoxelInDisk(int numVoxels, float centerX, float offset, float radius, Function&& function)
+{
+    const float halfWidthSquared = radius * radius - offset * offset;
+    if (halfWidthSquared <= 0.0f)
+        return;
+    const float halfWidth = std::sqrt(halfWidthSquared);
+    const int begin = std::max(int(std::ceil(centerX - halfWidth)), 0);
+    const int end = std::min(int(std::floor(centerX + halfWidth)) + 1, numVoxels);
+    for (int x = begin; x < end; x++) {
+        const float dx = float(x) - centerX;
+        function(x, (dx * dx + offset * offset) / (radius * radius));
+    }
+}
+
+// Tubes that wind along y (odd tubes) or z (even tubes), so that the centre of every tube is the same for a whole row.
+static RowFunction vesselsScene(const ProceduralVolumeSettings& settings)
+{
+    static constexpr int numTubes = 16;
+    struct Tube {
+        int axis;
+        // The centre along x and along the third axis follows base + amplitude * sin(2 pi (frequency * t + phase)), in
+        // units of the size of the volume, with t from 0 to 1 along the axis of the tube.
+        std::array<float, 2> base, amplitude, frequency, phase;
+        float radius;
+    };
+    const glm::ivec3 dims = settings.dims;
+    std::vector<Tube> tubes;
+    for (uint32_t i = 0; i < uint32_t(numTubes); i++) {
+        Tube tube;
+        tube.axis = i % 2 == 0 ? 2 : 1;
+        for (uint32_t j = 0; j < 2; j++) {
+            tube.base[j] = random(settings.seed, i, 4 * j, 0.2f, 0.8f);
+            tube.amplitude[j] = random(settings.seed, i, 4 * j + 1, 0.03f, 0.15f);
+            tube.frequency[j] = random(settings.seed, i, 4 * j + 2, 0.5f, 2.0f);
+            tube.phase[j] = random(settings.seed, i, 4 * j + 3);
+        }
+        tube.radius = random(settings.seed, i, 8, 0.01f, 0.03f) * float(glm::compMin(dims));
+        tubes.push_back(tube);
+    }
+    return [=](int y, int z, float* row) {
+        for (const Tube& tube : tubes) {
+            // The axis of the tube and the other axis in the plane of the row.
+            const int other = tube.axis == 2 ? 1 : 2;
+            const float t = float(tube.axis == 2 ? z : y) / float(dims[tube.axis]);
+            const auto center = [&](size_t j, int size) {
+                return (tube.base[j] + tube.amplitude[j] * std::sin(twoPi * (tube.frequency[j] * t + tube.phase[j]))) * float(size);
+            };
+            const float offset = float(tube.axis == 2 ? y : z) - center(1, dims[other]);
+            forEachVoxelInDisk(dims.x, center(0, dims.x), offset, tube.radius, [&](int x, float distanceSquared) {
+                row[x] = std::max(row[x], 1.0f - 0.6f * distanceSquared);
+            });
+        }
+    };
+}
+
+// Balls with a radius of 2.5% of the shortest axis, as many as fill the requested fraction of the volume. Each ball
+// is solid with a soft rim and has its own value in [0.5, 1].
+static RowFunction sparseScene(const ProceduralVolumeSettings& settings)
+{
+    struct Ball {
+        glm::vec3 center;
+        float value;
+    };
+    const glm::ivec3 dims = settings.dims;
+    const float radius = std::max(0.025f * float(glm::compMin(dims)), 1.0f);
+    const double numVoxels = double(dims.x) * double(dims.y) * double(dims.z);
+    const double ballVolume = 4.0 / 3.0 * 3.14159265358979 * double(radius) * double(radius) * double(radius);
+    const size_t numBalls = size_t(std::lround(std::clamp(double(settings.density), 0.0, 1.0) * numVoxels / ballVolume));
+
+    // The balls that reach into every slice.
+    std::vector<Ball> balls;
+    std::vector<std::vector<uint32_t>> sliceBalls(size_t(dims.z));
+    for (uint32_t i = 0; i < uint32_t(numBalls); i++) {
+        const glm::vec3 center { random(settings.seed, i, 0) * float(dims.x), random(settings.seed, i, 1) * float(dims.y), random(settings.seed, i, 2) * float(dims.z) };
+        balls.push_back(Ball { center, random(settings.seed, i, 3, 0.5f, 1.0f) });
+        const int begin = std::max(int(std::ceil(center.z - radius)), 0), end = std::min(int(std::floor(center.z + radius)) + 1, dims.z);
+        for (int z = begin; z < end; z++)
+            sliceBalls[size_t(z)].push_back(i);
+    }
+    return [=](int y, int z, float* row) {
+        for (const uint32_t i : sliceBalls[size_t(z)]) {
+            const Ball& ball = balls[i];
+            const float dy = float(y) - ball.center.y, dz = float(z) - ball.center.z;
+            const float offset = std::sqrt(dy * dy + dz * dz);
+            forEachVoxelInDisk(dims.x, ball.center.x, offset, radius, [&](int x, float distanceSquared) {
+                row[x] = std::max(row[x], ball.value * std::min(2.0f * (1.0f - distanceSquared), 1.0f));
+            });
+        }
+    };
+}
+
+static RowFunction sceneRowFunction(const ProceduralVolumeSettings& settings)
+{
+    switch (settings.scene) {
+    case ProceduralScene::Noise: {
+        return noiseScene(settings);
+    }
+    case ProceduralScene::Spheres: {
+        return spheresScene(settings);
+    }
+    case ProceduralScene::Vessels: {
+        return vesselsScene(settings);
+    }
+    case ProceduralScene::Sparse: {
+        return sparseScene(settings);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+float proceduralMaximum(VoxelType voxelType)
+{
+    return voxelType == VoxelType::UInt8 ? 255.0f : 4095.0f;
+}
+
+// Generate the slices [firstSlice, firstSlice + numSlices) into out, a row at a time in parallel.
+template <typename T>
+static void generateSlices(const RowFunction& rowFunction, const glm::ivec3& dims, float maximum, int firstSlice, int numSlices, T* out)
+{
+    const size_t numRows = size_t(dims.y) * size_t(numSlices);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, numRows), [&](const tbb::blocked_range<size_t>& range) {
+        std::vector<float> row(size_t(dims.x));
+        for (size_t r = range.begin(); r != range.end(); r++) {
+            std::fill(std::begin(row), std::end(row), 0.0f);
+            rowFunction(int(r % size_t(dims.y)), firstSlice + int(r / size_t(dims.y)), row.data());
+            T* pOut = out + r * size_t(dims.x);
+            for (size_t x = 0; x < row.size(); x++) {
+                if constexpr (std::is_floating_point_v<T>)
+                    pOut[x] = row[x] * maximum;
+                else
+                    pOut[x] = T(std::lround(row[x] * maximum));
+            }
+        }
+    });
+}
+
+Volume createProceduralVolume(const ProceduralVolumeSettings& settings)
+{
+    PROFILE_ZONE("createProceduralVolume");
+    assert(glm::all(glm::greaterThan(settings.dims, glm::ivec3(0))));
+    const RowFunction rowFunction = sceneRowFunction(settings);
+    const float maximum = proceduralMaximum(settings.voxelType);
+    Volume::VoxelData data = withVoxelType(settings.voxelType, [&](auto type) -> Volume::VoxelData {
+        std::vector<decltype(type)> voxels(size_t(settings.dims.x) * size_t(settings.dims.y) * size_t(settings.dims.z));
+        generateSlices(rowFunction, settings.dims, maximum, 0, settings.dims.z, voxels.data());
+        return voxels;
+    });
+    return Volume(std::move(data), settings.dims);
+}
+
+bool writeProceduralVolume(const ProceduralVolumeSettings& settings, const std::filesystem::path& file)
+{
+    PROFILE_ZONE("writeProceduralVolume");
+    assert(glm::all(glm::greaterThan(settings.dims, glm::ivec3(0))));
+    std::ofstream ofs { file, std::ios::binary };
+    if (!ofs.is_open())
+        return false;
+
+    const char* typeName = settings.voxelType == VoxelType::UInt8 ? "byte" : (settings.voxelType == VoxelType::Float32 ? "float" : "short");
+    ofs << "# AVS field file\n"
+        << "# Procedural " << proceduralSceneNames[size_t(settings.scene)] << " volume, seed " << settings.seed << "\n"
+        << "ndim=3\ndim1=" << settings.dims.x << "\ndim2=" << settings.dims.y << "\ndim3=" << settings.dims.z
+        << "\nnspace=3\nveclen=1\ndata=" << typeName << "\nfield=uniform\n\f\f";
+
+    const RowFunction rowFunction = sceneRowFunction(settings);
+    const float maximum = proceduralMaximum(settings.voxelType);
+    withVoxelType(settings.voxelType, [&](auto type) {
+        using T = decltype(type);
+        // Slabs of about 64 MB: large enough to keep all threads busy, small enough for any volume size.
+        const size_t sliceSize = size_t(settings.dims.x) * size_t(settings.dims.y);
+        const int slabSlices = int(std::clamp((size_t(64) << 20) / (sliceSize * sizeof(T)), size_t(1), size_t(settings.dims.z)));
+        std::vector<T> slab(sliceSize * size_t(slabSlices));
+        for (int z = 0; z < settings.dims.z && ofs; z += slabSlices) {
+            const int numSlices = std::min(slabSlices, settings.dims.z - z);
+            generateSlices(rowFunction, settings.dims, maximum, z, numSlices, slab.data());
+            ofs.write(reinterpret_cast<const char*>(slab.data()), std::streamsize(size_t(numSlices) * sliceSize * sizeof(T)));
+        }
+    });
+    return bool(ofs);
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "volume/volume.h"
+#include "volume/voxel_type.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <glm/vec3.hpp>
+
+namespace volume {
+
+// Synthetic scenes to benchmark the viewer at any size. Every voxel is a function of the settings and its position
+// only, so a volume does not depend on the number of threads that generate it, and a volume that is written to a file
+// is the same as one that is generated in memory.
+enum class ProceduralScene {
+    // Fractal value noise that fills the whole volume.
+    Noise = 0,
+    // Nested spheres around the centre, with higher values towards the centre.
+    Spheres,
+    // Winding tubes along y and z, bright in the middle and fading towards their walls.
+    Vessels,
+    // Small balls at random positions in an otherwise empty volume (see ProceduralVolumeSettings::density).
+    Sparse
+};
+constexpr size_t numProceduralScenes = 4;
+constexpr std::array<const char*, numProceduralScenes> proceduralSceneNames { "noise", "spheres", "vessels", "sparse" };
+
+struct ProceduralVolumeSettings {
+    ProceduralScene scene { ProceduralScene::Spheres };
+    glm::ivec3 dims { 256 };
+    VoxelType voxelType { VoxelType::UInt8 };
+    uint32_t seed { 0 };
+    // The fraction of the voxels that the balls of the Sparse scene fill (about, as balls may overlap).
+    float density { 0.01f };
+};
+
+// The largest voxel value of a procedural volume: 255 for UInt8 volumes and 4095 (the 12 bits of most CT scans) for
+// the other types.
+float proceduralMaximum(VoxelType voxelType);
+
+// Generate a procedural volume in memory.
+Volume createProceduralVolume(const ProceduralVolumeSettings& settings);
+// Write a procedural volume to an .fld file a few slices at a time, so that it does not have to fit in memory. Int16
+// volumes are written as short, which is read back as UInt16 (all values are positive). Returns false if the file
+// could not be written.
+bool writeProceduralVolume(const ProceduralVolumeSettings& settings, const std::filesystem::path& file);
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "volume.h"
+#include <array>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#if defined(_MSC_VER)
+#include <xmmintrin.h> // _mm_prefetch
+#endif
+
+namespace volume {
+
+// Samples a volume at consecutive positions along a single ray. With linear interpolation, consecutive samples
+// (sampleStep = 1) fall into the same or a neighbouring cell, so the sampler keeps the 8 corners of the current cell,
+// reuses the corners that the next cell shares with it, and prefetches the cell after that along the ray direction.
+// The result is identical to Volume::getSampleInterpolate; other interpolation modes are forwarded to it.
+// A sampler is meant to live on the stack for the duration of one ray and is not thread-safe.
+class RaySampler {
+public:
+    RaySampler(const Volume& volume, const glm::vec3& direction)
+        : m_sampler(volume.sampler())
+        , m_linear(volume.interpolationMode == InterpolationMode::Linear)
+        , m_data(volume.rawData())
+        , m_voxelType(volume.voxelType())
+        , m_dim(volume.dims())
+        , m_strideY(size_t(m_dim.x))
+        , m_strideZ(size_t(m_dim.x) * size_t(m_dim.y))
+        , m_step(direction.x > 0.0f ? 1 : -1, direction.y > 0.0f ? 1 : -1, direction.z > 0.0f ? 1 : -1)
+    {
+    }
+
+    float sample(const glm::vec3& coord)
+    {
+        if (!m_linear)
+            return m_sampler(coord);
+
+        const bool inside = (coord.x >= 0.0f) & (coord.y >= 0.0f) & (coord.z >= 0.0f)
+            & (coord.x + 1.0f < float(m_dim.x)) & (coord.y + 1.0f < float(m_dim.y)) & (coord.z + 1.0f < float(m_dim.z));
+        if (!inside)
+            return 0.0f;
+
+        const int x = int(coord.x), y = int(coord.y), z = int(coord.z);
+        if (x != m_cell.x || y != m_cell.y || z != m_cell.z)
+            moveToCell(x, y, z);
+
+        // Same blend order as Volume::getSampleTriLinearInterpolationFast so that the results are bit-identical.
+        const float xFactor = coord.x - float(x);
+        const float yFactor = coord.y - float(y);
+        const float zFactor = coord.z - float(z);
+        const auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+        const auto& c = m_corners;
+        const float bottom = lerp(lerp(c[0], c[1], xFactor), lerp(c[2], c[3], xFactor), yFactor);
+        const float top = lerp(lerp(c[4], c[5], xFactor), lerp(c[6], c[7], xFactor), yFactor);
+        return lerp(bottom, top, zFactor);
+    }
+
+private:
+    // Corners are stored at index x + 2y + 4z relative to the cell. Switching on the voxel type once per cell keeps the
+    // per-sample path free of it.
+    void moveToCell(int x, int y, int z)
+    {
+        withVoxelType(m_voxelType, [&](auto type) { moveToCell<decltype(type)>(x, y, z); });
+    }
+
+    template <typename T>
+    void moveToCell(int x, int y, int z)
+    {
+        const T* data = static_cast<const T*>(m_data);
+        const T* base = data + size_t(x) + m_strideY * size_t(y) + m_strideZ * size_t(z);
+        const int dx = x - m_cell.x, dy = y - m_cell.y, dz = z - m_cell.z;
+        const auto& c = m_corners;
+        // Offsets of the corners in memory and, per axis, the corner pairs (lower, upper) that face the axis.
+        const std::array<size_t, 8> offsets { 0, 1, m_strideY, m_strideY + 1, m_strideZ, m_strideZ + 1, m_strideZ + m_strideY, m_strideZ + m_strideY + 1 };
+        static constexpr std::array<std::array<int, 4>, 3> lowerFaces { { { 0, 2, 4, 6 }, { 0, 1, 4, 5 }, { 0, 1, 2, 3 } } };
+
+        // Moving to a face neighbour (the common case for a ray) shares a face: only the 4 far corners are loaded.
+        const int axis = (dy == 0 && dz == 0) ? 0 : ((dx == 0 && dz == 0) ? 1 : ((dx == 0 && dy == 0) ? 2 : -1));
+        const int delta = axis == 0 ? dx : (axis == 1 ? dy : dz);
+        if (axis >= 0 && (delta == 1 || delta == -1)) {
+            for (const int lower : lowerFaces[size_t(axis)]) {
+                const int upper = lower | (1 << axis);
+                const int reused = delta > 0 ? lower : upper;
+                const int loaded = delta > 0 ? upper : lower;
+                m_corners[size_t(reused)] = c[size_t(loaded)];
+                m_corners[size_t(loaded)] = float(base[offsets[size_t(loaded)]]);
+            }
+        } else {
+            for (size_t corner = 0; corner < 8; corner++)
+                m_corners[corner] = float(base[offsets[corner]]);
+        }
+        m_cell = glm::ivec3(x, y, z);
+
+        // Request the rows of the cell that the ray is heading towards so that they are cached when it gets there.
+        const int nextX = x + m_step.x, nextY = y + m_step.y, nextZ = z + m_step.z;
+        if (nextX >= 0 && nextY >= 0 && nextZ >= 0 && nextX + 1 < m_dim.x && nextY + 1 < m_dim.y && nextZ + 1 < m_dim.z) {
+            const T* next = data + size_t(nextX) + m_strideY * size_t(nextY) + m_strideZ * size_t(nextZ);
+            prefetch(next);
+            prefetch(next + m_strideY);
+            prefetch(next + m_strideZ);
+            prefetch(next + m_strideZ + m_strideY);
+        }
+    }
+
+    static void prefetch(const void* address)
+    {
+#if defined(_MSC_VER)
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        __builtin_prefetch(address);
+#endif
+    }
+
+private:
+    const Volume::Sampler m_sampler;
+    const bool m_linear;
+    const void* m_data;
+    const VoxelType m_voxelType;
+    const glm::ivec3 m_dim;
+    const size_t m_strideY, m_strideZ;
+    const glm::ivec3 m_step;
+
+    // Starts far away from any cell so that the first sample loads all corners.
+    glm::ivec3 m_cell { -2 };
+    std::array<float, 8> m_corners;
+};
+
+}
@@ -0,0 +1,263 @@
+#include "sparse_volume.h"
+#include "profiling/profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <glm/glm.hpp>
+#include <gsl/span>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace volume {
+
+SparseVolume::SparseVolume(const Volume& volume)
+    : m_dim(volume.dims())
+    , m_voxelType(volume.voxelType())
+    , m_numTiles((m_dim + tileSize - 1) / tileSize)
+{
+    PROFILE_ZONE("SparseVolume(volume)");
+    withVoxelType(m_voxelType, [&](auto type) {
+        using T = decltype(type);
+        m_leaves = std::vector<T>();
+        addTiles<T>(volume, 0);
+    });
+    findUniformNeighbours();
+}
+
+SparseVolume::SparseVolume(const std::filesystem::path& file)
+{
+    PROFILE_ZONE("SparseVolume(file)");
+    for (int tileZ = 0;; tileZ++) {
+        Volume::Region region;
+        region.begin.z = tileZ * tileSize;
+        region.end.z = region.begin.z + tileSize;
+        // Quiet, as a large file has hundreds of slabs.
+        const Volume slab { file, region, Volume::Properties::Defer, Volume::LoadTime::Quiet };
+        if (slab.numVoxels() == 0)
+            break;
+
+        if (tileZ == 0) {
+            m_voxelType = slab.voxelType();
+            m_dim = glm::ivec3(slab.dims().x, slab.dims().y, 0);
+            m_numTiles = glm::ivec3((m_dim.x + tileSize - 1) / tileSize, (m_dim.y + tileSize - 1) / tileSize, 0);
+            withVoxelType(m_voxelType, [&](auto type) { m_leaves = std::vector<decltype(type)>(); });
+        }
+        m_dim.z += slab.dims().z;
+        m_numTiles.z++;
+        withVoxelType(m_voxelType, [&](auto type) { addTiles<decltype(type)>(slab, tileZ); });
+
+        if (slab.dims().z < tileSize)
+            break;
+    }
+    findUniformNeighbours();
+}
+
+// Append the tiles of voxels, which holds the voxels of the volume from slice firstTileZ * tileSize onwards (to the end
+// of the volume or to a multiple of tileSize). The uniform tiles are found first, so that the leaves are numbered in
+// the order of their tiles independent of the number of threads.
+template <typename T>
+void SparseVolume::addTiles(const Volume& voxels, int firstTileZ)
+{
+    const gsl::span<const T> data = voxels.data<T>();
+    const glm::ivec3 dim = voxels.dims();
+    const size_t firstTile = m_tiles.size();
+    const size_t numTilesXY = size_t(m_numTiles.x) * size_t(m_numTiles.y);
+    const size_t numNewTiles = numTilesXY * size_t((dim.z + tileSize - 1) / tileSize);
+    assert(firstTile == numTilesXY * size_t(firstTileZ));
+    m_tiles.resize(firstTile + numNewTiles);
+
+    // The part of a new tile that lies inside of the volume, in the coordinates of voxels.
+    const auto tileBox = [&](size_t i, glm::ivec3& begin, glm::ivec3& end) {
+        const glm::ivec3 tileIndex { int(i % size_t(m_numTiles.x)), int(i / size_t(m_numTiles.x) % size_t(m_numTiles.y)), int(i / numTilesXY) };
+        begin = tileIndex * tileSize;
+        end = glm::min(begin + tileSize, dim);
+    };
+    const auto row = [&](int y, int z) { return data.data() + size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z)); };
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, numNewTiles), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            glm::ivec3 begin, end;
+            tileBox(i, begin, end);
+            const T first = row(begin.y, begin.z)[begin.x];
+            bool uniform = true;
+            for (int z = begin.z; z < end.z && uniform; z++) {
+                for (int y = begin.y; y < end.y && uniform; y++) {
+                    const T* voxelRow = row(y, z);
+                    uniform = std::all_of(voxelRow + begin.x, voxelRow + end.x, [&](T voxel) { return voxel == first; });
+                }
+            }
+            Tile& tile = m_tiles[firstTile + i];
+            tile.leaf = uniform ? uniformTile : 0;
+            tile.value = uniform ? float(first) : 0.0f;
+        }
+    });
+
+    size_t leaf = numLeaves();
+    for (size_t i = firstTile; i < m_tiles.size(); i++) {
+        if (m_tiles[i].leaf != uniformTile)
+            m_tiles[i].leaf = uint32_t(leaf++);
+    }
+    assert(leaf < size_t(uniformTile));
+    std::vector<T>& leaves = std::get<std::vector<T>>(m_leaves);
+    leaves.resize(leaf * voxelsPerLeaf, T(0));
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, numNewTiles), [&](const tbb::blocked_range<size_t>& range) {
+        for (size_t i = range.begin(); i != range.end(); i++) {
+            const Tile& tile = m_tiles[firstTile + i];
+            if (tile.leaf == uniformTile)
+                continue;
+            glm::ivec3 begin, end;
+            tileBox(i, begin, end);
+            T* out = leaves.data() + size_t(tile.leaf) * voxelsPerLeaf;
+            for (int z = begin.z; z < end.z; z++) {
+                for (int y = begin.y; y < end.y; y++) {
+                    const size_t leafRow = size_t(tileSize) * (size_t(y - begin.y) + size_t(tileSize) * size_t(z - begin.z));
+                    std::copy(row(y, z) + begin.x, row(y, z) + end.x, out + leafRow);
+                }
+            }
+        }
+    });
+}
+
+// Find the uniform tiles with uniform cells (see Tile::uniformCells) and uniform neighbourhoods. The neighbours of a
+// tile with a uniform neighbourhood must be complete tiles, as voxels outside of the volume are sampled as 0.
+void SparseVolume::findUniformNeighbours()
+{
+    const auto sameValue = [&](const Tile& current, const glm::ivec3& neighbourIndex) {
+        const Tile& other = tile(neighbourIndex);
+        return other.leaf == uniformTile && other.value == current.value;
+    };
+    const glm::ivec3 completeTiles = m_dim / tileSize;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_numTiles.z), [&](const tbb::blocked_range<int>& range) {
+        for (int z = range.begin(); z != range.end(); z++) {
+            for (int y = 0; y < m_numTiles.y; y++) {
+                for (int x = 0; x < m_numTiles.x; x++) {
+                    const glm::ivec3 tileIndex { x, y, z };
+                    Tile& current = m_tiles[size_t(x) + size_t(m_numTiles.x) * (size_t(y) + size_t(m_numTiles.y) * size_t(z))];
+                    if (current.leaf != uniformTile)
+                        continue;
+
+                    // The tiles that share the far faces, edges and corner of the tile, if they lie inside of the volume.
+                    current.uniformCells = true;
+                    for (int neighbour = 1; neighbour < 8 && current.uniformCells; neighbour++) {
+                        const glm::ivec3 neighbourIndex = tileIndex + glm::ivec3(neighbour & 1, (neighbour >> 1) & 1, neighbour >> 2);
+                        if (glm::all(glm::lessThan(neighbourIndex, m_numTiles)))
+                            current.uniformCells = sameValue(current, neighbourIndex);
+                    }
+
+                    current.uniformNeighbourhood = current.uniformCells && glm::all(glm::greaterThan(tileIndex, glm::ivec3(0)))
+                        && glm::all(glm::lessThan(tileIndex + 1, completeTiles));
+                    for (int neighbour = 0; neighbour < 27 && current.uniformNeighbourhood; neighbour++) {
+                        const glm::ivec3 offset { neighbour % 3 - 1, neighbour / 3 % 3 - 1, neighbour / 9 - 1 };
+                        current.uniformNeighbourhood = sameValue(current, tileIndex + offset);
+                    }
+                }
+            }
+        }
+    });
+}
+
+glm::ivec3 SparseVolume::dims() const
+{
+    return m_dim;
+}
+
+VoxelType SparseVolume::voxelType() const
+{
+    return m_voxelType;
+}
+
+glm::ivec3 SparseVolume::numTiles() const
+{
+    return m_numTiles;
+}
+
+size_t SparseVolume::numLeaves() const
+{
+    return std::visit([](const auto& leaves) { return leaves.size() / voxelsPerLeaf; }, m_leaves);
+}
+
+size_t SparseVolume::memoryUsage() const
+{
+    return m_tiles.size() * sizeof(Tile) + numLeaves() * voxelsPerLeaf * voxelSize(m_voxelType);
+}
+
+template <typename T>
+const T* SparseVolume::leafData(uint32_t leaf) const
+{
+    return std::get<std::vector<T>>(m_leaves).data() + size_t(leaf) * voxelsPerLeaf;
+}
+
+float SparseVolume::getVoxel(int x, int y, int z) const
+{
+    const Tile& voxelTile = tile(glm::ivec3(x, y, z) / tileSize);
+    if (voxelTile.leaf == uniformTile)
+        return voxelTile.value;
+    const size_t i = size_t(x % tileSize) + size_t(tileSize) * (size_t(y % tileSize) + size_t(tileSize) * size_t(z % tileSize));
+    return withVoxelType(m_voxelType, [&](auto type) { return float(leafData<decltype(type)>(voxelTile.leaf)[i]); });
+}
+
+float SparseVolume::getSampleInterpolate(const glm::vec3& coord, InterpolationMode interpolationMode) const
+{
+    switch (interpolationMode) {
+    case InterpolationMode::NearestNeighbour: {
+        return getSampleNearestNeighbourInterpolation(coord);
+    }
+    case InterpolationMode::Linear: {
+        return getSampleTriLinearInterpolation(coord);
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+// Same bounds test and rounding as Volume::getSampleNearestNeighbourInterpolation.
+float SparseVolume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
+{
+    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
+        return 0.0f;
+    const glm::ivec3 voxel { coord + 0.5f };
+    return getVoxel(voxel.x, voxel.y, voxel.z);
+}
+
+float SparseVolume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
+{
+    return withVoxelType(m_voxelType, [&](auto type) { return sampleTriLinear<decltype(type)>(coord); });
+}
+
+// Same bounds test and blend order as Volume::getSampleTriLinearInterpolationFast, so that the results are identical.
+// Cells inside of a single tile (7 out of 8 along every axis) read their corners from its leaf or value directly.
+template <typename T>
+float SparseVolume::sampleTriLinear(const glm::vec3& coord) const
+{
+    const bool inside = (coord.x >= 0.0f) & (coord.y >= 0.0f) & (coord.z >= 0.0f)
+        & (coord.x + 1.0f < float(m_dim.x)) & (coord.y + 1.0f < float(m_dim.y)) & (coord.z + 1.0f < float(m_dim.z));
+    if (!inside)
+        return 0.0f;
+
+    const glm::ivec3 cell { coord };
+    const float xFactor = coord.x - float(cell.x);
+    const float yFactor = coord.y - float(cell.y);
+    const float zFactor = coord.z - float(cell.z);
+    const auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+    const auto interpolate = [&](auto corner) {
+        const auto pair = [&](int y, int z) { return lerp(corner(0, y, z), corner(1, y, z), xFactor); };
+        const float bottom = lerp(pair(0, 0), pair(1, 0), yFactor);
+        const float top = lerp(pair(0, 1), pair(1, 1), yFactor);
+        return lerp(bottom, top, zFactor);
+    };
+
+    const glm::ivec3 tileIndex = cell / tileSize;
+    const glm::ivec3 local = cell - tileIndex * tileSize;
+    if (glm::all(glm::lessThan(local, glm::ivec3(tileSize - 1)))) {
+        const Tile& cellTile = tile(tileIndex);
+        if (cellTile.leaf == uniformTile)
+            return cellTile.value;
+        const T* c = leafData<T>(cellTile.leaf) + size_t(local.x) + size_t(tileSize) * (size_t(local.y) + size_t(tileSize) * size_t(local.z));
+        return interpolate([&](int x, int y, int z) { return float(c[size_t(x) + size_t(tileSize) * (size_t(y) + size_t(tileSize) * size_t(z))]); });
+    }
+    return interpolate([&](int x, int y, int z) { return getVoxel(cell.x + x, cell.y + y, cell.z + z); });
+}
+
+}
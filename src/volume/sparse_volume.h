@@ -0,0 +1,81 @@
+#pragma once
+#include "volume/volume.h"
+#include "volume/voxel_type.h"
+#include <cstdint>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include <limits>
+#include <vector>
+
+namespace volume {
+
+// Two-level sparse storage for volumes that are mostly empty, in the spirit of OpenVDB: the volume is divided into
+// tiles of tileSize^3 voxels. A tile whose voxels all have the same value stores only that value; the other tiles
+// store their voxels in a dense leaf. Memory therefore scales with the part of the volume that holds data, and the
+// renderer skips uniform tiles without sampling them (see RenderConfig::sparseTraversal).
+// Sampling gives the same results as the dense volume for nearest neighbour and linear interpolation.
+class SparseVolume {
+public:
+    static constexpr int tileSize = 8;
+    static constexpr size_t voxelsPerLeaf = size_t(tileSize) * tileSize * tileSize;
+    static constexpr uint32_t uniformTile = std::numeric_limits<uint32_t>::max();
+
+    struct Tile {
+        // The leaf that holds the voxels of the tile, or uniformTile if they all equal value.
+        uint32_t leaf { uniformTile };
+        float value { 0.0f };
+        // Whether the voxels up to and including the first voxels of the next tiles along x, y and z (or up to the end
+        // of the volume) equal value as well. Trilinear samples anywhere in the tile, up to its far faces, then equal
+        // value; otherwise that only holds up to one voxel before its far faces.
+        bool uniformCells { false };
+        // Whether the 26 neighbours of the tile are uniform with the same value as well, and lie inside of the volume
+        // (not at its far faces). Samples up to a voxel outside of the tile then equal value.
+        bool uniformNeighbourhood { false };
+    };
+
+public:
+    explicit SparseVolume(const Volume& volume);
+    // Reads the file a slab of tiles at a time (see Volume::Region), so the dense volume never has to fit in memory.
+    explicit SparseVolume(const std::filesystem::path& file);
+
+    glm::ivec3 dims() const;
+    VoxelType voxelType() const;
+    glm::ivec3 numTiles() const;
+    // The tile that holds voxel tileIndex * tileSize; tileIndex must lie inside of numTiles(). Inline, as the renderer
+    // looks up a tile for every step along a ray.
+    const Tile& tile(const glm::ivec3& tileIndex) const
+    {
+        return m_tiles[size_t(tileIndex.x) + size_t(m_numTiles.x) * (size_t(tileIndex.y) + size_t(m_numTiles.y) * size_t(tileIndex.z))];
+    }
+    size_t numLeaves() const;
+    // Bytes taken by the tiles and the leaves.
+    size_t memoryUsage() const;
+
+    float getVoxel(int x, int y, int z) const;
+    // Same as Volume::getSampleInterpolate with the nearest neighbour or linear interpolation mode.
+    float getSampleInterpolate(const glm::vec3& coord, InterpolationMode interpolationMode) const;
+    float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
+    float getSampleTriLinearInterpolation(const glm::vec3& coord) const;
+
+private:
+    template <typename T>
+    void addTiles(const Volume& voxels, int firstTileZ);
+    void findUniformNeighbours();
+
+    template <typename T>
+    const T* leafData(uint32_t leaf) const;
+    template <typename T>
+    float sampleTriLinear(const glm::vec3& coord) const;
+
+private:
+    glm::ivec3 m_dim { 0 };
+    VoxelType m_voxelType { VoxelType::UInt8 };
+    glm::ivec3 m_numTiles { 0 };
+    // Tiles in x-major order (index = x + numTiles.x * (y + numTiles.y * z)).
+    std::vector<Tile> m_tiles;
+    // The voxels of every leaf in x-major order, one leaf after the other. Voxels of leaves at the far faces of the
+    // volume that lie outside of it are 0.
+    Volume::VoxelData m_leaves;
+};
+
+}
@@ -1,52 +1,146 @@
 #include "volume.h"
+#include "profiling/profiler.h"
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cctype> // isspace
 #include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <gsl/span>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 struct Header {
     glm::ivec3 dim;
-    size_t elementSize;
+    // Not set if the data type of the file is not supported.
+    std::optional<volume::VoxelType> voxelType;
+};
+// See Volume::histogram().
+struct Histogram {
+    std::vector<size_t> bins;
+    float begin { 0.0f }, binWidth { 1.0f };
 };
 static Header readHeader(std::ifstream& ifs);
-static float computeMinimum(gsl::span<const uint16_t> data);
-static float computeMaximum(gsl::span<const uint16_t> data);
-static std::vector<int> computeHistogram(gsl::span<const uint16_t> data);
+static volume::Volume::Region clampRegion(const volume::Volume::Region& region, const glm::ivec3& fileDims);
+template <typename T>
+static float computeMinimum(gsl::span<const T> data);
+template <typename T>
+static float computeMaximum(gsl::span<const T> data);
+template <typename T>
+static Histogram computeHistogram(gsl::span<const T> data, float minimum, float maximum);
+template <typename T>
+static std::vector<float> computeBSplineCoefficients(gsl::span<const T> data, const glm::ivec3& dim);
 
 namespace volume {
 
-Volume::Volume(const std::filesystem::path& file)
+// The x86 kernels (render/kernels.h) fetch the corner pair (x, x + 1) of a uint8 volume with a 32-bit load, which
+// reads up to 2 bytes past the last voxel. Byte volumes are padded so that these loads stay inside of the allocation.
+static constexpr size_t bytePadding = 2;
+
+Volume::Volume(const std::filesystem::path& file, Properties properties)
+    : Volume(file, Region {}, properties)
+{
+}
+
+Volume::Volume(const std::filesystem::path& file, const Region& region, Properties properties, LoadTime loadTime)
     : m_fileName(file.string())
 {
     using clock = std::chrono::high_resolution_clock;
     auto start = clock::now();
-    loadFile(file);
+    loadFile(file, region);
     auto end = clock::now();
-    std::cout << "Time to load: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+    if (loadTime == LoadTime::Print)
+        std::cout << "Time to load: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
 
-    if (m_data.size() > 0) {
-        m_minimum = computeMinimum(m_data);
-        m_maximum = computeMaximum(m_data);
-        m_histogram = computeHistogram(m_data);
-    }
+    initLayout();
+    if (properties == Properties::Compute)
+        computeProperties();
 }
 
-Volume::Volume(std::vector<uint16_t> data, const glm::ivec3& dim)
+Volume::Volume(VoxelData data, const glm::ivec3& dim)
     : m_fileName()
-    , m_elementSize(2)
     , m_dim(dim)
     , m_data(std::move(data))
-    , m_minimum(computeMinimum(m_data))
-    , m_maximum(computeMaximum(m_data))
-    , m_histogram(computeHistogram(m_data))
 {
+    assert(std::visit([](const auto& voxels) { return voxels.size(); }, m_data) == numVoxels());
+    initLayout();
+    computeProperties();
+}
+
+glm::ivec3 Volume::regionDims(const std::filesystem::path& file, const Region& region)
+{
+    std::ifstream ifs(file, std::ios::binary);
+    const Region clamped = clampRegion(region, readHeader(ifs).dim);
+    return (clamped.end - clamped.begin + clamped.stride - 1) / clamped.stride;
+}
+
+// The strides and the padding of the voxels, which every sampler relies on. Done before anything reads the voxels, so
+// that they are not reallocated under a concurrent reader.
+void Volume::initLayout()
+{
+    m_strideY = size_t(m_dim.x);
+    m_strideZ = size_t(m_dim.x) * size_t(m_dim.y);
+    std::visit([&](auto& voxels) {
+        using T = typename std::decay_t<decltype(voxels)>::value_type;
+        if constexpr (sizeof(T) == 1)
+            voxels.resize(numVoxels() + bytePadding, 0);
+    }, m_data);
+}
+
+void Volume::computeProperties()
+{
+    PROFILE_ZONE("Volume::computeProperties");
+    if (numVoxels() == 0)
+        return;
+
+    std::visit([&](const auto& voxels) {
+        using T = typename std::decay_t<decltype(voxels)>::value_type;
+        const gsl::span<const T> span { voxels.data(), numVoxels() };
+        m_minimum = computeMinimum(span);
+        m_maximum = computeMaximum(span);
+        Histogram histogram = computeHistogram(span, m_minimum, m_maximum);
+        m_histogram = std::move(histogram.bins);
+        m_histogramBegin = histogram.begin;
+        m_histogramBinWidth = histogram.binWidth;
+    }, m_data);
+}
+
+// Computes the B-spline coefficients if they have not been computed yet. Threads that sample the volume at the same
+// time wait for the first one to finish.
+void Volume::computeBSplineCoefficients() const
+{
+    std::call_once(m_pBSplineCoefficients->computed, [&]() {
+        std::visit([&](const auto& voxels) {
+            using T = typename std::decay_t<decltype(voxels)>::value_type;
+            m_pBSplineCoefficients->values = ::computeBSplineCoefficients(gsl::span<const T>(voxels.data(), numVoxels()), m_dim);
+        }, m_data);
+    });
+}
+
+Volume Volume::downsample(int stride) const
+{
+    PROFILE_ZONE("Volume::downsample");
+    const glm::ivec3 dim = (m_dim + stride - 1) / stride;
+    VoxelData data = std::visit([&](const auto& voxels) -> VoxelData {
+        using T = typename std::decay_t<decltype(voxels)>::value_type;
+        std::vector<T> result(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+        tbb::parallel_for(0, dim.z, [&](int z) {
+            for (int y = 0; y < dim.y; y++) {
+                const size_t row = size_t(y * stride) * m_strideY + size_t(z * stride) * m_strideZ;
+                T* pOut = &result[size_t(dim.x) * (size_t(y) + size_t(dim.y) * size_t(z))];
+                for (int x = 0; x < dim.x; x++)
+                    pOut[x] = voxels[row + size_t(x * stride)];
+            }
+        });
+        return result;
+    }, m_data);
+    return Volume(std::move(data), dim);
 }
 
 float Volume::minimum() const
@@ -59,39 +153,71 @@ float Volume::maximum() const
     return m_maximum;
 }
 
-std::vector<int> Volume::histogram() const
+const std::vector<size_t>& Volume::histogram() const
 {
     return m_histogram;
 }
 
+float Volume::histogramBegin() const
+{
+    return m_histogramBegin;
+}
+
+float Volume::histogramBinWidth() const
+{
+    return m_histogramBinWidth;
+}
+
 glm::ivec3 Volume::dims() const
 {
     return m_dim;
 }
 
+size_t Volume::numVoxels() const
+{
+    return size_t(m_dim.x) * size_t(m_dim.y) * size_t(m_dim.z);
+}
+
 std::string_view Volume::fileName() const
 {
     return m_fileName;
 }
 
+VoxelType Volume::voxelType() const
+{
+    return VoxelType(m_data.index());
+}
+
+const void* Volume::rawData() const
+{
+    return std::visit([](const auto& voxels) { return static_cast<const void*>(voxels.data()); }, m_data);
+}
+
+template <typename T>
+float Volume::voxel(size_t index) const
+{
+    return static_cast<float>(std::get<std::vector<T>>(m_data)[index]);
+}
+
 float Volume::getVoxel(int x, int y, int z) const
 {
-    const size_t i = size_t(x + m_dim.x * (y + m_dim.y * z));
-    return static_cast<float>(m_data[i]);
+    const size_t i = size_t(x) + m_strideY * size_t(y) + m_strideZ * size_t(z);
+    return withVoxelType(voxelType(), [&](auto type) { return voxel<decltype(type)>(i); });
 }
 
-// This function returns a value based on the current interpolation mode
-float Volume::getSampleInterpolate(const glm::vec3& coord) const
+template <typename T>
+Volume::Sampler::Function Volume::samplerFunction() const
 {
     switch (interpolationMode) {
     case InterpolationMode::NearestNeighbour: {
-        return getSampleNearestNeighbourInterpolation(coord);
+        return sampleNearestNeighbour<T>;
     }
     case InterpolationMode::Linear: {
-        return getSampleTriLinearInterpolation(coord);
+        return sampleTriLinear<T>;
     }
     case InterpolationMode::Cubic: {
-        return getSampleTriCubicInterpolation(coord);
+        // Interpolates the (float) B-spline coefficients, independent of the voxel type.
+        return [](const Volume& volume, const glm::vec3& coord) { return volume.getSampleTriCubicInterpolation(coord); };
     }
     default: {
         throw std::exception();
@@ -99,21 +225,43 @@ float Volume::getSampleInterpolate(const glm::vec3& coord) const
     }
 }
 
+// Resolve the function that samples this volume with the current interpolation mode. The sampler stays valid until
+// the interpolation mode changes, so the renderer creates one per frame.
+Volume::Sampler Volume::sampler() const
+{
+    Sampler sampler;
+    sampler.m_pVolume = this;
+    sampler.m_pFunction = withVoxelType(voxelType(), [&](auto type) { return samplerFunction<decltype(type)>(); });
+    return sampler;
+}
+
+// This function returns a value based on the current interpolation mode
+float Volume::getSampleInterpolate(const glm::vec3& coord) const
+{
+    return sampler()(coord);
+}
+
 // This function returns the nearest neighbour value at the continuous 3D position given by coord.
 // Notice that in this framework we assume that the distance between neighbouring voxels is 1 in all directions
 float Volume::getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const
+{
+    return withVoxelType(voxelType(), [&](auto type) { return sampleNearestNeighbour<decltype(type)>(*this, coord); });
+}
+
+template <typename T>
+float Volume::sampleNearestNeighbour(const Volume& volume, const glm::vec3& coord)
 {
     // check if the coordinate is within volume boundaries, since we only look at direct neighbours we only need to check within 0.5
-    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(m_dim))))
+    if (glm::any(glm::lessThan(coord + 0.5f, glm::vec3(0))) || glm::any(glm::greaterThanEqual(coord + 0.5f, glm::vec3(volume.m_dim))))
         return 0.0f;
 
     // nearest neighbour simply rounds to the closest voxel positions
     auto roundToPositiveInt = [](float f) {
         // rounding is equal to adding 0.5 and cutting off the fractional part
-        return static_cast<int>(f + 0.5f);
+        return static_cast<size_t>(f + 0.5f);
     };
 
-    return getVoxel(roundToPositiveInt(coord.x), roundToPositiveInt(coord.y), roundToPositiveInt(coord.z));
+    return volume.voxel<T>(roundToPositiveInt(coord.x) + volume.m_strideY * roundToPositiveInt(coord.y) + volume.m_strideZ * roundToPositiveInt(coord.z));
 }
 
 // ======= TODO : IMPLEMENT the functions below for tri-linear interpolation ========
@@ -138,6 +286,40 @@ float Volume::getSampleTriLinearInterpolation(const glm::vec3& coord) const
     return linearInterpolate(valueBottom, valueTop, zFactor);
 }
 
+// Same result as getSampleTriLinearInterpolation (which is kept as the reference implementation), but computes the
+// index of the first corner once and reaches the other 7 with the precomputed strides instead of 8 getVoxel calls.
+// The bounds test is a single predictable branch and the blends are written as a + t * (b - a) so the compiler can
+// contract them into FMAs when the target supports them.
+float Volume::getSampleTriLinearInterpolationFast(const glm::vec3& coord) const
+{
+    return withVoxelType(voxelType(), [&](auto type) { return sampleTriLinear<decltype(type)>(*this, coord); });
+}
+
+template <typename T>
+float Volume::sampleTriLinear(const Volume& volume, const glm::vec3& coord)
+{
+    const glm::ivec3& dim = volume.m_dim;
+    const bool inside = (coord.x >= 0.0f) & (coord.y >= 0.0f) & (coord.z >= 0.0f)
+        & (coord.x + 1.0f < float(dim.x)) & (coord.y + 1.0f < float(dim.y)) & (coord.z + 1.0f < float(dim.z));
+    if (!inside)
+        return 0.0f;
+
+    const int x0 = static_cast<int>(coord.x);
+    const int y0 = static_cast<int>(coord.y);
+    const int z0 = static_cast<int>(coord.z);
+    const float xFactor = coord.x - static_cast<float>(x0);
+    const float yFactor = coord.y - static_cast<float>(y0);
+    const float zFactor = coord.z - static_cast<float>(z0);
+
+    // The x neighbours are adjacent in memory, so the 8 corners are 4 contiguous pairs.
+    const size_t strideY = volume.m_strideY, strideZ = volume.m_strideZ;
+    const T* c = std::get<std::vector<T>>(volume.m_data).data() + size_t(x0) + strideY * size_t(y0) + strideZ * size_t(z0);
+    const auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+    const auto pair = [&](size_t offset) { return lerp(float(c[offset]), float(c[offset + 1]), xFactor); };
+    const float bottom = lerp(pair(0), pair(strideY), yFactor);
+    const float top = lerp(pair(strideZ), pair(strideZ + strideY), yFactor);
+    return lerp(bottom, top, zFactor);
+}
 
 // This function linearly interpolates the value at X using incoming values g0 and g1 given a factor (equal to the positon of x in 1D)
 //
@@ -183,64 +365,232 @@ float Volume::biLinearInterpolate(const glm::vec2& xyCoord, int z) const
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function represents the h(x) function, which returns the weight of the cubic interpolation kernel for a given position x
+// We use the cubic B-spline kernel. It is smooth (C2) and non-negative, but it does not pass through the voxel values
+// by itself; the B-spline coefficients are therefore prefiltered when the volume is loaded (see computeBSplineCoefficients).
 float Volume::weight(float x)
 {
+    x = std::abs(x);
+    if (x < 1.0f)
+        return (4.0f - 6.0f * x * x + 3.0f * x * x * x) / 6.0f;
+    if (x < 2.0f) {
+        const float t = 2.0f - x;
+        return t * t * t / 6.0f;
+    }
     return 0.0f;
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This functions returns the results of a cubic interpolation using 4 values and a factor
+// g0..g3 are the B-spline coefficients at positions -1, 0, 1 and 2; factor is the position in [0, 1) between g1 and g2.
 float Volume::cubicInterpolate(float g0, float g1, float g2, float g3, float factor)
 {
-    return 0.0f;
+    return g0 * weight(factor + 1.0f) + g1 * weight(factor) + g2 * weight(1.0f - factor) + g3 * weight(2.0f - factor);
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function returns the value of a bicubic interpolation
+// Direct evaluation using the 4x4 coefficients around xyCoord in slice z (16 taps).
 float Volume::biCubicInterpolate(const glm::vec2& xyCoord, int z) const
 {
-    return 0.0f;
+    computeBSplineCoefficients();
+    const int x1 = static_cast<int>(std::floor(xyCoord.x));
+    const int y1 = static_cast<int>(std::floor(xyCoord.y));
+    const float xFactor = xyCoord.x - static_cast<float>(x1);
+    const float yFactor = xyCoord.y - static_cast<float>(y1);
+
+    std::array<float, 4> rows;
+    for (int i = 0; i < 4; i++) {
+        const int y = y1 - 1 + i;
+        rows[size_t(i)] = cubicInterpolate(
+            getCoefficient(x1 - 1, y, z), getCoefficient(x1, y, z), getCoefficient(x1 + 1, y, z), getCoefficient(x1 + 2, y, z), xFactor);
+    }
+    return cubicInterpolate(rows[0], rows[1], rows[2], rows[3], yFactor);
 }
 
 // ======= OPTIONAL : This functions can be used to implement cubic interpolation ========
 // This function computes the tricubic interpolation at coord
+// Evaluating the 4x4x4 B-spline taps directly (4 biCubicInterpolate calls) costs 64 fetches. Because the B-spline
+// weights are non-negative, each pair of 1D taps can instead be folded into a single linear interpolation at an
+// offset position ("Fast Third-Order Texture Filtering", Sigg and Hadwiger), which reduces the 64 taps to
+// 8 tri-linear fetches of the coefficient volume.
 float Volume::getSampleTriCubicInterpolation(const glm::vec3& coord) const
 {
-    return 0.0f;
+    if (glm::any(glm::lessThan(coord, glm::vec3(0))) || glm::any(glm::greaterThan(coord, glm::vec3(m_dim - 1))))
+        return 0.0f;
+    computeBSplineCoefficients();
+
+    const glm::vec3 index = glm::floor(coord);
+    const glm::vec3 factor = coord - index;
+
+    // Per axis: the combined weights of the two tap pairs and the positions at which to fetch them.
+    glm::vec3 g0, g1, h0, h1;
+    for (int axis = 0; axis < 3; axis++) {
+        const float w0 = weight(factor[axis] + 1.0f);
+        const float w1 = weight(factor[axis]);
+        const float w2 = weight(1.0f - factor[axis]);
+        const float w3 = weight(2.0f - factor[axis]);
+        g0[axis] = w0 + w1;
+        g1[axis] = w2 + w3;
+        h0[axis] = index[axis] - 1.0f + w1 / g0[axis];
+        h1[axis] = index[axis] + 1.0f + w3 / g1[axis];
+    }
+
+    const auto fetch = [&](float x, float y, float z) { return getCoefficientTriLinearInterpolation(glm::vec3(x, y, z)); };
+    const float bottom = g0.y * (g0.x * fetch(h0.x, h0.y, h0.z) + g1.x * fetch(h1.x, h0.y, h0.z))
+        + g1.y * (g0.x * fetch(h0.x, h1.y, h0.z) + g1.x * fetch(h1.x, h1.y, h0.z));
+    const float top = g0.y * (g0.x * fetch(h0.x, h0.y, h1.z) + g1.x * fetch(h1.x, h0.y, h1.z))
+        + g1.y * (g0.x * fetch(h0.x, h1.y, h1.z) + g1.x * fetch(h1.x, h1.y, h1.z));
+    return g0.z * bottom + g1.z * top;
+}
+
+// Returns the B-spline coefficient at the given voxel. Positions outside of the volume are mirrored at the border,
+// matching the boundary condition used when the coefficients were computed.
+float Volume::getCoefficient(int x, int y, int z) const
+{
+    const auto mirror = [](int i, int size) {
+        if (size == 1)
+            return 0;
+        if (i < 0)
+            i = -i;
+        if (i >= size)
+            i = 2 * size - 2 - i;
+        return std::clamp(i, 0, size - 1);
+    };
+    const size_t i = size_t(mirror(x, m_dim.x)) + m_strideY * size_t(mirror(y, m_dim.y)) + m_strideZ * size_t(mirror(z, m_dim.z));
+    return m_pBSplineCoefficients->values[i];
+}
+
+// Tri-linear interpolation of the B-spline coefficients (the equivalent of a hardware texture fetch).
+float Volume::getCoefficientTriLinearInterpolation(const glm::vec3& coord) const
+{
+    const int x0 = static_cast<int>(std::floor(coord.x));
+    const int y0 = static_cast<int>(std::floor(coord.y));
+    const int z0 = static_cast<int>(std::floor(coord.z));
+    const float xFactor = coord.x - static_cast<float>(x0);
+    const float yFactor = coord.y - static_cast<float>(y0);
+    const float zFactor = coord.z - static_cast<float>(z0);
+
+    const auto lerp = [](float a, float b, float t) { return a + t * (b - a); };
+    // Away from the border no mirroring is needed and the 8 coefficients are read with fixed strides.
+    if (x0 >= 0 && y0 >= 0 && z0 >= 0 && x0 + 1 < m_dim.x && y0 + 1 < m_dim.y && z0 + 1 < m_dim.z) {
+        const size_t strideY = m_strideY, strideZ = m_strideZ;
+        const float* c = &m_pBSplineCoefficients->values[size_t(x0) + strideY * size_t(y0) + strideZ * size_t(z0)];
+        const float bottom = lerp(lerp(c[0], c[1], xFactor), lerp(c[strideY], c[strideY + 1], xFactor), yFactor);
+        c += strideZ;
+        const float top = lerp(lerp(c[0], c[1], xFactor), lerp(c[strideY], c[strideY + 1], xFactor), yFactor);
+        return lerp(bottom, top, zFactor);
+    }
+
+    const auto biLinear = [&](int z) {
+        return lerp(lerp(getCoefficient(x0, y0, z), getCoefficient(x0 + 1, y0, z), xFactor),
+            lerp(getCoefficient(x0, y0 + 1, z), getCoefficient(x0 + 1, y0 + 1, z), xFactor), yFactor);
+    };
+    return lerp(biLinear(z0), biLinear(z0 + 1), zFactor);
 }
 
 // Load an fld volume data file
-// First read and parse the header, then the volume data can be directly converted from bytes to uint16_ts
-void Volume::loadFile(const std::filesystem::path& file)
+// First read and parse the header, then the voxels are read directly into their native type. The data section of an
+// fld file is little endian, like the machines that VolVis runs on, so no conversion is needed.
+void Volume::loadFile(const std::filesystem::path& file, const Region& region)
 {
+    PROFILE_ZONE("Volume::loadFile");
     assert(std::filesystem::exists(file));
     std::ifstream ifs(file, std::ios::binary);
     assert(ifs.is_open());
 
     const auto header = readHeader(ifs);
-    m_dim = header.dim;
-    m_elementSize = header.elementSize;
+    const auto [begin, end, stride] = clampRegion(region, header.dim);
+    m_dim = (end - begin + stride - 1) / stride;
+    if (!header.voxelType) {
+        // Unsupported data type (reported by readHeader): an empty volume of the right size.
+        m_data = std::vector<uint16_t>(numVoxels(), 0);
+        return;
+    }
 
-    const size_t voxelCount = static_cast<size_t>(header.dim.x * header.dim.y * header.dim.z);
-    const size_t byteCount = voxelCount * header.elementSize;
-    std::vector<char> buffer(byteCount);
     // Data section is separated from header by two /f characters.
     ifs.seekg(2, std::ios::cur);
-    ifs.read(buffer.data(), std::streamsize(byteCount));
-
-    m_data.resize(voxelCount);
-    if (header.elementSize == 1) { // Bytes.
-        for (size_t i = 0; i < byteCount; i++) {
-            m_data[i] = static_cast<uint16_t>(buffer[i] & 0xFF);
-        }
-    } else if (header.elementSize == 2) { // uint16_ts.
-        for (size_t i = 0; i < byteCount; i += 2) {
-            m_data[i / 2] = static_cast<uint16_t>((buffer[i] & 0xFF) + (buffer[i + 1] & 0xFF) * 256);
+    const std::streamoff dataStart = ifs.tellg();
+    const size_t fileStrideY = size_t(header.dim.x), fileStrideZ = size_t(header.dim.x) * size_t(header.dim.y);
+    m_data = withVoxelType(*header.voxelType, [&](auto type) -> VoxelData {
+        using T = decltype(type);
+        std::vector<T> voxels(numVoxels());
+        if (voxels.empty())
+            return voxels;
+
+        // Read count voxels starting at voxel (x, y, z) of the file. Returns the number of voxels that were read, which
+        // is less than count if the file ends before them; the voxels that were not read (including a voxel of which
+        // only some bytes were read) are set to 0.
+        const auto read = [&](int x, int y, int z, T* pOut, size_t count) {
+            const size_t fileIndex = size_t(x) + size_t(y) * fileStrideY + size_t(z) * fileStrideZ;
+            ifs.seekg(dataStart + std::streamoff(fileIndex * sizeof(T)));
+            ifs.read(reinterpret_cast<char*>(pOut), std::streamsize(count * sizeof(T)));
+            if (ifs)
+                return count;
+            std::cerr << "File " << file << " ends before the voxels of its header" << std::endl;
+            const size_t numRead = size_t(std::max(ifs.gcount(), std::streamsize(0))) / sizeof(T);
+            std::fill(pOut + numRead, pOut + count, T(0));
+            return numRead;
+        };
+        const size_t sliceSize = size_t(m_dim.x) * size_t(m_dim.y);
+        const size_t rowGap = fileStrideY - size_t(m_dim.x);
+        if (stride == 1 && m_dim.x == header.dim.x && m_dim.y == header.dim.y) {
+            // Whole slices are contiguous in the file.
+            read(0, 0, begin.z, voxels.data(), voxels.size());
+        } else if (stride == 1 && m_dim.x == header.dim.x) {
+            // Whole rows: the rows of a slice are contiguous.
+            for (int z = 0; z < m_dim.z; z++) {
+                if (read(0, begin.y, begin.z + z, &voxels[size_t(z) * sliceSize], sliceSize) < sliceSize)
+                    break;
+            }
+        } else if (stride == 1 && rowGap <= size_t(m_dim.x)) {
+            // Partial rows that are at most their own length apart: read everything from the first to the last voxel
+            // of the region in a slice at once (at most twice the voxels of the region), and keep the parts of the
+            // rows that are in the region. If the file ends in the span, the voxels that were read are kept as well.
+            std::vector<T> span(size_t(m_dim.y - 1) * fileStrideY + size_t(m_dim.x));
+            for (int z = 0; z < m_dim.z; z++) {
+                const size_t numRead = read(begin.x, begin.y, begin.z + z, span.data(), span.size());
+                for (int y = 0; y < m_dim.y; y++)
+                    std::copy_n(&span[size_t(y) * fileStrideY], m_dim.x, &voxels[size_t(y) * size_t(m_dim.x) + size_t(z) * sliceSize]);
+                if (numRead < span.size())
+                    break;
+            }
+        } else if (stride == 1) {
+            // Partial rows that are further apart: read them one by one, straight into the volume.
+            for (int z = 0; z < m_dim.z; z++) {
+                for (int y = 0; y < m_dim.y; y++) {
+                    if (read(begin.x, begin.y + y, begin.z + z, &voxels[size_t(y) * size_t(m_dim.x) + size_t(z) * sliceSize], size_t(m_dim.x)) < size_t(m_dim.x))
+                        return voxels;
+                }
+            }
+        } else {
+            // Read the part of every row of the region that spans it, and keep every stride-th voxel.
+            std::vector<T> row(size_t(m_dim.x - 1) * size_t(stride) + 1);
+            for (int z = 0; z < m_dim.z; z++) {
+                for (int y = 0; y < m_dim.y; y++) {
+                    const size_t numRead = read(begin.x, begin.y + y * stride, begin.z + z * stride, row.data(), row.size());
+                    T* pOut = &voxels[size_t(y) * size_t(m_dim.x) + size_t(z) * sliceSize];
+                    for (int x = 0; x < m_dim.x; x++)
+                        pOut[x] = row[size_t(x) * size_t(stride)];
+                    if (numRead < row.size())
+                        return voxels;
+                }
+            }
         }
-    }
+        return voxels;
+    });
 }
 }
 
+// The region with its box clamped to the file and a stride of at least 1.
+static volume::Volume::Region clampRegion(const volume::Volume::Region& region, const glm::ivec3& fileDims)
+{
+    volume::Volume::Region out;
+    out.begin = glm::clamp(region.begin, glm::ivec3(0), fileDims);
+    out.end = glm::clamp(region.end, out.begin, fileDims);
+    out.stride = std::max(region.stride, 1);
+    return out;
+}
+
 static Header readHeader(std::ifstream& ifs)
 {
     Header out {};
@@ -277,9 +627,12 @@ static Header readHeader(std::ifstream& ifs)
                 std::cerr << "Only scalar m_data are supported" << std::endl;
         } else if (key == "data") {
             if (value == "byte") {
-                out.elementSize = 1;
+                out.voxelType = volume::VoxelType::UInt8;
             } else if (value == "short") {
-                out.elementSize = 2;
+                // The datasets store unsigned 16-bit values as short.
+                out.voxelType = volume::VoxelType::UInt16;
+            } else if (value == "float") {
+                out.voxelType = volume::VoxelType::Float32;
             } else {
                 std::cerr << "Data type " << value << " not recognized" << std::endl;
             }
@@ -295,20 +648,121 @@ static Header readHeader(std::ifstream& ifs)
     return out;
 }
 
-static float computeMinimum(gsl::span<const uint16_t> data)
+template <typename T>
+static bool isNaN(T value)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return std::isnan(value);
+    else
+        return false;
+}
+
+// NaNs order after every other value, so they are only the minimum if every voxel is NaN.
+template <typename T>
+static float computeMinimum(gsl::span<const T> data)
 {
-    return float(*std::min_element(std::begin(data), std::end(data)));
+    return float(*std::min_element(std::begin(data), std::end(data), [](T lhs, T rhs) { return lhs < rhs || (isNaN(rhs) && !isNaN(lhs)); }));
 }
 
-static float computeMaximum(gsl::span<const uint16_t> data)
+// NaNs order before every other value, so they are only the maximum if every voxel is NaN.
+template <typename T>
+static float computeMaximum(gsl::span<const T> data)
 {
-    return float(*std::max_element(std::begin(data), std::end(data)));
+    return float(*std::max_element(std::begin(data), std::end(data), [](T lhs, T rhs) { return lhs < rhs || (isNaN(lhs) && !isNaN(rhs)); }));
 }
 
-static std::vector<int> computeHistogram(gsl::span<const uint16_t> data)
+// See Volume::histogram(). A single bin of a large volume can hold more than 2^31 voxels.
+template <typename T>
+static Histogram computeHistogram(gsl::span<const T> data, float minimum, float maximum)
 {
-    std::vector<int> histogram(size_t(*std::max_element(std::begin(data), std::end(data)) + 1), 0);
-    for (const auto v : data)
-        histogram[v]++;
+    PROFILE_ZONE("computeHistogram");
+    Histogram histogram;
+    if constexpr (std::is_unsigned_v<T>) {
+        histogram.bins.resize(size_t(maximum) + 1, 0);
+        for (const T v : data)
+            histogram.bins[v]++;
+    } else {
+        if (std::isnan(minimum))
+            return histogram;
+        // Int16 volumes with few distinct values keep a bin per value.
+        const double range = double(maximum) - double(minimum);
+        const bool binPerValue = std::is_integral_v<T> && range < double(volume::Volume::maxHistogramBins);
+        const size_t numBins = binPerValue ? size_t(range) + 1 : (range > 0.0 ? volume::Volume::maxHistogramBins : 1);
+        histogram.begin = minimum;
+        histogram.binWidth = binPerValue || range == 0.0 ? 1.0f : float(range / double(numBins));
+        histogram.bins.resize(numBins, 0);
+        const double scale = 1.0 / double(histogram.binWidth);
+        for (const T v : data) {
+            if (isNaN(v))
+                continue;
+            histogram.bins[std::min(size_t((double(v) - double(minimum)) * scale), numBins - 1)]++;
+        }
+    }
     return histogram;
 }
+
+// Filter a single line of samples in place (with the given stride) such that the cubic B-spline through the
+// resulting coefficients interpolates the original samples. This is the recursive (causal + anti-causal) filter from
+// "Interpolation Revisited" by Thevenaz, Blu and Unser, using mirror boundary conditions.
+static void prefilterBSplineLine(float* line, size_t size, size_t stride)
+{
+    if (size < 2)
+        return;
+
+    const float pole = std::sqrt(3.0f) - 2.0f;
+    const float gain = (1.0f - pole) * (1.0f - 1.0f / pole);
+    const auto at = [&](size_t i) -> float& { return line[i * stride]; };
+    for (size_t i = 0; i < size; i++)
+        at(i) *= gain;
+
+    // Initial value of the causal filter: the sum over the mirrored signal, truncated once the pole's powers are
+    // negligible.
+    static constexpr size_t horizon = 12;
+    float sum = at(0);
+    if (horizon < size) {
+        float zn = pole;
+        for (size_t i = 1; i < horizon; i++) {
+            sum += zn * at(i);
+            zn *= pole;
+        }
+    } else {
+        float zn = pole;
+        float z2n = std::pow(pole, float(size - 1));
+        sum += z2n * at(size - 1);
+        z2n *= z2n / pole;
+        for (size_t i = 1; i < size - 1; i++) {
+            sum += (zn + z2n) * at(i);
+            zn *= pole;
+            z2n /= pole;
+        }
+        sum /= 1.0f - zn * zn;
+    }
+    at(0) = sum;
+    for (size_t i = 1; i < size; i++)
+        at(i) += pole * at(i - 1);
+
+    at(size - 1) = (pole / (pole * pole - 1.0f)) * (pole * at(size - 2) + at(size - 1));
+    for (size_t i = size - 1; i-- > 0;)
+        at(i) = pole * (at(i + 1) - at(i));
+}
+
+// Compute the cubic B-spline coefficients of the volume by prefiltering along x, y and z. The lines of each pass are
+// independent so they are filtered in parallel.
+template <typename T>
+static std::vector<float> computeBSplineCoefficients(gsl::span<const T> data, const glm::ivec3& dim)
+{
+    PROFILE_ZONE("computeBSplineCoefficients");
+    std::vector<float> coefficients(std::begin(data), std::end(data));
+
+    const size_t sizeX = size_t(dim.x), sizeY = size_t(dim.y), sizeZ = size_t(dim.z);
+    const auto filterLines = [&](size_t numLines, size_t size, size_t stride, auto lineStart) {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, numLines), [&](const tbb::blocked_range<size_t>& range) {
+            for (size_t line = std::begin(range); line != std::end(range); line++)
+                prefilterBSplineLine(&coefficients[lineStart(line)], size, stride);
+        });
+    };
+    filterLines(sizeY * sizeZ, sizeX, 1, [&](size_t line) { return line * sizeX; });
+    filterLines(sizeX * sizeZ, sizeY, sizeX, [&](size_t line) { return (line % sizeX) + (line / sizeX) * sizeX * sizeY; });
+    filterLines(sizeX * sizeY, sizeZ, sizeX * sizeY, [&](size_t line) { return line; });
+    return coefficients;
+}
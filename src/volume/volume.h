@@ -1,8 +1,15 @@
 #pragma once
+#include "voxel_type.h"
+#include <cstdint>
 #include <filesystem>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <gsl/span>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <variant>
 #include <vector>
 
 namespace volume {
@@ -13,21 +20,95 @@ enum class InterpolationMode {
     Cubic
 };
 
+// The two axes perpendicular to axis, in increasing order: the u and v axes of an image or slice of the volume along it.
+inline glm::ivec2 otherAxes(int axis)
+{
+    return glm::ivec2(axis == 0 ? 1 : 0, axis == 2 ? 1 : 2);
+}
+
 class Volume {
 public:
     // DO NOT REMOVE
     InterpolationMode interpolationMode { InterpolationMode::NearestNeighbour };
 
 public:
-    Volume(const std::filesystem::path& file);
-    Volume(std::vector<uint16_t> data, const glm::ivec3& dim);
+    // Voxels in their native type (see VoxelType), in x-major order (index = x + dims.x * (y + dims.y * z)).
+    using VoxelData = std::variant<std::vector<uint8_t>, std::vector<int16_t>, std::vector<uint16_t>, std::vector<float>>;
+
+    // Samples the volume with the interpolation mode and voxel type that were current when the sampler was created
+    // (see Volume::sampler). Resolving both up front keeps the branches on them out of the per-sample path.
+    class Sampler {
+    public:
+        using Function = float (*)(const Volume& volume, const glm::vec3& coord);
+
+        float operator()(const glm::vec3& coord) const { return m_pFunction(*m_pVolume, coord); }
+
+    private:
+        friend class Volume;
+        const Volume* m_pVolume { nullptr };
+        Function m_pFunction { nullptr };
+    };
+
+    // Whether the constructor computes the properties derived from the voxels (minimum(), maximum() and histogram()),
+    // or leaves that to a later call to computeProperties().
+    enum class Properties {
+        Compute,
+        Defer
+    };
+
+    // Whether the constructors that read a file print how long reading took.
+    enum class LoadTime {
+        Print,
+        Quiet
+    };
+
+    // The box [begin, end) of the voxels of a file, of which every stride-th voxel along every axis is loaded: voxel
+    // (x, y, z) of the volume is voxel begin + (x, y, z) * stride of the file. The box is clamped to the file.
+    struct Region {
+        glm::ivec3 begin { 0 };
+        glm::ivec3 end { std::numeric_limits<int>::max() };
+        int stride { 1 };
+    };
+
+public:
+    Volume(const std::filesystem::path& file, Properties properties = Properties::Compute);
+    // Only reads the part of the file that holds the region.
+    Volume(const std::filesystem::path& file, const Region& region, Properties properties = Properties::Compute, LoadTime loadTime = LoadTime::Print);
+    Volume(VoxelData data, const glm::ivec3& dim);
+
+    // The dimensions of the volume that Volume(file, region) loads. Only reads the header of the file.
+    static glm::ivec3 regionDims(const std::filesystem::path& file, const Region& region);
+
+    // Only reads the voxels, so other threads may read them (and sample the volume with nearest neighbour or linear
+    // interpolation) at the same time. See ui/volume_loader.h.
+    void computeProperties();
 
+    // Every stride-th voxel along every axis, without filtering: voxel (x, y, z) of the result is voxel
+    // (x, y, z) * stride of this volume. Only reads the voxels (see computeProperties).
+    Volume downsample(int stride) const;
+
+    // The smallest and largest value of the voxels. NaNs are left out (both are NaN if every voxel is).
     float minimum() const;
     float maximum() const;
-    std::vector<int> histogram() const;
+    // Bin i counts the voxels with a value in [histogramBegin() + i * histogramBinWidth(), histogramBegin() + (i + 1) *
+    // histogramBinWidth()); the last bin also counts the maximum. Unsigned volumes have a bin per value from 0 up to the
+    // maximum. Int16 and float volumes, whose values can be negative, far apart or between integers, have at most
+    // maxHistogramBins bins over [minimum(), maximum()]. NaNs are not counted.
+    const std::vector<size_t>& histogram() const;
+    float histogramBegin() const;
+    float histogramBinWidth() const;
+    static constexpr size_t maxHistogramBins = 4096;
     glm::ivec3 dims() const;
+    size_t numVoxels() const;
     std::string_view fileName() const;
+    VoxelType voxelType() const;
+    // The voxels, if they are stored as T (throws std::bad_variant_access otherwise).
+    template <typename T>
+    gsl::span<const T> data() const;
+    // Untyped pointer to the voxels, to be interpreted according to voxelType().
+    const void* rawData() const;
 
+    Sampler sampler() const;
     float getSampleInterpolate(const glm::vec3& coord) const;
     float getVoxel(int x, int y, int z) const;
 
@@ -35,6 +116,7 @@ protected:
     float getSampleNearestNeighbourInterpolation(const glm::vec3& coord) const;
 
     float getSampleTriLinearInterpolation(const glm::vec3& coord) const;
+    float getSampleTriLinearInterpolationFast(const glm::vec3& coord) const;
     float biLinearInterpolate(const glm::vec2& xyCoord, int z) const;
     static float linearInterpolate(float g0, float g1, float factor);
 
@@ -42,18 +124,48 @@ protected:
     float biCubicInterpolate(const glm::vec2& xyCoord, int z) const;
     static float cubicInterpolate(float g0, float g1, float g2, float g3, float factor);
     static float weight(float x);
+    float getCoefficient(int x, int y, int z) const;
+    float getCoefficientTriLinearInterpolation(const glm::vec3& coord) const;
+    void computeBSplineCoefficients() const;
 
 private:
-    void loadFile(const std::filesystem::path& file);
+    void loadFile(const std::filesystem::path& file, const Region& region);
+    void initLayout();
+
+    template <typename T>
+    float voxel(size_t index) const;
+    template <typename T>
+    static float sampleNearestNeighbour(const Volume& volume, const glm::vec3& coord);
+    template <typename T>
+    static float sampleTriLinear(const Volume& volume, const glm::vec3& coord);
+    template <typename T>
+    Sampler::Function samplerFunction() const;
 
 protected:
     const std::string m_fileName;
-    size_t m_elementSize;
     glm::ivec3 m_dim;
+    // Distance (in voxels) between neighbours along y and z in m_data.
+    size_t m_strideY, m_strideZ;
 
-    std::vector<uint16_t> m_data;
+    VoxelData m_data;
 
     float m_minimum, m_maximum;
-    std::vector<int> m_histogram;
+    std::vector<size_t> m_histogram;
+    float m_histogramBegin { 0.0f }, m_histogramBinWidth { 1.0f };
+
+    // Cubic B-spline coefficients (prefiltered voxel values) used by tri-cubic interpolation. They take 4 bytes per
+    // voxel, so they are only computed on the first cubic sample (see computeBSplineCoefficients()).
+    struct BSplineCoefficients {
+        std::once_flag computed;
+        std::vector<float> values;
+    };
+    std::unique_ptr<BSplineCoefficients> m_pBSplineCoefficients { std::make_unique<BSplineCoefficients>() };
 };
+
+template <typename T>
+gsl::span<const T> Volume::data() const
+{
+    return gsl::span<const T>(std::get<std::vector<T>>(m_data).data(), numVoxels());
+}
+
 }
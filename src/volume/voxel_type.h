@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+namespace volume {
+
+// Type in which the voxels of a volume are stored: the type of the data file, without conversion. The order matches
+// the alternatives of Volume::VoxelData.
+enum class VoxelType {
+    UInt8 = 0,
+    Int16,
+    UInt16,
+    Float32
+};
+
+// Size of a voxel of the given type in bytes.
+constexpr size_t voxelSize(VoxelType type)
+{
+    constexpr size_t sizes[] { sizeof(uint8_t), sizeof(int16_t), sizeof(uint16_t), sizeof(float) };
+    return sizes[size_t(type)];
+}
+
+// Calls function with a value of the C++ type of the given voxel type, to instantiate generic code per voxel type, and
+// returns its result.
+template <typename Function>
+auto withVoxelType(VoxelType type, Function&& function)
+{
+    switch (type) {
+    case VoxelType::UInt8: {
+        return function(uint8_t {});
+    }
+    case VoxelType::Int16: {
+        return function(int16_t {});
+    }
+    case VoxelType::UInt16: {
+        return function(uint16_t {});
+    }
+    case VoxelType::Float32: {
+        return function(float {});
+    }
+    default: {
+        throw std::exception();
+    }
+    }
+}
+
+}